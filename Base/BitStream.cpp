@@ -15,19 +15,22 @@ namespace KwlKit
 
 // BitStream
 
-BitStream::BitStream() : stream(0), raccum(0), raccumPos(0) {
+BitStream::BitStream() : stream(0), raccum(0), raccumPos(0), profile(0) {
 	Init();
 }
 
-BitStream::BitStream( Stream &s ) : stream(&s), raccum(0), raccumPos(0) {
+BitStream::BitStream( Stream &s ) : stream(&s), raccum(0), raccumPos(0), profile(0) {
 	Init();
 }
 
 void BitStream::Init()
 {
 	raccum = raccumPos = 0;
-	buffer.Resize(8192);
-	buffPtr = buffer.GetData();
+	readPos = 0;
+	if ( stream ) {
+		buffer.Resize(8192);
+	}
+	buffPtr = buffer.IsEmpty() ? 0 : buffer.GetData();
 	buffTop = buffPtr;			// assume read buffer
 }
 
@@ -51,6 +54,45 @@ bool BitStream::SetStream( Stream &s )
 	return 1;
 }
 
+// read directly from memory
+bool BitStream::SetMemory( const void *data, Int size )
+{
+	KWLKIT_ASSERT( (data || !size) && size >= 0 );
+	if (!Flush()) {
+		return 0;
+	}
+	stream = 0;
+	Init();
+	// read only => never written through
+	buffPtr = const_cast<Byte *>( static_cast<const Byte *>(data) );
+	buffTop = buffPtr + size;
+	readPos = size;
+	return 1;
+}
+
+// seek to bit position
+bool BitStream::SeekBits( Long pos )
+{
+	KWLKIT_ASSERT( pos >= 0 );
+	Long bytePos = pos >> 3;
+	raccum = raccumPos = 0;
+	if ( !stream ) {
+		// reading from memory: buffTop - readPos = start of memory
+		if ( KWLKIT_UNLIKELY( bytePos > readPos ) ) {
+			return 0;
+		}
+		buffPtr = buffTop - (readPos - bytePos);
+	} else {
+		buffPtr = buffTop = buffer.GetData();
+		readPos = bytePos;
+		if ( KWLKIT_UNLIKELY( !stream->Seek( bytePos ) ) ) {
+			return 0;
+		}
+	}
+	UInt tmp;
+	return !(pos & 7) || ReadBits( tmp, (Byte)(pos & 7) );
+}
+
 
 // read bits, no more than 24
 bool BitStream::ReadBits( UInt &u, Byte count )
@@ -83,25 +125,9 @@ fastfetch:
 		return 1;
 	}
 
-	// the trick here is that there may be some bytes left in buffer
-
-	Int left = (Int)(buffTop - buffPtr);
-
-	if ( left ) {
-		// note: can't use MemCpy here because of overlap (FIXME: use MemMove)
-		Byte *dst = buffer.GetData();
-		for ( Int i=0; i<left; i++ ) {
-			dst[i] = buffPtr[i];
-		}
-	}
-
-	// here we do slow read buffer and loop
-	Int nr;
-	if ( KWLKIT_UNLIKELY( !stream->Read( buffer.GetData()+left, buffer.GetSize()-left, nr ) ) ) {
+	if ( KWLKIT_UNLIKELY( !FillBuffer() ) ) {
 		return 0;
 	}
-	buffPtr = buffer.GetData();
-	buffTop = buffPtr + nr + left;
 	// we'll fast-fetch from buffer
 	while ( raccumPos < count && buffPtr < buffTop ) {
 		raccum |= (RAccum)*buffPtr++ << raccumPos;
@@ -114,6 +140,33 @@ fastfetch:
 	return 0;
 }
 
+// refill buffer from stream
+bool BitStream::FillBuffer()
+{
+	if ( !stream ) {
+		// reading from memory => nothing more to read
+		return 1;
+	}
+	// the trick here is that there may be some bytes left in buffer
+	Int left = (Int)(buffTop - buffPtr);
+
+	if ( left ) {
+		MemMove( buffer.GetData(), buffPtr, left );
+	}
+
+	Int nr;
+	{
+		KWLKIT_PROFILE_SCOPE( profile, PROFILE_STREAM_READ );
+		if ( KWLKIT_UNLIKELY( !stream->Read( buffer.GetData()+left, buffer.GetSize()-left, nr ) ) ) {
+			return 0;
+		}
+	}
+	buffPtr = buffer.GetData();
+	buffTop = buffPtr + nr + left;
+	readPos += nr;
+	return 1;
+}
+
 // read bits, up to 32 (slower than ReadBits)
 bool BitStream::ReadBits32( UInt &u, Byte count )
 {
@@ -171,7 +224,8 @@ bool BitStream::Flush() {
 bool BitStream::Reset()
 {
 	raccum = raccumPos = 0;
-	buffPtr = buffTop = buffer.GetData();
+	readPos = 0;
+	buffPtr = buffTop = buffer.IsEmpty() ? 0 : buffer.GetData();
 	return stream->Rewind();
 }
 
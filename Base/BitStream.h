@@ -9,6 +9,9 @@
 #include "Array.h"
 #include "Assert.h"
 #include "Likely.h"
+#include "Profile.h"
+#include "Memory.h"
+#include "Endian.h"
 
 namespace KwlKit
 {
@@ -29,6 +32,8 @@ public:
 
 	// attach underlying stream
 	bool SetStream( Stream &s );
+	// read directly from memory (no stream, no internal buffer), data must stay valid while reading
+	bool SetMemory( const void *data, Int size );
 	// detach stream (do not use)
 	void DetachStream();
 	// read bits, no more than 24!
@@ -74,18 +79,51 @@ public:
 	inline UInt PeekBitsFast( Byte count );
 	inline void PopBitsFast( Byte count );
 
+	// fast refill: tops accumulator up to at least FAST_REFILL_BITS using a single unaligned load
+	// only valid if CanRefillFast()
+	inline void RefillFast();
+	// at least FAST_REFILL_SLACK bytes buffered => RefillFast can be called a couple of times without checks
+	inline bool CanRefillFast() const {
+		return buffTop - buffPtr >= FAST_REFILL_SLACK;
+	}
+	// slow refill: tops accumulator up byte by byte from buffered bytes (never reads past buffer or from stream)
+	// returns number of bits in accumulator
+	inline Byte RefillSlow();
+	// peek bits already in accumulator (no refill), up to 16 (zero allowed)
+	inline UInt PeekAccum( Byte count ) const;
+	// refill buffer from stream (keeping unread bytes), returns 0 on error
+	// (no-op when reading from memory)
+	bool FillBuffer();
+
+	// get read position in bits (relative to stream position at SetStream/Reset or start of memory)
+	inline Long GetBitPosition() const {
+		return (readPos - (Long)(buffTop - buffPtr))*8 - raccumPos;
+	}
+	// seek to bit position (as returned by GetBitPosition), stream must support Seek
+	bool SeekBits( Long pos );
+
+	static const Byte FAST_REFILL_BITS = 8*sizeof(UIntPtr) - 8;
+	static const Int FAST_REFILL_SLACK = 16;
+
 	bool Close( bool force = 0 );
 
+	// set profiling stats sink (can be null), only used if KWLKIT_PROFILE is enabled
+	inline void SetProfileStats( ProfileStats *stats ) {
+		profile = stats;
+	}
+
 private:
-	Array<Byte> buffer;		// internal buffer (defaults to 8k)
-	Byte *buffPtr;			// ptr to next by in buffer
+	Array<Byte> buffer;		// internal buffer (defaults to 8k, allocated when stream is attached)
+	Byte *buffPtr;			// ptr to next by in buffer (points to user memory if reading from memory)
 	Byte *buffTop;			// buffer top
+	Long readPos;			// number of bytes fetched into buffer so far (memory size if reading from memory)
 
 	Stream *stream;			// reference ptr to underlying stream
 	// read accumulator
 	typedef UIntPtr RAccum;
 	RAccum raccum;
 	Byte raccumPos;
+	ProfileStats *profile;
 
 	void Init();
 };
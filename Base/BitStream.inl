@@ -55,6 +55,34 @@ inline UInt BitStream::PeekBitsFast( Byte count )
 	return ((UInt)raccum & (((UInt)1 << count)-1));
 }
 
+inline void BitStream::RefillFast()
+{
+	KWLKIT_ASSERT( buffPtr + sizeof(raccum) <= buffTop && raccumPos < 8*sizeof(raccum) );
+	// branchless: load whole word and only advance by the number of whole bytes that fit
+	// (upper bits of accumulator above raccumPos may hold part of the next byte, which is harmless
+	// because the same bits get or-ed in again on next refill)
+	RAccum tmp = LoadUnaligned<RAccum>( buffPtr );
+	Endian::FromLittle( tmp );
+	raccum |= tmp << raccumPos;
+	buffPtr += (8*sizeof(raccum) - 1 - raccumPos) >> 3;
+	raccumPos |= FAST_REFILL_BITS;
+}
+
+inline Byte BitStream::RefillSlow()
+{
+	while ( raccumPos <= 8*sizeof(raccum) - 8 && buffPtr < buffTop ) {
+		raccum |= (RAccum)*buffPtr++ << raccumPos;
+		raccumPos += 8;
+	}
+	return raccumPos;
+}
+
+inline UInt BitStream::PeekAccum( Byte count ) const
+{
+	KWLKIT_ASSERT( count <= 16 && raccumPos >= count );
+	return ((UInt)raccum & (((UInt)1 << count)-1));
+}
+
 inline void BitStream::PopBitsFast( Byte count )
 {
 	KWLKIT_ASSERT( raccumPos >= count );
@@ -41,6 +41,41 @@ struct Bits
 		x >>= 8*sizeof(T) - bits;
 	}
 
+	// index of lowest set bit (x must be nonzero)
+	static inline Int CountTrailingZeros( UInt x )
+	{
+		KWLKIT_ASSERT( x );
+#if KWLKIT_COMPILER_MSC
+		unsigned long res;
+		_BitScanForward( &res, x );
+		return (Int)res;
+#elif KWLKIT_COMPILER_GCC
+		return __builtin_ctz( x );
+#else
+		Int res = 0;
+		while ( !(x & 1) ) {
+			x >>= 1;
+			res++;
+		}
+		return res;
+#endif
+	}
+
+	static inline Int CountTrailingZeros( ULong x )
+	{
+		KWLKIT_ASSERT( x );
+#if KWLKIT_COMPILER_MSC && KWLKIT_64BIT
+		unsigned long res;
+		_BitScanForward64( &res, x );
+		return (Int)res;
+#elif KWLKIT_COMPILER_GCC
+		return __builtin_ctzll( x );
+#else
+		UInt lo = (UInt)x;
+		return lo ? CountTrailingZeros( lo ) : 32 + CountTrailingZeros( (UInt)(x >> 32) );
+#endif
+	}
+
 };
 
 // with the help of http://graphics.stanford.edu/~seander/bithacks.html#ReverseByteWith64BitsDiv - too lazy
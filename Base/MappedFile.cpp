@@ -0,0 +1,123 @@
+
+// (c) Martin Sedlak (mar) 2015
+// distributed under the Boost Software License, version 1.0
+// (see accompanying file License.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "MappedFile.h"
+#include "Assert.h"
+
+#if KWLKIT_OS_WINDOWS
+#	if !defined(WIN32_LEAN_AND_MEAN)
+#		define WIN32_LEAN_AND_MEAN
+#	endif
+#	if !defined(NOMINMAX)
+#		define NOMINMAX
+#	endif
+#	include <windows.h>
+#else
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <fcntl.h>
+#	include <unistd.h>
+#endif
+
+namespace KwlKit
+{
+
+// MappedFile
+
+MappedFile::MappedFile() : data(0), size(0), handle(0), open(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open( const char *filename )
+{
+	KWLKIT_ASSERT( filename );
+	Close();
+#if KWLKIT_OS_WINDOWS
+	wchar_t wname[MAX_PATH];
+	if ( !MultiByteToWideChar( CP_UTF8, 0, filename, -1, wname, MAX_PATH ) ) {
+		return 0;
+	}
+	HANDLE file = CreateFileW( wname, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0 );
+	if ( file == INVALID_HANDLE_VALUE ) {
+		return 0;
+	}
+	LARGE_INTEGER fsize;
+	if ( !GetFileSizeEx( file, &fsize ) || (ULong)fsize.QuadPart > (ULong)(size_t)-1 ) {
+		CloseHandle( file );
+		return 0;
+	}
+	size = (size_t)fsize.QuadPart;
+	if ( size ) {
+		// mapping object keeps the file open
+		HANDLE mapping = CreateFileMappingW( file, 0, PAGE_READONLY, 0, 0, 0 );
+		CloseHandle( file );
+		if ( !mapping ) {
+			size = 0;
+			return 0;
+		}
+		data = static_cast<const Byte *>( MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 ) );
+		if ( !data ) {
+			CloseHandle( mapping );
+			size = 0;
+			return 0;
+		}
+		handle = mapping;
+	} else {
+		CloseHandle( file );
+	}
+#else
+	int fd = ::open( filename, O_RDONLY );
+	if ( fd < 0 ) {
+		return 0;
+	}
+	struct stat st;
+	if ( fstat( fd, &st ) != 0 || st.st_size < 0 || (ULong)st.st_size > (ULong)(size_t)-1 ) {
+		::close( fd );
+		return 0;
+	}
+	size = (size_t)st.st_size;
+	if ( size ) {
+		// mapping stays valid after closing the descriptor
+		void *ptr = mmap( 0, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+		::close( fd );
+		if ( ptr == MAP_FAILED ) {
+			size = 0;
+			return 0;
+		}
+		data = static_cast<const Byte *>(ptr);
+	} else {
+		::close( fd );
+	}
+#endif
+	open = 1;
+	return 1;
+}
+
+void MappedFile::Close()
+{
+#if KWLKIT_OS_WINDOWS
+	if ( data ) {
+		UnmapViewOfFile( data );
+	}
+	if ( handle ) {
+		CloseHandle( static_cast<HANDLE>(handle) );
+	}
+#else
+	if ( data ) {
+		munmap( const_cast<Byte *>(data), size );
+	}
+#endif
+	data = 0;
+	size = 0;
+	handle = 0;
+	open = 0;
+}
+
+}
@@ -0,0 +1,45 @@
+
+// (c) Martin Sedlak (mar) 2015
+// distributed under the Boost Software License, version 1.0
+// (see accompanying file License.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "Types.h"
+#include "NoCopy.h"
+
+namespace KwlKit
+{
+
+// read-only memory mapped file (native handles are kept in the .cpp to keep system headers out)
+class MappedFile : public NoCopy
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	// filename is UTF-8 on Windows
+	bool Open( const char *filename );
+	void Close();
+
+	inline bool IsOpen() const {
+		return open;
+	}
+
+	// null for empty files
+	inline const Byte *GetData() const {
+		return data;
+	}
+
+	inline size_t GetSize() const {
+		return size;
+	}
+
+private:
+	const Byte *data;
+	size_t size;
+	void *handle;
+	bool open;
+};
+
+}
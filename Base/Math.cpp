@@ -1,76 +1,129 @@
-
 // (c) Martin Sedlak (mar) 2015
 // distributed under the Boost Software License, version 1.0
 // (see accompanying file License.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
 
 #include "Math.h"
 
+#if KWLKIT_SIMD_F16C
+#	include <immintrin.h>
+#elif KWLKIT_SIMD_SSE2
+#	include <emmintrin.h>
+#endif
+
+#if KWLKIT_SIMD_NEON
+#	include <arm_neon.h>
+#endif
+
 namespace KwlKit
 {
 
+// reference: https://github.com/Maratyszcza/FP16
+// branchless; doesn't do any denormal arithmetic so it's safe with FTZ/DAZ
 Float HalfToFloat( UShort h )
 {
-	// TODO: optimize later
-	Int s, e, m;
-	s = h >> 15;
-	e = (h >> 10) & 31;
-	m = h & 1023;
+	// shift out sign; exponent and mantissa are now at the top
+	UInt w = (UInt)h << 17;
+	UInt sign = ((UInt)h & 0x8000u) << 16;
+	// normalized: adjust exponent by 224 and scale by 2^-112 (=> bias 127-15); also preserves inf/NaN
+	UInt norm = FloatToBits( BitsToFloat( (w >> 4) + (0xe0u << 23) ) * BitsToFloat( 0x7800000u ) );
+	// denormal: 0.5 + m*2^-24 - 0.5
+	UInt denorm = FloatToBits( BitsToFloat( (w >> 17) | (126u << 23) ) - 0.5f );
+	return BitsToFloat( sign | (w < (1u << 27) ? denorm : norm) );
+}
 
-	Int sign = 1 - (s << 1);
-	const Float mscl = 1.0f/1024.0f;
+// not required by kwl decoder but keeping for completeness
+UShort FloatToHalf( Float f )
+{
+	UInt u = FloatToBits( f );
+	UInt sign = (u >> 16) & 0x8000u;
+	UInt a = u & 0x7fffffffu;
+	// truncate mantissa and adjust exponent bias (127-15)
+	UInt res = (a >> 13) - (112u << 10);
+	// flush denormals to zero (below 2^-14)
+	res = a < 0x38800000u ? 0 : res;
+	// above 65504 => infinity
+	res = a > 0x477fe000u ? 0x7c00u : res;
+	res |= sign;
+	// NaN
+	res = a > 0x7f800000u ? 0x7fffu : res;
+	return (UShort)res;
+}
 
-	if ( e == 31 ) {
-		// handle special exponent...
-		// m == 0 => infinity
-		//   != 0 => NaN
-		return m == 0 ? Limits<Float>::Infinity()*sign : Limits<Float>::NaN();
+void HalfToFloat( const UShort *src, Float *dst, Int count )
+{
+	KWLKIT_ASSERT( count >= 0 && (!count || (src && dst)) );
+	Int i = 0;
+#if KWLKIT_SIMD_F16C
+	for ( ; i+4 <= count; i += 4 ) {
+		__m128i h = _mm_loadl_epi64( CastTo<const __m128i *>( src+i ) );
+		_mm_storeu_ps( dst+i, _mm_cvtph_ps( h ) );
 	}
-	if ( e == 0 ) {
-		// zero or denormal
-		return (1.0f / (1 << 14)) * sign * (m*mscl);
+#elif KWLKIT_SIMD_SSE2
+	// same as scalar version
+	const __m128i zero = _mm_setzero_si128();
+	for ( ; i+4 <= count; i += 4 ) {
+		__m128i h = _mm_unpacklo_epi16( _mm_loadl_epi64( CastTo<const __m128i *>( src+i ) ), zero );
+		__m128i w = _mm_slli_epi32( h, 17 );
+		__m128i sign = _mm_slli_epi32( _mm_and_si128( h, _mm_set1_epi32( 0x8000 ) ), 16 );
+		__m128 norm = _mm_castsi128_ps( _mm_add_epi32( _mm_srli_epi32( w, 4 ), _mm_set1_epi32( 0xe0 << 23 ) ) );
+		norm = _mm_mul_ps( norm, _mm_castsi128_ps( _mm_set1_epi32( 0x7800000 ) ) );
+		__m128 denorm = _mm_castsi128_ps( _mm_or_si128( _mm_srli_epi32( w, 17 ), _mm_set1_epi32( 126 << 23 ) ) );
+		denorm = _mm_sub_ps( denorm, _mm_set1_ps( 0.5f ) );
+		__m128i isDenorm = _mm_cmpeq_epi32( _mm_srli_epi32( w, 27 ), zero );
+		__m128i res = _mm_or_si128( _mm_and_si128( isDenorm, _mm_castps_si128( denorm ) ),
+			_mm_andnot_si128( isDenorm, _mm_castps_si128( norm ) ) );
+		_mm_storeu_ps( dst+i, _mm_castsi128_ps( _mm_or_si128( res, sign ) ) );
 	}
-	// normalized
-	if ( e >= 15 ) {
-		return (Float)(1 << (e-15)) * sign * (1.0f + m*mscl );
+#elif KWLKIT_SIMD_NEON && KWLKIT_CPU_ARM64
+	for ( ; i+4 <= count; i += 4 ) {
+		float16x4_t h = vreinterpret_f16_u16( vld1_u16( src+i ) );
+		vst1q_f32( dst+i, vcvt_f32_f16( h ) );
+	}
+#endif
+	for ( ; i<count; i++ ) {
+		dst[i] = HalfToFloat( src[i] );
 	}
-	return (1.0f / (1 << (15-e))) * sign * (1.0f + m*mscl);
 }
 
-// not required by kwl decoder but keeping for completeness
-UShort FloatToHalf( Float f )
+// note: we don't use F16C here because it rounds denormals/overflows differently
+void FloatToHalf( const Float *src, UShort *dst, Int count )
 {
-	// handle extreme cases first
-	if ( Limits<Float>::IsNan(f) ) {
-		return 0x7fff;
+	KWLKIT_ASSERT( count >= 0 && (!count || (src && dst)) );
+	Int i = 0;
+#if KWLKIT_SIMD_SSE2
+	// same as scalar version; a is always positive so we can use signed compares
+	for ( ; i+4 <= count; i += 4 ) {
+		__m128i u = _mm_castps_si128( _mm_loadu_ps( src+i ) );
+		__m128i sign = _mm_and_si128( _mm_srli_epi32( u, 16 ), _mm_set1_epi32( 0x8000 ) );
+		__m128i a = _mm_and_si128( u, _mm_set1_epi32( 0x7fffffff ) );
+		__m128i res = _mm_sub_epi32( _mm_srli_epi32( a, 13 ), _mm_set1_epi32( 112 << 10 ) );
+		__m128i tiny = _mm_cmplt_epi32( a, _mm_set1_epi32( 0x38800000 ) );
+		__m128i huge = _mm_cmpgt_epi32( a, _mm_set1_epi32( 0x477fe000 ) );
+		__m128i nan = _mm_cmpgt_epi32( a, _mm_set1_epi32( 0x7f800000 ) );
+		res = _mm_andnot_si128( tiny, res );
+		res = _mm_or_si128( _mm_andnot_si128( huge, res ), _mm_and_si128( huge, _mm_set1_epi32( 0x7c00 ) ) );
+		res = _mm_or_si128( res, sign );
+		res = _mm_or_si128( _mm_andnot_si128( nan, res ), _mm_and_si128( nan, _mm_set1_epi32( 0x7fff ) ) );
+		// sign-extend so that signed saturation in pack keeps values intact
+		res = _mm_srai_epi32( _mm_slli_epi32( res, 16 ), 16 );
+		_mm_storel_epi64( CastTo<__m128i *>( dst+i ), _mm_packs_epi32( res, res ) );
 	}
-	UShort res = (UShort)(f < 0) << 15;
-	f = Abs(f);
-	if ( f > 65504.0f ) {
-		return res | 0x7c00;
+#elif KWLKIT_SIMD_NEON
+	for ( ; i+4 <= count; i += 4 ) {
+		uint32x4_t u = vreinterpretq_u32_f32( vld1q_f32( src+i ) );
+		uint32x4_t sign = vandq_u32( vshrq_n_u32( u, 16 ), vdupq_n_u32( 0x8000 ) );
+		uint32x4_t a = vandq_u32( u, vdupq_n_u32( 0x7fffffff ) );
+		uint32x4_t res = vsubq_u32( vshrq_n_u32( a, 13 ), vdupq_n_u32( 112 << 10 ) );
+		res = vbicq_u32( res, vcltq_u32( a, vdupq_n_u32( 0x38800000 ) ) );
+		res = vbslq_u32( vcgtq_u32( a, vdupq_n_u32( 0x477fe000 ) ), vdupq_n_u32( 0x7c00 ), res );
+		res = vorrq_u32( res, sign );
+		res = vbslq_u32( vcgtq_u32( a, vdupq_n_u32( 0x7f800000 ) ), vdupq_n_u32( 0x7fff ), res );
+		vst1_u16( dst+i, vmovn_u32( res ) );
 	}
-	// flush denormals to zero
-	if ( f < (1.0f / (1<<14)) ) {
-		return res;
+#endif
+	for ( ; i<count; i++ ) {
+		dst[i] = FloatToHalf( src[i] );
 	}
-	Int e;
-	Float m = frexp( f, &e );
-	// adjust from <0.5..1) to <1..2)
-	e--;
-	m *= 2.0f;
-	KWLKIT_ASSERT( e > -15 && e <= 15 );
-	res |= (UShort)((e+15) << 10);
-
-	/*
-	2^e * m = -1^sgn * 2^(pe-15) * (1 + m/1024)
-	e = pe - 15;
-	pe = e+15;
-	fm = 1 + pm/1024
-	pm/1024 = fm-1
-	pm = (fm-1) * 1024
-	*/
-	res |= (UShort)FloatToInt( (m - 1.0f) * 1024.0f );
-	return res;
 }
 
-
 }
@@ -168,10 +168,30 @@ static inline Int FloatToInt( Float f ) {
 	return (Int)Floor(f);
 }
 
+// reinterpret float as bits and vice versa
+static inline UInt FloatToBits( Float f )
+{
+	union { Float f; UInt u; } tmp;
+	tmp.f = f;
+	return tmp.u;
+}
+
+static inline Float BitsToFloat( UInt u )
+{
+	union { Float f; UInt u; } tmp;
+	tmp.u = u;
+	return tmp.f;
+}
+
 // half float support
 Float HalfToFloat( UShort h );
+// note: truncates mantissa and flushes denormals to zero
 UShort FloatToHalf( Float f );
 
+// batch versions (SIMD if available), results are identical to scalar versions (except for NaN payload)
+void HalfToFloat( const UShort *src, Float *dst, Int count );
+void FloatToHalf( const Float *src, UShort *dst, Int count );
+
 static inline Int RoundFloatToInt( Float f )
 {
 #if 1
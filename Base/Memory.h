@@ -6,6 +6,7 @@
 #pragma once
 
 #include "Types.h"
+#include <cstring>
 
 namespace KwlKit
 {
@@ -17,4 +18,16 @@ void MemCpy( void *dst, const void *src, size_t count );
 void MemMove( void *dst, const void *src, size_t count );
 int MemCmp( const void *src0, const void *src1, size_t count );
 
+// unaligned load/store (native endianness), compiles to a plain move where possible
+template< typename T > static inline T LoadUnaligned( const void *src )
+{
+	T res;
+	memcpy( &res, src, sizeof(T) );
+	return res;
+}
+
+template< typename T > static inline void StoreUnaligned( void *dst, T value ) {
+	memcpy( dst, &value, sizeof(T) );
+}
+
 }
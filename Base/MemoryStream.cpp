@@ -0,0 +1,80 @@
+
+// (c) Martin Sedlak (mar) 2015
+// distributed under the Boost Software License, version 1.0
+// (see accompanying file License.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "MemoryStream.h"
+#include "Memory.h"
+#include "Templates.h"
+
+namespace KwlKit
+{
+
+// MemoryStream
+
+MemoryStream::MemoryStream() : data(0), size(0), pos(0)
+{
+}
+
+MemoryStream::MemoryStream( const void *ndata, size_t nsize ) : data(0), size(0), pos(0)
+{
+	SetData( ndata, nsize );
+}
+
+void MemoryStream::SetData( const void *ndata, size_t nsize )
+{
+	KWLKIT_ASSERT( ndata || !nsize );
+	data = static_cast<const Byte *>(ndata);
+	size = nsize;
+	pos = 0;
+}
+
+bool MemoryStream::Read( void *buf, Int count, Int &nread )
+{
+	KWLKIT_ASSERT( buf && count >= 0 );
+	nread = (Int)Min( (size_t)count, size - pos );
+	if ( nread > 0 ) {
+		MemCpy( buf, data + pos, (size_t)nread );
+	}
+	pos += (size_t)nread;
+	return 1;
+}
+
+bool MemoryStream::Rewind()
+{
+	pos = 0;
+	return 1;
+}
+
+bool MemoryStream::Seek( Long npos )
+{
+	if ( npos < 0 || (ULong)npos > (ULong)size ) {
+		return 0;
+	}
+	pos = (size_t)npos;
+	return 1;
+}
+
+const void *MemoryStream::GetMemory( size_t &nsize )
+{
+	nsize = size;
+	return data;
+}
+
+// ArrayStream
+
+ArrayStream::ArrayStream( Array< Byte > &ndata ) : data(&ndata)
+{
+}
+
+bool ArrayStream::Write( const void *buf, Int count )
+{
+	KWLKIT_ASSERT( (buf || !count) && count >= 0 );
+	if ( count > 0 ) {
+		const Byte *b = static_cast<const Byte *>(buf);
+		data->insert( data->end(), b, b + count );
+	}
+	return 1;
+}
+
+}
@@ -0,0 +1,57 @@
+
+// (c) Martin Sedlak (mar) 2015
+// distributed under the Boost Software License, version 1.0
+// (see accompanying file License.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "Stream.h"
+
+namespace KwlKit
+{
+
+// read-only stream over a memory block (memory must stay valid while reading)
+class MemoryStream : public Stream
+{
+public:
+	KWLKIT_INJECT_STREAM()
+
+	MemoryStream();
+	MemoryStream( const void *ndata, size_t nsize );
+
+	void SetData( const void *ndata, size_t nsize );
+
+	bool Read( void *buf, Int count, Int &nread );
+	bool Rewind();
+	bool Seek( Long pos );
+	const void *GetMemory( size_t &nsize );
+
+	inline Long Tell() const {
+		return (Long)pos;
+	}
+
+private:
+	const Byte *data;
+	size_t size;
+	size_t pos;
+};
+
+// output stream appending to an array (array must stay valid while writing)
+class ArrayStream : public Stream
+{
+public:
+	KWLKIT_INJECT_STREAM()
+
+	explicit ArrayStream( Array< Byte > &ndata );
+
+	bool Write( const void *buf, Int count );
+
+	inline Array< Byte > &GetArray() {
+		return *data;
+	}
+
+private:
+	Array< Byte > *data;
+};
+
+}
@@ -78,6 +78,26 @@ namespace KwlKit
 #	define KWLKIT_PLATFORM_EMSCRIPTEN	1
 #endif
 
+// SIMD instruction sets available at compile time
+// define KWLKIT_NO_SIMD to force generic code
+#if !defined(KWLKIT_NO_SIMD)
+#	if KWLKIT_CPU_X86 && (defined(__SSE2__) || KWLKIT_CPU_AMD64 || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#		define KWLKIT_SIMD_SSE2			1
+#	endif
+#	if KWLKIT_CPU_X86 && defined(__AVX2__)
+#		define KWLKIT_SIMD_AVX2			1
+#	endif
+#	if KWLKIT_CPU_X86 && (defined(__SSSE3__) || KWLKIT_SIMD_AVX2)
+#		define KWLKIT_SIMD_SSSE3			1
+#	endif
+#	if KWLKIT_CPU_X86 && (defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__)))
+#		define KWLKIT_SIMD_F16C			1
+#	endif
+#	if KWLKIT_CPU_ARM && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#		define KWLKIT_SIMD_NEON			1
+#	endif
+#endif
+
 // platform-dependent macros for 64-bit long integer constants (assuming 32+-bit compiler so no need for 32-bit version)
 #define KWLKIT_CONST_LONG(x) x##ll
 #define KWLKIT_CONST_ULONG(x) x##ull
@@ -0,0 +1,94 @@
+// (c) Martin Sedlak (mar) 2015
+// distributed under the Boost Software License, version 1.0
+// (see accompanying file License.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "Types.h"
+#include "Timer.h"
+
+// define KWLKIT_PROFILE to 1 to enable per-stage decode profiling
+// when disabled (default), profiling scopes compile to nothing
+#if !defined(KWLKIT_PROFILE)
+#	define KWLKIT_PROFILE 0
+#endif
+
+namespace KwlKit
+{
+
+enum ProfileStage
+{
+	PROFILE_STREAM_READ,		// input stream reads (BitStream refills)
+	PROFILE_INFLATE,			// Inflate::Read (total, includes the stages below)
+	PROFILE_HUFFMAN_BUILD,		// Huffman table builds
+	PROFILE_COMPRESSED_BLOCK,	// compressed block decoding
+	PROFILE_DEQUANT,			// KwlFile::Decompress (dequantization)
+	PROFILE_IMDCT,				// DoIMdct
+	PROFILE_OVERLAP_ADD,		// OverlapAdd
+	PROFILE_CONV_SAMPLES,		// output sample conversion
+	PROFILE_RESAMPLE,			// resampling
+	PROFILE_STAGE_COUNT
+};
+
+struct ProfileCounter
+{
+	ULong nanoseconds;			// accumulated time (inclusive)
+	ULong calls;				// number of calls
+};
+
+// polled by the user; all counters are cumulative until Reset
+struct ProfileStats
+{
+	ProfileCounter stages[PROFILE_STAGE_COUNT];
+
+	inline ProfileStats() {
+		Reset();
+	}
+
+	inline void Reset()
+	{
+		for ( Int i=0; i<PROFILE_STAGE_COUNT; i++ ) {
+			stages[i].nanoseconds = stages[i].calls = 0;
+		}
+	}
+
+	static inline const char *GetStageName( Int stage )
+	{
+		static const char * const names[PROFILE_STAGE_COUNT] = {
+			"StreamRead", "Inflate", "HuffmanBuild", "CompressedBlock", "Dequant", "IMdct", "OverlapAdd",
+			"ConvSamples", "Resample"
+		};
+		return stage >= 0 && stage < PROFILE_STAGE_COUNT ? names[stage] : "";
+	}
+};
+
+#if KWLKIT_PROFILE
+
+class ProfileScope
+{
+public:
+	inline ProfileScope( ProfileStats *nstats, ProfileStage nstage ) : stats(nstats), stage(nstage) {
+		start = stats ? Timer::GetNanoseconds() : 0;
+	}
+
+	inline ~ProfileScope()
+	{
+		if ( stats ) {
+			ProfileCounter &c = stats->stages[stage];
+			c.nanoseconds += Timer::GetNanoseconds() - start;
+			c.calls++;
+		}
+	}
+
+private:
+	ProfileStats *stats;
+	ProfileStage stage;
+	ULong start;
+};
+
+#	define KWLKIT_PROFILE_SCOPE( stats, stage ) ProfileScope profileScope_##stage( stats, stage )
+#else
+#	define KWLKIT_PROFILE_SCOPE( stats, stage )
+#endif
+
+}
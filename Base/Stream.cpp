@@ -31,6 +31,18 @@ bool Stream::Rewind() {
 	return 0;
 }
 
+bool Stream::Seek( Long pos )
+{
+	KWLKIT_ASSERT( pos >= 0 );
+	return Rewind() && SkipRead( pos );
+}
+
+const void *Stream::GetMemory( size_t &size )
+{
+	size = 0;
+	return 0;
+}
+
 bool Stream::Read( void *buf, Int size, Int &nread )
 {
 	(void)buf;
@@ -39,6 +51,13 @@ bool Stream::Read( void *buf, Int size, Int &nread )
 	return 0;
 }
 
+bool Stream::Write( const void *buf, Int size )
+{
+	(void)buf;
+	(void)size;
+	return 0;
+}
+
 // skip bytes (read)
 bool Stream::SkipRead( Long bytes )
 {
@@ -33,6 +33,9 @@ public:
 		Int nr;	return Read( buf, size, nr ) && nr == size;
 	}
 
+	// write whole buffer, returns 0 on failure (not supported by default)
+	virtual bool Write( const void *buf, Int size );
+
 	// not really needed
 	virtual bool Flush();
 
@@ -40,6 +43,14 @@ public:
 
 	virtual bool Rewind();
 
+	// seek to absolute position (relative to where Rewind goes)
+	// default implementation rewinds and skips, override if stream supports fast seeking
+	virtual bool Seek( Long pos );
+
+	// direct access to whole stream contents (relative to where Rewind goes) for memory-backed streams
+	// returns null if not supported
+	virtual const void *GetMemory( size_t &size );
+
 	// helper (skips nbytes forward)
 	bool SkipRead( Long bytes );
 };
@@ -0,0 +1,295 @@
+
+// (c) Martin Sedlak (mar) 2015
+// distributed under the Boost Software License, version 1.0
+// (see accompanying file License.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "Thread.h"
+#include "Assert.h"
+
+#if KWLKIT_OS_WINDOWS
+#	if !defined(WIN32_LEAN_AND_MEAN)
+#		define WIN32_LEAN_AND_MEAN
+#	endif
+#	if !defined(NOMINMAX)
+#		define NOMINMAX
+#	endif
+#	include <windows.h>
+#	include <process.h>
+#else
+#	include <pthread.h>
+#	include <unistd.h>
+#endif
+
+namespace KwlKit
+{
+
+// native thread entry point
+struct ThreadEntry
+{
+#if KWLKIT_OS_WINDOWS
+	static unsigned __stdcall Entry( void *param )
+	{
+		Thread::Run( static_cast<Thread *>(param) );
+		return 0;
+	}
+#else
+	static void *Entry( void *param )
+	{
+		Thread::Run( static_cast<Thread *>(param) );
+		return 0;
+	}
+#endif
+};
+
+// Mutex
+
+Mutex::Mutex()
+{
+#if KWLKIT_NO_THREADS
+	handle = 0;
+#elif KWLKIT_OS_WINDOWS
+	CRITICAL_SECTION *cs = new CRITICAL_SECTION;
+	InitializeCriticalSection( cs );
+	handle = cs;
+#else
+	pthread_mutex_t *m = new pthread_mutex_t;
+	pthread_mutex_init( m, 0 );
+	handle = m;
+#endif
+}
+
+Mutex::~Mutex()
+{
+#if KWLKIT_NO_THREADS
+#elif KWLKIT_OS_WINDOWS
+	CRITICAL_SECTION *cs = static_cast<CRITICAL_SECTION *>(handle);
+	DeleteCriticalSection( cs );
+	delete cs;
+#else
+	pthread_mutex_t *m = static_cast<pthread_mutex_t *>(handle);
+	pthread_mutex_destroy( m );
+	delete m;
+#endif
+}
+
+void Mutex::Lock()
+{
+#if KWLKIT_NO_THREADS
+#elif KWLKIT_OS_WINDOWS
+	EnterCriticalSection( static_cast<CRITICAL_SECTION *>(handle) );
+#else
+	pthread_mutex_lock( static_cast<pthread_mutex_t *>(handle) );
+#endif
+}
+
+void Mutex::Unlock()
+{
+#if KWLKIT_NO_THREADS
+#elif KWLKIT_OS_WINDOWS
+	LeaveCriticalSection( static_cast<CRITICAL_SECTION *>(handle) );
+#else
+	pthread_mutex_unlock( static_cast<pthread_mutex_t *>(handle) );
+#endif
+}
+
+// CondVar
+
+CondVar::CondVar()
+{
+#if KWLKIT_NO_THREADS
+	handle = 0;
+#elif KWLKIT_OS_WINDOWS
+	CONDITION_VARIABLE *cv = new CONDITION_VARIABLE;
+	InitializeConditionVariable( cv );
+	handle = cv;
+#else
+	pthread_cond_t *cv = new pthread_cond_t;
+	pthread_cond_init( cv, 0 );
+	handle = cv;
+#endif
+}
+
+CondVar::~CondVar()
+{
+#if KWLKIT_NO_THREADS
+#elif KWLKIT_OS_WINDOWS
+	delete static_cast<CONDITION_VARIABLE *>(handle);
+#else
+	pthread_cond_t *cv = static_cast<pthread_cond_t *>(handle);
+	pthread_cond_destroy( cv );
+	delete cv;
+#endif
+}
+
+void CondVar::Wait( Mutex &m )
+{
+#if KWLKIT_NO_THREADS
+	// nobody could ever wake us up
+	(void)m;
+	KWLKIT_ASSERT( 0 );
+#elif KWLKIT_OS_WINDOWS
+	SleepConditionVariableCS( static_cast<CONDITION_VARIABLE *>(handle), static_cast<CRITICAL_SECTION *>(m.handle),
+		INFINITE );
+#else
+	pthread_cond_wait( static_cast<pthread_cond_t *>(handle), static_cast<pthread_mutex_t *>(m.handle) );
+#endif
+}
+
+void CondVar::Signal()
+{
+#if KWLKIT_NO_THREADS
+#elif KWLKIT_OS_WINDOWS
+	WakeConditionVariable( static_cast<CONDITION_VARIABLE *>(handle) );
+#else
+	pthread_cond_signal( static_cast<pthread_cond_t *>(handle) );
+#endif
+}
+
+void CondVar::Broadcast()
+{
+#if KWLKIT_NO_THREADS
+#elif KWLKIT_OS_WINDOWS
+	WakeAllConditionVariable( static_cast<CONDITION_VARIABLE *>(handle) );
+#else
+	pthread_cond_broadcast( static_cast<pthread_cond_t *>(handle) );
+#endif
+}
+
+// Thread
+
+Thread::Thread() : handle(0), func(0), param(0)
+{
+}
+
+Thread::~Thread()
+{
+	Join();
+}
+
+void Thread::Run( Thread *t )
+{
+	t->func( t->param );
+}
+
+bool Thread::Start( Function nfunc, void *nparam )
+{
+	KWLKIT_ASSERT( !handle && nfunc );
+	func = nfunc;
+	param = nparam;
+#if KWLKIT_NO_THREADS
+	return 0;
+#elif KWLKIT_OS_WINDOWS
+	handle = reinterpret_cast<void *>( _beginthreadex( 0, 0, ThreadEntry::Entry, this, 0, 0 ) );
+	return handle != 0;
+#else
+	pthread_t *th = new pthread_t;
+	if ( pthread_create( th, 0, ThreadEntry::Entry, this ) != 0 ) {
+		delete th;
+		return 0;
+	}
+	handle = th;
+	return 1;
+#endif
+}
+
+void Thread::Join()
+{
+	if ( !handle ) {
+		return;
+	}
+#if KWLKIT_NO_THREADS
+#elif KWLKIT_OS_WINDOWS
+	WaitForSingleObject( static_cast<HANDLE>(handle), INFINITE );
+	CloseHandle( static_cast<HANDLE>(handle) );
+#else
+	pthread_t *th = static_cast<pthread_t *>(handle);
+	pthread_join( *th, 0 );
+	delete th;
+#endif
+	handle = 0;
+}
+
+Int Thread::GetCpuCount()
+{
+#if KWLKIT_NO_THREADS
+	return 1;
+#elif KWLKIT_OS_WINDOWS
+	SYSTEM_INFO si;
+	GetSystemInfo( &si );
+	return si.dwNumberOfProcessors > 0 ? (Int)si.dwNumberOfProcessors : 1;
+#else
+	long res = sysconf( _SC_NPROCESSORS_ONLN );
+	return res > 0 ? (Int)res : 1;
+#endif
+}
+
+// ThreadPool
+
+ThreadPool::ThreadPool( Int numThreads ) : queueHead(0), quit(0)
+{
+	if ( numThreads <= 0 ) {
+		numThreads = Thread::GetCpuCount();
+	}
+	for ( Int i=0; i<numThreads; i++ ) {
+		Thread *t = new Thread;
+		if ( !t->Start( Worker, this ) ) {
+			// no threads => tasks run synchronously
+			delete t;
+			break;
+		}
+		threads.Add( t );
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		MutexLock lock( mutex );
+		quit = 1;
+		wake.Broadcast();
+	}
+	for ( Int i=0; i<threads.GetSize(); i++ ) {
+		delete threads[i];
+	}
+}
+
+void ThreadPool::Submit( Thread::Function task, void *param )
+{
+	KWLKIT_ASSERT( task );
+	if ( threads.IsEmpty() ) {
+		task( param );
+		return;
+	}
+	MutexLock lock( mutex );
+	Task t;
+	t.func = task;
+	t.param = param;
+	queue.Add( t );
+	wake.Signal();
+}
+
+void ThreadPool::Worker( void *param )
+{
+	ThreadPool *pool = static_cast<ThreadPool *>(param);
+	pool->mutex.Lock();
+	for (;;) {
+		if ( pool->queueHead < pool->queue.GetSize() ) {
+			Task t = pool->queue[ pool->queueHead++ ];
+			if ( pool->queueHead == pool->queue.GetSize() ) {
+				pool->queue.Clear();
+				pool->queueHead = 0;
+			}
+			pool->mutex.Unlock();
+			t.func( t.param );
+			pool->mutex.Lock();
+			continue;
+		}
+		if ( pool->quit ) {
+			break;
+		}
+		pool->wake.Wait( pool->mutex );
+	}
+	pool->mutex.Unlock();
+}
+
+}
@@ -0,0 +1,123 @@
+
+// (c) Martin Sedlak (mar) 2015
+// distributed under the Boost Software License, version 1.0
+// (see accompanying file License.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "Types.h"
+#include "NoCopy.h"
+#include "Array.h"
+
+// define KWLKIT_NO_THREADS to disable threading (ThreadPool then runs tasks synchronously)
+#if !defined(KWLKIT_NO_THREADS) && KWLKIT_PLATFORM_EMSCRIPTEN && !defined(__EMSCRIPTEN_PTHREADS__)
+#	define KWLKIT_NO_THREADS		1
+#endif
+
+namespace KwlKit
+{
+
+// minimal threading primitives (native objects are allocated in the .cpp to keep system headers out)
+
+class Mutex : public NoCopy
+{
+public:
+	Mutex();
+	~Mutex();
+
+	void Lock();
+	void Unlock();
+
+private:
+	friend class CondVar;
+	void *handle;
+};
+
+// scoped lock
+class MutexLock : public NoCopy
+{
+public:
+	explicit MutexLock( Mutex &m ) : mutex(m) {
+		mutex.Lock();
+	}
+	~MutexLock() {
+		mutex.Unlock();
+	}
+
+private:
+	Mutex &mutex;
+};
+
+class CondVar : public NoCopy
+{
+public:
+	CondVar();
+	~CondVar();
+
+	// mutex must be locked
+	void Wait( Mutex &m );
+	void Signal();
+	void Broadcast();
+
+private:
+	void *handle;
+};
+
+class Thread : public NoCopy
+{
+public:
+	typedef void (*Function)( void *param );
+
+	Thread();
+	// joins if still running
+	~Thread();
+
+	bool Start( Function nfunc, void *nparam );
+	void Join();
+
+	// get number of logical CPUs
+	static Int GetCpuCount();
+
+private:
+	void *handle;
+	Function func;
+	void *param;
+
+	static void Run( Thread *t );
+	friend struct ThreadEntry;
+};
+
+// fixed-size pool of worker threads executing tasks in FIFO order
+class ThreadPool : public NoCopy
+{
+public:
+	// numThreads <= 0 => one thread per CPU
+	explicit ThreadPool( Int numThreads = 0 );
+	// finishes queued tasks
+	~ThreadPool();
+
+	// queue task (runs synchronously if there are no worker threads)
+	void Submit( Thread::Function task, void *param );
+
+	inline Int GetThreadCount() const {
+		return threads.GetSize();
+	}
+
+private:
+	struct Task
+	{
+		Thread::Function func;
+		void *param;
+	};
+
+	Mutex mutex;
+	CondVar wake;
+	Array< Task > queue;
+	Int queueHead;
+	bool quit;
+	Array< Thread * > threads;
+
+	static void Worker( void *param );
+};
+
+}
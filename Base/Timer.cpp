@@ -0,0 +1,41 @@
+// (c) Martin Sedlak (mar) 2015
+// distributed under the Boost Software License, version 1.0
+// (see accompanying file License.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "Timer.h"
+
+#if KWLKIT_OS_WINDOWS
+#	if !defined(WIN32_LEAN_AND_MEAN)
+#		define WIN32_LEAN_AND_MEAN
+#	endif
+#	if !defined(NOMINMAX)
+#		define NOMINMAX
+#	endif
+#	include <windows.h>
+#else
+#	include <time.h>
+#endif
+
+namespace KwlKit
+{
+
+// Timer
+
+ULong Timer::GetNanoseconds()
+{
+#if KWLKIT_OS_WINDOWS
+	LARGE_INTEGER freq, cnt;
+	QueryPerformanceFrequency( &freq );
+	QueryPerformanceCounter( &cnt );
+	// split to avoid overflow
+	ULong f = (ULong)freq.QuadPart;
+	ULong c = (ULong)cnt.QuadPart;
+	return c / f * 1000000000u + c % f * 1000000000u / f;
+#else
+	timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (ULong)ts.tv_sec * 1000000000u + (ULong)ts.tv_nsec;
+#endif
+}
+
+}
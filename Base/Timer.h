@@ -0,0 +1,23 @@
+// (c) Martin Sedlak (mar) 2015
+// distributed under the Boost Software License, version 1.0
+// (see accompanying file License.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "Types.h"
+
+namespace KwlKit
+{
+
+struct Timer
+{
+	// get monotonic high resolution time in nanoseconds (arbitrary origin)
+	static ULong GetNanoseconds();
+
+	// get elapsed time in seconds since start (in ns)
+	static inline Double GetSecondsSince( ULong start ) {
+		return Double(GetNanoseconds() - start) * 1.0e-9;
+	}
+};
+
+}
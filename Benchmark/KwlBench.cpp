@@ -0,0 +1,1215 @@
+// no license applies to this file (public domain)
+
+// KwlKit benchmark: measures all hot kernels on deterministic synthetic data
+// build: just compile this file (it injects full KwlKit), e.g. g++ -O2 KwlBench.cpp -o KwlBench
+// usage: KwlBench [-json] [-quick] [suite...]
+// suites: kwl, inflate, deflate, zip, png, fft, mdct, resample, sampleconv, checksum (default: all)
+// output is CSV (suite,case,metric,value,unit) or JSON (array of the same records)
+
+// silence silly msc warnings
+#define _CRT_SECURE_NO_WARNINGS
+#include <cstdio>
+#include <cstring>
+
+#include "../KwlKit.h"
+#include "../Base/Timer.h"
+#include "../Base/MemoryStream.h"
+#include "../Compress/Deflate.h"
+#include "../Compress/InflateStream.h"
+#include "../Compress/InflatePool.h"
+#include "../Compress/ParallelInflate.h"
+#include "../Compress/ZipArchive.h"
+#include "../Compress/BlockCache.h"
+#include "../Png/PngFile.h"
+#include "../Compress/Adler32.h"
+#include "../Compress/Crc32.h"
+#include "../Mdct/DspWindows.h"
+#include "../Sample/SampleUtil.h"
+
+// this injects full KwlKit (instead of linking statically with a library)
+#include "../KwlKit.cpp"
+
+using namespace KwlKit;
+
+// deterministic pseudo-random generator
+class Random
+{
+public:
+	explicit Random( UInt nseed = 12345 ) : seed(nseed) {
+	}
+	inline UInt Next() {
+		seed = seed * 1103515245u + 12345u;
+		return seed >> 8;
+	}
+	// -1..1
+	inline Float NextFloat() {
+		return (Float)(Next() & 65535) / 32768.0f - 1.0f;
+	}
+private:
+	UInt seed;
+};
+
+// Reporting
+
+class Report
+{
+public:
+	Report() : json(0), count(0) {
+	}
+
+	void Begin() {
+		if ( json ) {
+			printf("[\n");
+		} else {
+			printf("suite,case,metric,value,unit\n");
+		}
+	}
+
+	void Add( const char *suite, const char *name, const char *metric, Double value, const char *unit )
+	{
+		if ( json ) {
+			printf( "%s\t{\"suite\": \"%s\", \"case\": \"%s\", \"metric\": \"%s\", \"value\": %.6g, \"unit\": \"%s\"}",
+				count ? ",\n" : "", suite, name, metric, value, unit );
+		} else {
+			printf( "%s,%s,%s,%.6g,%s\n", suite, name, metric, value, unit );
+		}
+		count++;
+		fflush( stdout );
+	}
+
+	void End() {
+		if ( json ) {
+			printf("\n]\n");
+		}
+	}
+
+	bool json;
+private:
+	Int count;
+};
+
+static Report report;
+// minimum time to measure each case
+static Double minTime = 0.5;
+
+// Measurement
+
+struct BenchCase
+{
+	virtual ~BenchCase() {}
+	virtual void Run() = 0;
+};
+
+// returns average seconds per Run()
+static Double Measure( BenchCase &bc )
+{
+	// warm up
+	bc.Run();
+	Long iters = 0;
+	ULong start = Timer::GetNanoseconds();
+	Double elapsed;
+	do {
+		bc.Run();
+		iters++;
+		elapsed = Timer::GetSecondsSince( start );
+	} while ( elapsed < minTime );
+	return elapsed / iters;
+}
+
+// Test data
+
+static void MakeTextCorpus( Array<Byte> &data, Int size )
+{
+	Random rnd(1);
+	Array<String> words;
+	for ( Int i=0; i<500; i++ ) {
+		String w;
+		Int len = 2 + (Int)(rnd.Next() % 8);
+		for ( Int j=0; j<len; j++ ) {
+			w += (char)('a' + rnd.Next() % 16);
+		}
+		words.Add( w );
+	}
+	data.Clear();
+	while ( data.GetSize() < size ) {
+		const String &w = words[ rnd.Next() % words.GetSize() ];
+		for ( size_t j=0; j<w.size() && data.GetSize() < size; j++ ) {
+			data.Add( (Byte)w[j] );
+		}
+		if ( data.GetSize() < size ) {
+			data.Add( (Byte)' ' );
+		}
+	}
+}
+
+static void MakeBinaryCorpus( Array<Byte> &data, Int size )
+{
+	// mix of noise and structured records
+	Random rnd(2);
+	data.Resize( size );
+	for ( Int i=0; i<size; i++ ) {
+		UInt r = rnd.Next();
+		if ( (i >> 12) & 1 ) {
+			data[i] = (Byte)r;
+		} else {
+			data[i] = (Byte)((i & 15) < 4 ? (i >> 4) : (r & 7));
+		}
+	}
+}
+
+static void MakeAudio( Array<Float> &pcm, Int numSamples, Int numChannels, Int sampleRate )
+{
+	Random rnd(3);
+	pcm.Resize( numSamples * numChannels );
+	for ( Int i=0; i<numSamples; i++ ) {
+		for ( Int ch=0; ch<numChannels; ch++ ) {
+			Float t = (Float)i / sampleRate;
+			pcm[i*numChannels + ch] = 0.4f * SinRad( 2*PI*(440.0f + ch*110.0f)*t ) +
+				0.2f * SinRad( 2*PI*(3000.0f + ch*700.0f)*t ) + 0.02f * rnd.NextFloat();
+		}
+	}
+}
+
+// kwl encoder (only used to create test data)
+// payload receives uncompressed frame data
+static void MakeKwl( Array<Byte> &file, Array<Byte> &payload, Int numChannels, Int blockSize, Int sampleRate,
+	Int numSamples )
+{
+	const Int quantBits = 6;
+	const Float powScl = 0.425f;
+	UShort flags = KwlFile::KWL_NORMALIZED | KwlFile::KWL_NUM_SAMPLES | KwlFile::KWL_HALF_FLOAT;
+
+	Array<Float> pcm;
+	MakeAudio( pcm, numSamples, numChannels, sampleRate );
+
+	Int numFrames = (numSamples + blockSize - 1) / blockSize + 1;
+	Float two_n = 2.0f / (blockSize*2);
+	Mdct<Float> mdct( blockSize*2, 2.0f*two_n, 0.5f );
+	mdct.SetWindowFunc( VorbisWindow );
+
+	Array<Float> in, coeffs;
+	in.Resize( 2*blockSize );
+	coeffs.Resize( blockSize );
+	Int qsize = 1 << quantBits;
+	Int qbase = qsize >> 1;
+	Float qofs = (Float)(qbase - 1) + 0.5f;
+	payload.Clear();
+	for ( Int f=0; f<numFrames; f++ ) {
+		for ( Int ch=0; ch<numChannels; ch++ ) {
+			for ( Int i=0; i<2*blockSize; i++ ) {
+				Int s = (f-1)*blockSize + i;
+				in[i] = s >= 0 && s < numSamples ? pcm[s*numChannels + ch] : 0.0f;
+			}
+			mdct.DoMdct( in.GetData(), coeffs.GetData() );
+			Float scl = 0;
+			for ( Int i=0; i<blockSize; i++ ) {
+				scl = Max( scl, Abs(coeffs[i]) );
+			}
+			UShort hscl = FloatToHalf( Max( scl, 1.0e-4f ) );
+			scl = HalfToFloat( hscl );
+			payload.Add( (Byte)hscl );
+			payload.Add( (Byte)(hscl >> 8) );
+			for ( Int i=0; i<blockSize; i++ ) {
+				Float v = coeffs[i] / scl;
+				v = Pow( Abs(v), powScl ) * Sign(v);
+				payload.Add( (Byte)Clamp( RoundFloatToInt( v*qofs ) + qbase, 0, qsize-1 ) );
+			}
+		}
+	}
+
+	KwlFile::Header hdr;
+	MemSet( &hdr, 0, sizeof(hdr) );
+	MemCpy( hdr.magic, "kwl\x1a", 4 );
+	hdr.version = 0x100;
+	hdr.flags = flags;
+	hdr.sampleRate = sampleRate;
+	hdr.numChannels = (Byte)numChannels;
+	hdr.quantBits = (Byte)quantBits;
+	hdr.blockSize = (UShort)blockSize;
+	hdr.numFrames = numFrames;
+	hdr.powScl = (UShort)(powScl * 65536);
+	hdr.numSamples = numSamples;
+	// note: assuming little endian host here
+	file.Resize( sizeof(hdr) );
+	MemCpy( file.GetData(), &hdr, sizeof(hdr) );
+	Array<Byte> comp;
+	DeflateBuffer( payload.GetData(), payload.GetSize(), comp, INF_ZLIB );
+	file.insert( file.end(), comp.begin(), comp.end() );
+}
+
+// filter
+static Int numSuites = 0;
+static char **suites = 0;
+
+static bool Enabled( const char *suite )
+{
+	if ( !numSuites ) {
+		return 1;
+	}
+	for ( Int i=0; i<numSuites; i++ ) {
+		if ( strcmp( suites[i], suite ) == 0 ) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// kwl
+
+struct KwlDecodeCase : BenchCase
+{
+	const Array<Byte> *file;
+	Int outChannels;
+	Int scale;
+	bool mono;
+	Long samplesDecoded;
+
+	void Run()
+	{
+		MemoryStream ms( file->GetData(), (size_t)file->GetSize() );
+		KwlFile kwl;
+		kwl.SetDecodeScale( scale );
+		kwl.SetDecodeMono( mono );
+		if ( !kwl.Open( ms ) ) {
+			fprintf( stderr, "kwl open failed\n" );
+			return;
+		}
+		Short buf[1024*2];
+		samplesDecoded = 0;
+		for (;;) {
+			Int nread;
+			if ( !kwl.ReadSamples( buf, 1024, outChannels, nread ) ) {
+				break;
+			}
+			samplesDecoded += nread;
+			if ( nread < 1024 ) {
+				break;
+			}
+		}
+	}
+};
+
+static void BenchKwl()
+{
+	const Int sampleRate = 44100;
+	const Int seconds = 10;
+	static const Int blockSizes[] = { 256, 512, 1024, 2048 };
+	for ( Int channels = 1; channels <= 2; channels++ ) {
+		for ( Int b=0; b<4; b++ ) {
+			Int blockSize = blockSizes[b];
+			Array<Byte> file, payload;
+			MakeKwl( file, payload, channels, blockSize, sampleRate, seconds * sampleRate );
+			Int numFrames = (seconds * sampleRate + blockSize - 1) / blockSize + 1;
+			// full decode plus reduced variants
+			for ( Int variant = 0; variant < 3; variant++ ) {
+				if ( variant == 2 && channels == 1 ) {
+					continue;
+				}
+				KwlDecodeCase kc;
+				kc.file = &file;
+				kc.outChannels = 2;
+				kc.scale = variant == 1 ? KwlFile::DECODE_SCALE_HALF : KwlFile::DECODE_SCALE_FULL;
+				kc.mono = variant == 2;
+				kc.samplesDecoded = 0;
+				Double t = Measure( kc );
+				static const char *variantNames[] = { "", "_half", "_mono" };
+				char name[64];
+				sprintf( name, "ch%d_bs%d%s", (int)channels, (int)blockSize, variantNames[variant] );
+				report.Add( "kwl", name, "frames_per_sec", numFrames / t, "frames/s" );
+				report.Add( "kwl", name, "realtime", seconds / t, "x" );
+			}
+		}
+	}
+}
+
+// inflate
+
+struct InflateCase : BenchCase
+{
+	const Array<Byte> *comp;
+	Array<Byte> out;
+	bool oneShot;
+	// push mode: feed chunks of this size (0 = pull from stream)
+	Int feedSize;
+	// skip checksum
+	bool trusted;
+
+	void Run()
+	{
+		if ( feedSize > 0 ) {
+			Inflate inf;
+			inf.SetFormat( INF_ZLIB );
+			Int total = 0;
+			for ( Int ofs = 0; ofs < comp->GetSize(); ofs += feedSize ) {
+				Int nread;
+				if ( !inf.Feed( comp->GetData() + ofs, Min( feedSize, comp->GetSize() - ofs ) ) ||
+					!inf.Drain( out.GetData() + total, out.GetSize() - total, nread ) ) {
+					break;
+				}
+				total += nread;
+			}
+			if ( !inf.IsEof() || total != out.GetSize() ) {
+				fprintf( stderr, "push inflate failed\n" );
+			}
+			return;
+		}
+		if ( oneShot ) {
+			size_t outSize;
+			if ( !InflateBuffer( comp->GetData(), comp->GetSize(), out.GetData(), out.GetSize(), INF_ZLIB, &outSize ) ||
+				outSize != (size_t)out.GetSize() ) {
+				fprintf( stderr, "inflate failed\n" );
+			}
+			return;
+		}
+		MemoryStream ms( comp->GetData(), (size_t)comp->GetSize() );
+		InflateStream is( ms, INF_ZLIB );
+		is.SetTrusted( trusted );
+		Int nread;
+		if ( !is.Read( out.GetData(), out.GetSize(), nread ) || nread != out.GetSize() ) {
+			fprintf( stderr, "inflate failed\n" );
+		}
+	}
+};
+
+// multi-member GZip (concatenated members)
+struct ParallelInflateCase : BenchCase
+{
+	const Array<Byte> *comp;
+	Array<Byte> out;
+	ThreadPool *pool;
+
+	void Run()
+	{
+		ParallelInflateStream ps( comp->GetData(), comp->GetSize(), pool );
+		Int nread;
+		if ( !ps.Read( out.GetData(), out.GetSize(), nread ) || nread != out.GetSize() ) {
+			fprintf( stderr, "parallel inflate failed\n" );
+		}
+	}
+};
+
+// single large stream: sequential vs. speculative parallel decoding (InflateStream::SetParallel)
+struct SpeculativeInflateCase : BenchCase
+{
+	const Array<Byte> *comp;
+	Array<Byte> out;
+	// null = sequential
+	ThreadPool *pool;
+
+	void Run()
+	{
+		MemoryStream ms( comp->GetData(), (size_t)comp->GetSize() );
+		InflateStream is( ms, INF_ZLIB );
+		is.SetParallel( pool != 0, pool );
+		Int nread;
+		if ( !is.Read( out.GetData(), out.GetSize(), nread ) || nread != out.GetSize() ) {
+			fprintf( stderr, "speculative inflate failed\n" );
+		}
+	}
+};
+
+static void BenchInflateCorpus( const char *name, const Array<Byte> &data )
+{
+	Array<Byte> comp;
+	DeflateBuffer( data.GetData(), data.GetSize(), comp, INF_ZLIB );
+	InflateCase ic;
+	ic.comp = &comp;
+	ic.out.Resize( data.GetSize() );
+	report.Add( "inflate", name, "ratio", (Double)comp.GetSize() / data.GetSize(), "" );
+	static const char *modes[] = { "throughput", "throughput_oneshot", "throughput_push_16k", "throughput_trusted" };
+	for ( Int i=0; i<4; i++ ) {
+		ic.oneShot = i == 1;
+		ic.feedSize = i == 2 ? 16 << 10 : 0;
+		ic.trusted = i == 3;
+		ic.out.Fill( 0 );
+		Double t = Measure( ic );
+		if ( MemCmp( ic.out.GetData(), data.GetData(), data.GetSize() ) != 0 ) {
+			fprintf( stderr, "inflate mismatch: %s\n", name );
+		}
+		report.Add( "inflate", name, modes[i], data.GetSize() / t / (1024.0*1024.0), "MB/s" );
+	}
+
+	// 256k members, single thread vs. all CPUs
+	const Int memberSize = 256 << 10;
+	Array<Byte> gz;
+	for ( Int ofs = 0; ofs < data.GetSize(); ofs += memberSize ) {
+		DeflateBuffer( data.GetData() + ofs, (size_t)Min( memberSize, data.GetSize() - ofs ), gz, INF_GZIP );
+	}
+	ParallelInflateCase pc;
+	pc.comp = &gz;
+	pc.out.Resize( data.GetSize() );
+	ThreadPool pool1( 1 );
+	ThreadPool poolAll;
+	for ( Int i=0; i<2; i++ ) {
+		pc.pool = i ? &poolAll : &pool1;
+		pc.out.Fill( 0 );
+		Double t = Measure( pc );
+		if ( MemCmp( pc.out.GetData(), data.GetData(), data.GetSize() ) != 0 ) {
+			fprintf( stderr, "parallel inflate mismatch: %s\n", name );
+		}
+		report.Add( "inflate", name, i ? "throughput_gzip_parallel" : "throughput_gzip_1thread",
+			data.GetSize() / t / (1024.0*1024.0), "MB/s" );
+	}
+}
+
+// many tiny zlib payloads
+struct InflateSmallCase : BenchCase
+{
+	Array< InflateBatchItem > items;
+	// 0 = InflateStream per item, 1 = InflateBuffer per item, 2 = InflateBatch,
+	// 3 = one InflateStream Reset per item, 4 = InflatePool context per item
+	Int mode;
+	ThreadPool *pool;
+	InflateStream reused;
+	InflatePool contexts;
+
+	void Run()
+	{
+		if ( mode == 2 ) {
+			if ( !InflateBatch( items.GetData(), items.GetSize(), INF_ZLIB, pool ) ) {
+				fprintf( stderr, "inflate batch failed\n" );
+			}
+			return;
+		}
+		for ( Int i=0; i<items.GetSize(); i++ ) {
+			InflateBatchItem &item = items[i];
+			if ( mode == 1 ) {
+				item.ok = InflateBuffer( item.src, item.srcLen, item.dst, item.dstCap, INF_ZLIB, &item.outSize );
+				continue;
+			}
+			MemoryStream ms( item.src, item.srcLen );
+			Int nread;
+			if ( mode == 3 ) {
+				reused.Reset( ms, INF_ZLIB );
+				item.ok = reused.Read( item.dst, (Int)item.dstCap, nread ) && reused.IsEof();
+			} else if ( mode == 4 ) {
+				InflateStream *is = contexts.Acquire( ms, INF_ZLIB );
+				item.ok = is && is->Read( item.dst, (Int)item.dstCap, nread ) && is->IsEof();
+				contexts.Release( is );
+			} else {
+				InflateStream is( ms, INF_ZLIB );
+				item.ok = is.Read( item.dst, (Int)item.dstCap, nread ) && is.IsEof();
+			}
+			item.outSize = (size_t)nread;
+		}
+	}
+};
+
+static void BenchInflateSmall()
+{
+	const Int count = 10000;
+	Array<Byte> text;
+	MakeTextCorpus( text, 1 << 20 );
+	Random rnd;
+	Array< Array<Byte> > comp;
+	Array<Byte> out;
+	Array<Int> offsets;
+	comp.Resize( count );
+	out.Resize( count * 512 );
+	offsets.Resize( count );
+	InflateSmallCase sc;
+	sc.items.Resize( count );
+	for ( Int i=0; i<count; i++ ) {
+		Int size = 20 + (Int)(rnd.Next() % 480);
+		offsets[i] = (Int)(rnd.Next() % (UInt)(text.GetSize() - size));
+		DeflateBuffer( text.GetData() + offsets[i], (size_t)size, comp[i], INF_ZLIB );
+		InflateBatchItem &item = sc.items[i];
+		item.src = comp[i].GetData();
+		item.srcLen = (size_t)comp[i].GetSize();
+		item.dst = out.GetData() + i*512;
+		item.dstCap = (size_t)size;
+		item.zipCrc = 0;
+	}
+	ThreadPool poolAll;
+	static const char *modes[] = { "items_stream", "items_buffer", "items_batch", "items_batch_parallel",
+		"items_stream_reset", "items_stream_pool" };
+	static const Int modeIds[] = { 0, 1, 2, 2, 3, 4 };
+	for ( Int i=0; i<6; i++ ) {
+		sc.mode = modeIds[i];
+		sc.pool = i == 3 ? &poolAll : 0;
+		out.Fill( 0 );
+		Double t = Measure( sc );
+		for ( Int j=0; j<count; j++ ) {
+			const InflateBatchItem &item = sc.items[j];
+			if ( !item.ok || item.outSize != item.dstCap ||
+				MemCmp( item.dst, text.GetData() + offsets[j], item.dstCap ) != 0 ) {
+				fprintf( stderr, "inflate small mismatch: %s\n", modes[i] );
+				break;
+			}
+		}
+		report.Add( "inflate", "small_zlib", modes[i], count / t, "items/s" );
+	}
+}
+
+static void BenchInflateLarge()
+{
+	const Int size = 256 << 20;
+	Array<Byte> data, comp;
+	MakeTextCorpus( data, size );
+	DeflateBuffer( data.GetData(), data.GetSize(), comp, INF_ZLIB );
+	SpeculativeInflateCase sc;
+	sc.comp = &comp;
+	sc.out.Resize( size );
+	// enough threads to engage the engine (oversubscribed on machines with fewer CPUs)
+	ThreadPool poolAll( Max( Thread::GetCpuCount(), SpeculativeInflate::MIN_THREADS - 1 ) );
+	Double times[2];
+	for ( Int i=0; i<2; i++ ) {
+		sc.pool = i ? &poolAll : 0;
+		sc.out.Fill( 0 );
+		times[i] = Measure( sc );
+		if ( MemCmp( sc.out.GetData(), data.GetData(), size ) != 0 ) {
+			fprintf( stderr, "speculative inflate mismatch\n" );
+		}
+		report.Add( "inflate", "text_256m", i ? "throughput_speculative" : "throughput_sequential",
+			size / times[i] / (1024.0*1024.0), "MB/s" );
+	}
+	report.Add( "inflate", "text_256m", "speedup_speculative", times[0] / times[1], "x" );
+}
+
+static void BenchInflate()
+{
+	const Int size = 4 << 20;
+	Array<Byte> data, tmp;
+	MakeTextCorpus( data, size );
+	BenchInflateCorpus( "text", data );
+	MakeBinaryCorpus( data, size );
+	BenchInflateCorpus( "binary", data );
+	MakeKwl( tmp, data, 2, 512, 44100, 44100*20 );
+	BenchInflateCorpus( "kwl", data );
+	BenchInflateSmall();
+	BenchInflateLarge();
+}
+
+// deflate
+
+struct DeflateCase : BenchCase
+{
+	const Array<Byte> *data;
+	Array<Byte> comp;
+	Int level;
+	ThreadPool *pool;
+
+	void Run()
+	{
+		comp.Clear();
+		ArrayStream as( comp );
+		Deflate enc( as );
+		enc.SetFormat( INF_ZLIB );
+		enc.SetLevel( level );
+		if ( pool ) {
+			enc.SetParallel( 1, pool );
+		}
+		if ( !enc.Write( data->GetData(), data->GetSize() ) || !enc.Finish() ) {
+			fprintf( stderr, "deflate failed\n" );
+		}
+	}
+};
+
+static void BenchDeflateCorpus( const char *name, const Array<Byte> &data )
+{
+	static const Int levels[] = { 1, 6, 9 };
+	DeflateCase dc;
+	dc.data = &data;
+	dc.pool = 0;
+	for ( Int l=0; l<3; l++ ) {
+		dc.level = levels[l];
+		Double t = Measure( dc );
+		char metric[64];
+		sprintf( metric, "throughput_l%d", (int)dc.level );
+		report.Add( "deflate", name, metric, data.GetSize() / t / (1024.0*1024.0), "MB/s" );
+		sprintf( metric, "ratio_l%d", (int)dc.level );
+		report.Add( "deflate", name, metric, (Double)dc.comp.GetSize() / data.GetSize(), "" );
+	}
+	// 1M chunks on all CPUs
+	ThreadPool poolAll;
+	dc.level = 6;
+	dc.pool = &poolAll;
+	Double t = Measure( dc );
+	report.Add( "deflate", name, "throughput_l6_parallel", data.GetSize() / t / (1024.0*1024.0), "MB/s" );
+	report.Add( "deflate", name, "ratio_l6_parallel", (Double)dc.comp.GetSize() / data.GetSize(), "" );
+}
+
+static void BenchDeflate()
+{
+	const Int size = 4 << 20;
+	Array<Byte> data;
+	MakeTextCorpus( data, size );
+	BenchDeflateCorpus( "text", data );
+	MakeBinaryCorpus( data, size );
+	BenchDeflateCorpus( "binary", data );
+}
+
+// zip
+
+static void ZipPut16( Array<Byte> &dst, UInt v )
+{
+	dst.Add( (Byte)v );
+	dst.Add( (Byte)(v >> 8) );
+}
+
+static void ZipPut32( Array<Byte> &dst, UInt v )
+{
+	ZipPut16( dst, v & 0xffffu );
+	ZipPut16( dst, v >> 16 );
+}
+
+// minimal Zip writer (deflated entries, no Zip64)
+static void MakeZip( Array<Byte> &zip, const Array<Byte> &data, Int numEntries, Int minSize, Int maxSize )
+{
+	Random rnd(4);
+	Array<Byte> cdir, comp;
+	zip.Clear();
+	for ( Int i=0; i<numEntries; i++ ) {
+		char name[64];
+		sprintf( name, "assets/dir%d/file%d.bin", (int)(i % 32), (int)i );
+		Int nameLen = (Int)strlen( name );
+		Int size = minSize + (Int)(rnd.Next() % (UInt)(maxSize - minSize + 1));
+		Int ofs = (Int)(rnd.Next() % (UInt)(data.GetSize() - size));
+		const Byte *src = data.GetData() + ofs;
+		UInt crc = GetCrc32( src, size );
+		comp.Clear();
+		DeflateBuffer( src, size, comp, INF_ZIP );
+
+		UInt localOfs = (UInt)zip.GetSize();
+		ZipPut32( zip, 0x04034b50 );
+		ZipPut16( zip, 20 );
+		ZipPut16( zip, 0 );
+		ZipPut16( zip, 8 );
+		ZipPut32( zip, 0 );
+		ZipPut32( zip, crc );
+		ZipPut32( zip, comp.GetSize() );
+		ZipPut32( zip, size );
+		ZipPut16( zip, nameLen );
+		ZipPut16( zip, 0 );
+		zip.insert( zip.end(), name, name + nameLen );
+		zip.insert( zip.end(), comp.begin(), comp.end() );
+
+		ZipPut32( cdir, 0x02014b50 );
+		ZipPut16( cdir, 20 );
+		ZipPut16( cdir, 20 );
+		ZipPut16( cdir, 0 );
+		ZipPut16( cdir, 8 );
+		ZipPut32( cdir, 0 );
+		ZipPut32( cdir, crc );
+		ZipPut32( cdir, comp.GetSize() );
+		ZipPut32( cdir, size );
+		ZipPut16( cdir, nameLen );
+		for ( Int j=0; j<6; j++ ) {
+			ZipPut16( cdir, 0 );
+		}
+		ZipPut32( cdir, localOfs );
+		cdir.insert( cdir.end(), name, name + nameLen );
+	}
+	UInt cdirOfs = (UInt)zip.GetSize();
+	zip.insert( zip.end(), cdir.begin(), cdir.end() );
+	ZipPut32( zip, 0x06054b50 );
+	ZipPut32( zip, 0 );
+	ZipPut16( zip, numEntries );
+	ZipPut16( zip, numEntries );
+	ZipPut32( zip, cdir.GetSize() );
+	ZipPut32( zip, cdirOfs );
+	ZipPut16( zip, 0 );
+}
+
+struct ZipOpenCase : BenchCase
+{
+	const Array<Byte> *zip;
+
+	void Run()
+	{
+		ZipArchive za;
+		if ( !za.OpenMemory( zip->GetData(), zip->GetSize() ) ) {
+			fprintf( stderr, "zip open failed\n" );
+		}
+	}
+};
+
+// find + open + read whole entry through ZipEntryStream
+struct ZipEntryCase : BenchCase
+{
+	const ZipArchive *archive;
+	const Array<String> *names;
+	Array<Byte> buf;
+	ZipEntryStream zs;
+
+	void Run()
+	{
+		for ( Int i=0; i<names->GetSize(); i++ ) {
+			Int index = archive->Find( (*names)[i].c_str() );
+			Int nread;
+			if ( index < 0 || !zs.Open( *archive, index ) || !zs.Read( buf.GetData(), buf.GetSize(), nread ) ||
+				nread != archive->GetSize( index ) ) {
+				fprintf( stderr, "zip entry read failed\n" );
+				return;
+			}
+		}
+	}
+};
+
+struct ZipBatchCase : BenchCase
+{
+	ZipArchive *archive;
+	const Array<Int> *indices;
+	Array< Array<Byte> > outputs;
+	ThreadPool *pool;
+
+	void Run()
+	{
+		if ( !archive->ExtractBatch( indices->GetData(), indices->GetSize(), outputs.GetData(), 0, pool ) ) {
+			fprintf( stderr, "zip batch failed\n" );
+		}
+	}
+};
+
+// small random reads from a large entry
+struct ZipRandomReadCase : BenchCase
+{
+	Stream *stream;
+	Long size;
+	Int numReads;
+	Array<Byte> buf;
+
+	void Run()
+	{
+		Random rnd(5);
+		for ( Int i=0; i<numReads; i++ ) {
+			Long pos = (Long)(rnd.Next() % (UInt)(size - buf.GetSize()));
+			if ( !stream->Seek( pos ) || !stream->Read( buf.GetData(), buf.GetSize() ) ) {
+				fprintf( stderr, "zip random read failed\n" );
+				return;
+			}
+		}
+	}
+};
+
+static void BenchZip()
+{
+	// many small assets
+	const Int numEntries = 4000;
+	Array<Byte> data, zip;
+	MakeTextCorpus( data, 4 << 20 );
+	MakeZip( zip, data, numEntries, 256, 16 << 10 );
+
+	ZipOpenCase oc;
+	oc.zip = &zip;
+	Double t = Measure( oc );
+	report.Add( "zip", "small", "open_latency", t * 1.0e6, "us" );
+
+	ZipArchive za;
+	za.OpenMemory( zip.GetData(), zip.GetSize() );
+	Array<String> names;
+	Array<Int> indices;
+	Long total = 0;
+	for ( Int i=0; i<za.GetNumEntries(); i++ ) {
+		names.Add( za.GetName( i ) );
+		indices.Add( i );
+		total += za.GetSize( i );
+	}
+
+	ZipEntryCase ec;
+	ec.archive = &za;
+	ec.names = &names;
+	ec.buf.Resize( (16 << 10) + 1 );
+	t = Measure( ec );
+	report.Add( "zip", "small", "entry_latency", t * 1.0e6 / numEntries, "us" );
+
+	ZipBatchCase bc;
+	bc.archive = &za;
+	bc.indices = &indices;
+	bc.outputs.Resize( numEntries );
+	ThreadPool pool1( 1 );
+	ThreadPool poolAll;
+	for ( Int i=0; i<2; i++ ) {
+		bc.pool = i ? &poolAll : &pool1;
+		t = Measure( bc );
+		report.Add( "zip", "small", i ? "throughput_batch_parallel" : "throughput_batch_1thread",
+			total / t / (1024.0*1024.0), "MB/s" );
+	}
+
+	// 4k reads from a 4M entry: InflateIndex (decode from nearest checkpoint) vs. warm block cache
+	MakeZip( zip, data, 1, data.GetSize() - 1, data.GetSize() - 1 );
+	za.OpenMemory( zip.GetData(), zip.GetSize() );
+	ZipRandomReadCase rc;
+	rc.size = za.GetSize( 0 );
+	rc.numReads = 64;
+	rc.buf.Resize( 4096 );
+
+	ZipEntryStream zs( za, 0 );
+	InflateIndex index;
+	// entry data follows the first local header (no extra field)
+	const Byte *comp = zip.GetData() + 30 + strlen( "assets/dir0/file0.bin" );
+	MemoryStream ms( comp, (size_t)za.GetCompressedSize( 0 ) );
+	index.Build( ms, INF_RAW, 256 << 10 );
+	InflateStream is;
+	is.SetStream( ms, 0 );
+	is.SetIndex( &index );
+	rc.stream = &is;
+	t = Measure( rc );
+	report.Add( "zip", "large", "random_read_index", t * 1.0e6 / rc.numReads, "us" );
+
+	BlockCache cache;
+	CachedStream cs( cache, 0, zs );
+	rc.stream = &cs;
+	t = Measure( rc );
+	BlockCache::Stats st = cache.GetStats();
+	report.Add( "zip", "large", "random_read_cached", t * 1.0e6 / rc.numReads, "us" );
+	report.Add( "zip", "large", "cache_hit_rate", (Double)st.hits / (st.hits + st.misses), "" );
+}
+
+// png
+
+static void PngPutChunk( Array<Byte> &png, const char *type, const Array<Byte> &data )
+{
+	UInt size = (UInt)data.GetSize();
+	for ( Int i=3; i>=0; i-- ) {
+		png.Add( (Byte)(size >> (8*i)) );
+	}
+	png.insert( png.end(), type, type + 4 );
+	png.insert( png.end(), data.begin(), data.end() );
+	UInt crc = GetCrc32( type, 4 );
+	if ( size ) {
+		crc = GetCrc32( data.GetData(), size, crc );
+	}
+	for ( Int i=3; i>=0; i-- ) {
+		png.Add( (Byte)(crc >> (8*i)) );
+	}
+}
+
+// 8-bit gray/RGB/RGBA image, filter types cycle per row (0-4)
+static void MakePng( Array<Byte> &png, Int width, Int height, Int channels )
+{
+	static const Byte colorTypes[5] = { 0, 0, 0, 2, 6 };
+	Random rnd(6);
+	Int rowBytes = width * channels;
+	Array<Byte> rows, raw, chunk;
+	rows.Resize( 2*rowBytes );
+	rows.MemSet( 0 );
+	Byte *prev = rows.GetData();
+	Byte *cur = prev + rowBytes;
+	for ( Int y=0; y<height; y++ ) {
+		for ( Int i=0; i<rowBytes; i++ ) {
+			Int x = i / channels;
+			cur[i] = (Byte)(((x*x + y*3) >> 4) + (i % channels)*50 + (rnd.Next() & 3));
+		}
+		Int filter = y % 5;
+		raw.Add( (Byte)filter );
+		for ( Int i=0; i<rowBytes; i++ ) {
+			Int a = i >= channels ? cur[i-channels] : 0;
+			Int b = prev[i];
+			Int c = i >= channels ? prev[i-channels] : 0;
+			Int p = a + b - c;
+			Int pa = Abs( p - a ), pb = Abs( p - b ), pc = Abs( p - c );
+			Int pred[5] = { 0, a, b, (a + b) >> 1, pa <= pb && pa <= pc ? a : pb <= pc ? b : c };
+			raw.Add( (Byte)(cur[i] - pred[filter]) );
+		}
+		Swap( prev, cur );
+	}
+	static const Byte signature[8] = { 137, 'P', 'N', 'G', 13, 10, 26, 10 };
+	png.Clear();
+	png.insert( png.end(), signature, signature + 8 );
+	chunk.Clear();
+	for ( Int v = 0; v < 2; v++ ) {
+		Int dim = v ? height : width;
+		for ( Int i=3; i>=0; i-- ) {
+			chunk.Add( (Byte)(dim >> (8*i)) );
+		}
+	}
+	chunk.Add( 8 );
+	chunk.Add( colorTypes[channels] );
+	chunk.Add( 0 );
+	chunk.Add( 0 );
+	chunk.Add( 0 );
+	PngPutChunk( png, "IHDR", chunk );
+	Array<Byte> comp;
+	DeflateBuffer( raw.GetData(), raw.GetSize(), comp, INF_ZLIB );
+	// split into 64k IDAT chunks
+	for ( Int ofs = 0; ofs < comp.GetSize(); ofs += 65536 ) {
+		chunk.Clear();
+		chunk.insert( chunk.end(), comp.begin() + ofs, comp.begin() + Min( ofs + 65536, comp.GetSize() ) );
+		PngPutChunk( png, "IDAT", chunk );
+	}
+	chunk.Clear();
+	PngPutChunk( png, "IEND", chunk );
+}
+
+struct PngCase : BenchCase
+{
+	const Array<Byte> *png;
+	Array<Byte> image;
+	Int channels;
+
+	void Run()
+	{
+		MemoryStream ms( png->GetData(), (size_t)png->GetSize() );
+		PngFile pf;
+		if ( !pf.Open( ms ) ) {
+			fprintf( stderr, "png open failed\n" );
+			return;
+		}
+		image.Resize( pf.GetWidth() * pf.GetHeight() * channels );
+		if ( !pf.Decode( image.GetData(), pf.GetWidth() * channels, channels ) ) {
+			fprintf( stderr, "png decode failed\n" );
+		}
+	}
+};
+
+static void BenchPng()
+{
+	static const char *names[5] = { 0, "gray", 0, "rgb", "rgba" };
+	const Int size = 1024;
+	Array<Byte> png;
+	PngCase pc;
+	pc.png = &png;
+	for ( Int ch=1; ch<=4; ch++ ) {
+		if ( !names[ch] ) {
+			continue;
+		}
+		MakePng( png, size, size, ch );
+		pc.channels = ch;
+		Double t = Measure( pc );
+		report.Add( "png", names[ch], "throughput", size * size * ch / t / (1024.0*1024.0), "MB/s" );
+		if ( ch != 4 ) {
+			// expanded to RGBA
+			pc.channels = 4;
+			t = Measure( pc );
+			report.Add( "png", names[ch], "throughput_rgba", size * size * 4 / t / (1024.0*1024.0), "MB/s" );
+		}
+	}
+}
+
+// fft/mdct
+
+struct FftCase : BenchCase
+{
+	Fft<Float> *fft;
+	Array< Complex<Float> > data;
+
+	void Run() {
+		fft->DoFft( data.GetData() );
+	}
+};
+
+struct MdctCase : BenchCase
+{
+	Mdct<Float> *mdct;
+	Array<Float> in, out;
+	bool inverse;
+
+	void Run()
+	{
+		if ( inverse ) {
+			mdct->DoIMdct( in.GetData(), out.GetData() );
+		} else {
+			mdct->DoMdct( in.GetData(), out.GetData() );
+		}
+	}
+};
+
+static void BenchFft()
+{
+	Random rnd;
+	for ( Int n = 16; n <= 4096; n *= 2 ) {
+		Fft<Float> fft( n );
+		FftCase fc;
+		fc.fft = &fft;
+		fc.data.Resize( n );
+		for ( Int i=0; i<n; i++ ) {
+			fc.data[i] = Complex<Float>( rnd.NextFloat(), rnd.NextFloat() );
+		}
+		Double t = Measure( fc );
+		char name[32];
+		sprintf( name, "n%d", (int)n );
+		report.Add( "fft", name, "time", t * 1.0e9, "ns" );
+	}
+}
+
+static void BenchMdct()
+{
+	Random rnd;
+	for ( Int n = 128; n <= 4096; n *= 2 ) {
+		Mdct<Float> mdct( n, 4.0f / n, 0.5f );
+		mdct.SetWindowFunc( VorbisWindow );
+		for ( Int inv = 0; inv < 2; inv++ ) {
+			MdctCase mc;
+			mc.mdct = &mdct;
+			mc.inverse = inv != 0;
+			mc.in.Resize( n );
+			mc.out.Resize( n );
+			for ( Int i=0; i<n; i++ ) {
+				mc.in[i] = rnd.NextFloat();
+			}
+			Double t = Measure( mc );
+			char name[32];
+			sprintf( name, "%s_n%d", inv ? "imdct" : "mdct", (int)n );
+			report.Add( "mdct", name, "time", t * 1.0e9, "ns" );
+		}
+	}
+}
+
+// resampler
+
+static const UInt formats[] = { SAMPLE_FORMAT_8S, SAMPLE_FORMAT_16S, SAMPLE_FORMAT_24S, SAMPLE_FORMAT_32F };
+static const char *formatNames[] = { "8s", "16s", "24s", "32f" };
+
+struct ResampleCase : BenchCase
+{
+	LinearResampler res;
+	Array<Byte> out;
+	Int outSamples;
+	Int chunk;
+
+	void Run()
+	{
+		Int sampleSize = res.GetSampleSize();
+		for ( Int done = 0; done < outSamples; done += chunk ) {
+			Int needed = res.ComputeNeededSamples( chunk );
+			void *in = res.GetInputBuffer( needed );
+			// note: content doesn't matter much, except for float NaNs
+			MemSet( in, 0x11, needed * sampleSize );
+			res.Resample( out.GetData(), chunk );
+		}
+	}
+};
+
+static void BenchResample()
+{
+	static const Int rates[][2] = {
+		{ 44100, 48000 }, { 48000, 44100 }, { 44100, 22050 }, { 22050, 44100 }, { 48000, 32000 }
+	};
+	for ( Int r=0; r<5; r++ ) {
+		for ( Int f=0; f<4; f++ ) {
+			ResampleCase rc;
+			rc.res.SetInputSampleRate( rates[r][0] );
+			rc.res.SetOutputSampleRate( rates[r][1] );
+			rc.res.SetFormat( formats[f], 2 );
+			rc.chunk = 1024;
+			rc.outSamples = 64*1024;
+			rc.out.Resize( rc.chunk * rc.res.GetSampleSize() );
+			Double t = Measure( rc );
+			char name[64];
+			sprintf( name, "%d_%d_%s", (int)rates[r][0], (int)rates[r][1], formatNames[f] );
+			report.Add( "resample", name, "throughput", rc.outSamples / t * 1.0e-6, "Msamples/s" );
+		}
+	}
+}
+
+// sample conversion
+
+struct SampleConvCase : BenchCase
+{
+	UInt srcFmt, dstFmt;
+	Int srcChannels, dstChannels;
+	Array<Byte> src, dst;
+	Int samples;
+
+	void Run() {
+		SampleConv::Convert( srcFmt, srcChannels, dstFmt, dstChannels, src.GetData(), dst.GetData(), samples );
+	}
+};
+
+static void BenchSampleConv()
+{
+	static const Int channels[][2] = { { 2, 2 }, { 1, 2 }, { 2, 1 } };
+	for ( Int c=0; c<3; c++ ) {
+		for ( Int sf=0; sf<4; sf++ ) {
+			for ( Int df=0; df<4; df++ ) {
+				SampleConvCase sc;
+				sc.srcFmt = formats[sf];
+				sc.dstFmt = formats[df];
+				sc.srcChannels = channels[c][0];
+				sc.dstChannels = channels[c][1];
+				sc.samples = 16384;
+				sc.src.Resize( sc.samples * sc.srcChannels * (sc.srcFmt & SAMPLE_FORMAT_SIZE_MASK) );
+				sc.dst.Resize( sc.samples * sc.dstChannels * (sc.dstFmt & SAMPLE_FORMAT_SIZE_MASK) );
+				sc.src.MemSet( 0x11 );
+				Double t = Measure( sc );
+				char name[64];
+				sprintf( name, "%s_%d_to_%s_%d", formatNames[sf], (int)sc.srcChannels, formatNames[df],
+					(int)sc.dstChannels );
+				report.Add( "sampleconv", name, "throughput", sc.samples / t * 1.0e-6, "Msamples/s" );
+			}
+		}
+	}
+}
+
+// checksums
+
+struct ChecksumCase : BenchCase
+{
+	Array<Byte> data;
+	bool adler;
+	UInt result;
+
+	void Run() {
+		result = adler ? GetAdler32( data.GetData(), data.GetSize() ) : GetCrc32( data.GetData(), data.GetSize() );
+	}
+};
+
+static void BenchChecksum()
+{
+	static const Int sizes[] = { 64, 4096, 1 << 20 };
+	for ( Int a=0; a<2; a++ ) {
+		for ( Int s=0; s<3; s++ ) {
+			ChecksumCase cc;
+			cc.adler = a != 0;
+			MakeBinaryCorpus( cc.data, sizes[s] );
+			Double t = Measure( cc );
+			char name[64];
+			sprintf( name, "%s_%d", a ? "adler32" : "crc32", (int)sizes[s] );
+			report.Add( "checksum", name, "throughput", sizes[s] / t / (1024.0*1024.0), "MB/s" );
+		}
+	}
+}
+
+int main( int argc, char **argv )
+{
+	// initialize: necessary to call once at startup
+	KwlKit::Init();
+
+	Array<char *> filter;
+	for ( int i=1; i<argc; i++ ) {
+		if ( strcmp( argv[i], "-json" ) == 0 ) {
+			report.json = 1;
+		} else if ( strcmp( argv[i], "-quick" ) == 0 ) {
+			minTime = 0.05;
+		} else {
+			filter.Add( argv[i] );
+		}
+	}
+	numSuites = filter.GetSize();
+	suites = numSuites ? filter.GetData() : 0;
+
+	report.Begin();
+	if ( Enabled( "kwl" ) ) {
+		BenchKwl();
+	}
+	if ( Enabled( "inflate" ) ) {
+		BenchInflate();
+	}
+	if ( Enabled( "deflate" ) ) {
+		BenchDeflate();
+	}
+	if ( Enabled( "zip" ) ) {
+		BenchZip();
+	}
+	if ( Enabled( "png" ) ) {
+		BenchPng();
+	}
+	if ( Enabled( "fft" ) ) {
+		BenchFft();
+	}
+	if ( Enabled( "mdct" ) ) {
+		BenchMdct();
+	}
+	if ( Enabled( "resample" ) ) {
+		BenchResample();
+	}
+	if ( Enabled( "sampleconv" ) ) {
+		BenchSampleConv();
+	}
+	if ( Enabled( "checksum" ) ) {
+		BenchChecksum();
+	}
+	report.End();
+	return 0;
+}
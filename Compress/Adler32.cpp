@@ -1,4 +1,3 @@
-
 // (c) Martin Sedlak (mar) 2015
 // distributed under the Boost Software License, version 1.0
 // (see accompanying file License.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
@@ -6,9 +5,136 @@
 #include "Adler32.h"
 #include "../Base/Templates.h"
 
+#if KWLKIT_SIMD_AVX2
+#	include <immintrin.h>
+#elif KWLKIT_SIMD_SSSE3
+#	include <tmmintrin.h>
+#elif KWLKIT_SIMD_SSE2
+#	include <emmintrin.h>
+#endif
+
+#if KWLKIT_SIMD_NEON
+#	include <arm_neon.h>
+#endif
+
 namespace KwlKit
 {
 
+static const UInt ADLER32_BASE = 65521;
+// max bytes before hi can overflow 32 bits
+static const size_t ADLER32_NMAX = 5552;
+
+#if KWLKIT_SIMD_SSE2 || KWLKIT_SIMD_NEON
+
+// 32 byte blocks: lo += sum(b[i]), hi += 32*lo + sum((32-i)*b[i])
+// per NMAX chunk, prefix sums of lo are accumulated in a vector and scaled by 32 at the end
+static void GetAdler32Simd( const Byte *&b, size_t &size, UInt &lo, UInt &hi )
+{
+	size_t blocks = size / 32;
+	size -= blocks * 32;
+
+	while ( blocks ) {
+		size_t n = Min( blocks, ADLER32_NMAX / 32 );
+		blocks -= n;
+		hi += lo * (UInt)(n * 32);
+
+#if KWLKIT_SIMD_AVX2
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i ones = _mm256_set1_epi16( 1 );
+		const __m256i weights = _mm256_setr_epi8( 32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+			16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1 );
+		__m256i vs1 = zero, vs2 = zero, vps = zero;
+		for ( size_t i=0; i<n; i++ ) {
+			__m256i v = _mm256_loadu_si256( reinterpret_cast<const __m256i *>(b) );
+			b += 32;
+			vps = _mm256_add_epi32( vps, vs1 );
+			vs1 = _mm256_add_epi32( vs1, _mm256_sad_epu8( v, zero ) );
+			vs2 = _mm256_add_epi32( vs2, _mm256_madd_epi16( _mm256_maddubs_epi16( v, weights ), ones ) );
+		}
+		vs2 = _mm256_add_epi32( vs2, _mm256_slli_epi32( vps, 5 ) );
+		__m128i s1 = _mm_add_epi32( _mm256_castsi256_si128( vs1 ), _mm256_extracti128_si256( vs1, 1 ) );
+		__m128i s2 = _mm_add_epi32( _mm256_castsi256_si128( vs2 ), _mm256_extracti128_si256( vs2, 1 ) );
+#elif KWLKIT_SIMD_SSE2
+		const __m128i zero = _mm_setzero_si128();
+#	if KWLKIT_SIMD_SSSE3
+		const __m128i ones = _mm_set1_epi16( 1 );
+		const __m128i weights0 = _mm_setr_epi8( 32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17 );
+		const __m128i weights1 = _mm_setr_epi8( 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1 );
+#	else
+		const __m128i weights0 = _mm_setr_epi16( 32, 31, 30, 29, 28, 27, 26, 25 );
+		const __m128i weights1 = _mm_setr_epi16( 24, 23, 22, 21, 20, 19, 18, 17 );
+		const __m128i weights2 = _mm_setr_epi16( 16, 15, 14, 13, 12, 11, 10, 9 );
+		const __m128i weights3 = _mm_setr_epi16( 8, 7, 6, 5, 4, 3, 2, 1 );
+#	endif
+		__m128i vs1 = zero, vs2 = zero, vps = zero;
+		for ( size_t i=0; i<n; i++ ) {
+			__m128i v0 = _mm_loadu_si128( reinterpret_cast<const __m128i *>(b) );
+			__m128i v1 = _mm_loadu_si128( reinterpret_cast<const __m128i *>(b + 16) );
+			b += 32;
+			vps = _mm_add_epi32( vps, vs1 );
+			vs1 = _mm_add_epi32( vs1, _mm_add_epi32( _mm_sad_epu8( v0, zero ), _mm_sad_epu8( v1, zero ) ) );
+#	if KWLKIT_SIMD_SSSE3
+			__m128i w0 = _mm_madd_epi16( _mm_maddubs_epi16( v0, weights0 ), ones );
+			__m128i w1 = _mm_madd_epi16( _mm_maddubs_epi16( v1, weights1 ), ones );
+			vs2 = _mm_add_epi32( vs2, _mm_add_epi32( w0, w1 ) );
+#	else
+			__m128i w0 = _mm_madd_epi16( _mm_unpacklo_epi8( v0, zero ), weights0 );
+			__m128i w1 = _mm_madd_epi16( _mm_unpackhi_epi8( v0, zero ), weights1 );
+			__m128i w2 = _mm_madd_epi16( _mm_unpacklo_epi8( v1, zero ), weights2 );
+			__m128i w3 = _mm_madd_epi16( _mm_unpackhi_epi8( v1, zero ), weights3 );
+			vs2 = _mm_add_epi32( vs2, _mm_add_epi32( _mm_add_epi32( w0, w1 ), _mm_add_epi32( w2, w3 ) ) );
+#	endif
+		}
+		vs2 = _mm_add_epi32( vs2, _mm_slli_epi32( vps, 5 ) );
+		__m128i s1 = vs1, s2 = vs2;
+#endif
+
+#if KWLKIT_SIMD_SSE2
+		// horizontal sums
+		s1 = _mm_add_epi32( s1, _mm_shuffle_epi32( s1, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+		s2 = _mm_add_epi32( s2, _mm_shuffle_epi32( s2, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+		s2 = _mm_add_epi32( s2, _mm_shuffle_epi32( s2, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+		lo += (UInt)_mm_cvtsi128_si32( s1 );
+		hi += (UInt)_mm_cvtsi128_si32( s2 );
+#else
+		// NEON: per-column byte sums are weighted after the loop
+		static const UShort weights[16] = { 32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17 };
+		static const UShort weightsLo[16] = { 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1 };
+		uint32x4_t vs1 = vdupq_n_u32( 0 ), vs2 = vdupq_n_u32( 0 );
+		uint16x8_t c0 = vdupq_n_u16( 0 ), c1 = c0, c2 = c0, c3 = c0;
+		for ( size_t i=0; i<n; i++ ) {
+			uint8x16_t v0 = vld1q_u8( b );
+			uint8x16_t v1 = vld1q_u8( b + 16 );
+			b += 32;
+			vs2 = vaddq_u32( vs2, vs1 );
+			vs1 = vpadalq_u16( vs1, vpadalq_u8( vpaddlq_u8( v0 ), v1 ) );
+			c0 = vaddw_u8( c0, vget_low_u8( v0 ) );
+			c1 = vaddw_u8( c1, vget_high_u8( v0 ) );
+			c2 = vaddw_u8( c2, vget_low_u8( v1 ) );
+			c3 = vaddw_u8( c3, vget_high_u8( v1 ) );
+		}
+		vs2 = vshlq_n_u32( vs2, 5 );
+		vs2 = vmlal_u16( vs2, vget_low_u16( c0 ), vld1_u16( weights ) );
+		vs2 = vmlal_u16( vs2, vget_high_u16( c0 ), vld1_u16( weights + 4 ) );
+		vs2 = vmlal_u16( vs2, vget_low_u16( c1 ), vld1_u16( weights + 8 ) );
+		vs2 = vmlal_u16( vs2, vget_high_u16( c1 ), vld1_u16( weights + 12 ) );
+		vs2 = vmlal_u16( vs2, vget_low_u16( c2 ), vld1_u16( weightsLo ) );
+		vs2 = vmlal_u16( vs2, vget_high_u16( c2 ), vld1_u16( weightsLo + 4 ) );
+		vs2 = vmlal_u16( vs2, vget_low_u16( c3 ), vld1_u16( weightsLo + 8 ) );
+		vs2 = vmlal_u16( vs2, vget_high_u16( c3 ), vld1_u16( weightsLo + 12 ) );
+		UInt s1[4], s2[4];
+		vst1q_u32( s1, vs1 );
+		vst1q_u32( s2, vs2 );
+		lo += s1[0] + s1[1] + s1[2] + s1[3];
+		hi += s2[0] + s2[1] + s2[2] + s2[3];
+#endif
+		lo %= ADLER32_BASE;
+		hi %= ADLER32_BASE;
+	}
+}
+
+#endif
+
 UInt GetAdler32( const void *buf, size_t size, UInt crc )
 {
 	KWLKIT_ASSERT( buf );
@@ -16,15 +142,21 @@ UInt GetAdler32( const void *buf, size_t size, UInt crc )
 	UInt hi = (crc >> 16);
 	UInt lo = crc & 0xffff;
 
-	while ( size >= 5552 ) {
+#if KWLKIT_SIMD_SSE2 || KWLKIT_SIMD_NEON
+	if ( size >= 64 ) {
+		GetAdler32Simd( b, size, lo, hi );
+	}
+#endif
+
+	while ( size >= ADLER32_NMAX ) {
 		// do it fast
-		for ( UInt i=5552; i>0; i-- ) {
+		for ( UInt i=ADLER32_NMAX; i>0; i-- ) {
 			lo += *b++;
 			hi += lo;
 		}
-		lo %= 65521;
-		hi %= 65521;
-		size -= 5552;
+		lo %= ADLER32_BASE;
+		hi %= ADLER32_BASE;
+		size -= ADLER32_NMAX;
 	}
 
 	while ( size-- ) {
@@ -32,11 +164,34 @@ UInt GetAdler32( const void *buf, size_t size, UInt crc )
 		hi += lo;
 	}
 
-	lo %= 65521;
-	hi %= 65521;
+	lo %= ADLER32_BASE;
+	hi %= ADLER32_BASE;
 
 	return lo | (hi << 16);
 }
 
+// based on adler32_combine from zlib
+UInt CombineAdler32( UInt crc1, UInt crc2, Long len2 )
+{
+	KWLKIT_ASSERT( len2 >= 0 );
+	UInt rem = (UInt)(len2 % ADLER32_BASE);
+	UInt lo = crc1 & 0xffff;
+	UInt hi = rem * lo % ADLER32_BASE;
+	lo += (crc2 & 0xffff) + ADLER32_BASE - 1;
+	hi += (crc1 >> 16) + (crc2 >> 16) + ADLER32_BASE - rem;
+	if ( lo >= ADLER32_BASE ) {
+		lo -= ADLER32_BASE;
+	}
+	if ( lo >= ADLER32_BASE ) {
+		lo -= ADLER32_BASE;
+	}
+	if ( hi >= 2*ADLER32_BASE ) {
+		hi -= 2*ADLER32_BASE;
+	}
+	if ( hi >= ADLER32_BASE ) {
+		hi -= ADLER32_BASE;
+	}
+	return lo | (hi << 16);
+}
 
 }
@@ -15,6 +15,9 @@ static const UInt ADLER32_INIT = 1;
 
 UInt GetAdler32( const void *buf, size_t size, UInt crc = ADLER32_INIT );
 
+// combine Adler32 of two consecutive chunks (crc2 computed from ADLER32_INIT, len2 = size of second chunk)
+UInt CombineAdler32( UInt crc1, UInt crc2, Long len2 );
+
 inline UInt GetAdler32Byte( Byte b, UInt crc = ADLER32_INIT )
 {
 	UInt hi = (crc >> 16);
@@ -0,0 +1,335 @@
+
+// (c) Martin Sedlak (mar) 2015
+// distributed under the Boost Software License, version 1.0
+// (see accompanying file License.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "BlockCache.h"
+#include "../Base/Memory.h"
+#include "../Base/Templates.h"
+
+namespace KwlKit
+{
+
+const Long BlockCache::DEFAULT_BUDGET = 64 << 20;
+const Int BlockCache::DEFAULT_BLOCK_SIZE = 64 << 10;
+const Int BlockCache::DEFAULT_STRIPES = 16;
+const Int BlockCache::MAX_STRIPES = 256;
+const Int BlockCache::MIN_TABLE_SIZE = 64;
+
+// BlockCache
+
+BlockCache::BlockCache( Long nbudget, Int nblockSize, Int nstripes )
+	: budget( nbudget )
+	, blockSize( nblockSize )
+{
+	KWLKIT_ASSERT( budget > 0 && blockSize > 0 && nstripes > 0 );
+	Int numStripes = 1;
+	while ( numStripes < Min( nstripes, MAX_STRIPES ) ) {
+		numStripes *= 2;
+	}
+	stripeMask = (UInt)numStripes - 1;
+	// at least one block per stripe
+	stripeBlocks = (Int)Max( budget / numStripes / blockSize, (Long)1 );
+	stripes.Resize( numStripes );
+	for ( Int i=0; i<numStripes; i++ ) {
+		Stripe *s = new Stripe;
+		s->table.Resize( MIN_TABLE_SIZE );
+		s->table.Fill( 0 );
+		s->lruHead = s->lruTail = 0;
+		s->count = 0;
+		s->hits = s->misses = s->evictions = 0;
+		stripes[i] = s;
+	}
+}
+
+BlockCache::~BlockCache()
+{
+	for ( Int i=0; i<stripes.GetSize(); i++ ) {
+		FreeBlocks( *stripes[i] );
+		delete stripes[i];
+	}
+}
+
+inline UInt BlockCache::Hash( ULong key, Long block )
+{
+	// 64-bit mix (splitmix finalizer)
+	ULong h = key ^ ((ULong)block * KWLKIT_CONST_ULONG(0x9e3779b97f4a7c15));
+	h ^= h >> 30;
+	h *= KWLKIT_CONST_ULONG(0xbf58476d1ce4e5b9);
+	h ^= h >> 27;
+	h *= KWLKIT_CONST_ULONG(0x94d049bb133111eb);
+	h ^= h >> 31;
+	return (UInt)h;
+}
+
+inline BlockCache::Stripe &BlockCache::GetStripe( UInt hash )
+{
+	// top bits select stripe, low bits select hash chain
+	return *stripes[ (hash >> 24) & stripeMask ];
+}
+
+BlockCache::Block *BlockCache::FindBlock( Stripe &s, UInt hash, ULong key, Long block )
+{
+	Block *b = s.table[ hash & (UInt)(s.table.GetSize()-1) ];
+	while ( b && (b->hash != hash || b->key != key || b->index != block) ) {
+		b = b->hashNext;
+	}
+	return b;
+}
+
+void BlockCache::Unlink( Stripe &s, Block *b )
+{
+	// LRU list
+	if ( b->lruPrev ) {
+		b->lruPrev->lruNext = b->lruNext;
+	} else {
+		s.lruHead = b->lruNext;
+	}
+	if ( b->lruNext ) {
+		b->lruNext->lruPrev = b->lruPrev;
+	} else {
+		s.lruTail = b->lruPrev;
+	}
+	// hash chain
+	Block **link = &s.table[ b->hash & (UInt)(s.table.GetSize()-1) ];
+	while ( *link != b ) {
+		link = &(*link)->hashNext;
+	}
+	*link = b->hashNext;
+	s.count--;
+}
+
+void BlockCache::LinkFront( Stripe &s, Block *b )
+{
+	b->lruPrev = 0;
+	b->lruNext = s.lruHead;
+	if ( s.lruHead ) {
+		s.lruHead->lruPrev = b;
+	} else {
+		s.lruTail = b;
+	}
+	s.lruHead = b;
+}
+
+void BlockCache::Grow( Stripe &s )
+{
+	Array< Block * > ntable;
+	ntable.Resize( s.table.GetSize() * 2 );
+	ntable.Fill( 0 );
+	UInt mask = (UInt)ntable.GetSize() - 1;
+	for ( Block *b = s.lruHead; b; b = b->lruNext ) {
+		Block *&head = ntable[ b->hash & mask ];
+		b->hashNext = head;
+		head = b;
+	}
+	s.table.swap( ntable );
+}
+
+void BlockCache::FreeBlocks( Stripe &s )
+{
+	Block *b = s.lruHead;
+	while ( b ) {
+		Block *next = b->lruNext;
+		delete b;
+		b = next;
+	}
+	s.lruHead = s.lruTail = 0;
+	s.table.Fill( 0 );
+	s.count = 0;
+}
+
+Int BlockCache::Read( ULong key, Long block, Int offset, void *buf, Int count )
+{
+	KWLKIT_ASSERT( offset >= 0 && offset <= blockSize && count >= 0 );
+	UInt hash = Hash( key, block );
+	Stripe &s = GetStripe( hash );
+	MutexLock lock( s.mutex );
+	Block *b = FindBlock( s, hash, key, block );
+	if ( !b ) {
+		s.misses++;
+		return -1;
+	}
+	s.hits++;
+	if ( b != s.lruHead ) {
+		// move to front
+		b->lruPrev->lruNext = b->lruNext;
+		if ( b->lruNext ) {
+			b->lruNext->lruPrev = b->lruPrev;
+		} else {
+			s.lruTail = b->lruPrev;
+		}
+		LinkFront( s, b );
+	}
+	Int res = Max( Min( count, b->size - offset ), 0 );
+	if ( res > 0 ) {
+		MemCpy( buf, b->data.GetData() + offset, (size_t)res );
+	}
+	return res;
+}
+
+void BlockCache::Insert( ULong key, Long block, const void *data, Int size )
+{
+	KWLKIT_ASSERT( size >= 0 && size <= blockSize && (data || !size) );
+	UInt hash = Hash( key, block );
+	Stripe &s = GetStripe( hash );
+	MutexLock lock( s.mutex );
+	Block *b = FindBlock( s, hash, key, block );
+	if ( b ) {
+		Unlink( s, b );
+	} else if ( s.count >= stripeBlocks ) {
+		// evict least recently used block and reuse its buffer
+		b = s.lruTail;
+		Unlink( s, b );
+		s.evictions++;
+	} else {
+		b = new Block;
+		b->data.Resize( blockSize );
+	}
+	b->key = key;
+	b->index = block;
+	b->hash = hash;
+	b->size = size;
+	if ( size > 0 ) {
+		MemCpy( b->data.GetData(), data, (size_t)size );
+	}
+	if ( s.count >= s.table.GetSize() ) {
+		Grow( s );
+	}
+	Block *&head = s.table[ hash & (UInt)(s.table.GetSize()-1) ];
+	b->hashNext = head;
+	head = b;
+	LinkFront( s, b );
+	s.count++;
+}
+
+void BlockCache::Remove( ULong key )
+{
+	for ( Int i=0; i<stripes.GetSize(); i++ ) {
+		Stripe &s = *stripes[i];
+		MutexLock lock( s.mutex );
+		Block *b = s.lruHead;
+		while ( b ) {
+			Block *next = b->lruNext;
+			if ( b->key == key ) {
+				Unlink( s, b );
+				delete b;
+			}
+			b = next;
+		}
+	}
+}
+
+void BlockCache::Clear()
+{
+	for ( Int i=0; i<stripes.GetSize(); i++ ) {
+		MutexLock lock( stripes[i]->mutex );
+		FreeBlocks( *stripes[i] );
+	}
+}
+
+BlockCache::Stats BlockCache::GetStats() const
+{
+	Stats res;
+	res.hits = res.misses = res.evictions = 0;
+	res.blocks = 0;
+	for ( Int i=0; i<stripes.GetSize(); i++ ) {
+		const Stripe &s = *stripes[i];
+		MutexLock lock( s.mutex );
+		res.hits += s.hits;
+		res.misses += s.misses;
+		res.evictions += s.evictions;
+		res.blocks += s.count;
+	}
+	res.memory = (Long)res.blocks * blockSize;
+	return res;
+}
+
+void BlockCache::ResetStats()
+{
+	for ( Int i=0; i<stripes.GetSize(); i++ ) {
+		Stripe &s = *stripes[i];
+		MutexLock lock( s.mutex );
+		s.hits = s.misses = s.evictions = 0;
+	}
+}
+
+// CachedStream
+
+CachedStream::CachedStream( BlockCache &ncache, ULong nkey, Stream &nsource )
+	: cache( ncache )
+	, key( nkey )
+	, source( nsource )
+	, pos( 0 )
+	, sourcePos( -1 )
+{
+}
+
+Int CachedStream::LoadBlock( Long block )
+{
+	Int bsize = cache.GetBlockSize();
+	Long start = block * bsize;
+	if ( sourcePos != start ) {
+		sourcePos = -1;
+		if ( !source.Seek( start ) ) {
+			return -1;
+		}
+	}
+	buffer.Resize( bsize );
+	Int nread;
+	if ( !source.Read( buffer.GetData(), bsize, nread ) ) {
+		return -1;
+	}
+	sourcePos = start + nread;
+	cache.Insert( key, block, buffer.GetData(), nread );
+	return nread;
+}
+
+bool CachedStream::Read( void *buf, Int count, Int &nread )
+{
+	KWLKIT_ASSERT( buf && count >= 0 );
+	nread = 0;
+	Byte *dst = static_cast<Byte *>(buf);
+	Int bsize = cache.GetBlockSize();
+	while ( count > 0 ) {
+		Long block = pos / bsize;
+		Int offset = (Int)(pos - block * bsize);
+		Int avail = Min( count, bsize - offset );
+		Int n = cache.Read( key, block, offset, dst, avail );
+		if ( n < 0 ) {
+			Int size = LoadBlock( block );
+			if ( size < 0 ) {
+				return 0;
+			}
+			n = Max( Min( avail, size - offset ), 0 );
+			if ( n > 0 ) {
+				MemCpy( dst, buffer.GetData() + offset, (size_t)n );
+			}
+		}
+		dst += n;
+		nread += n;
+		count -= n;
+		pos += n;
+		if ( n < avail ) {
+			// short block => end of stream
+			break;
+		}
+	}
+	return 1;
+}
+
+bool CachedStream::Rewind()
+{
+	pos = 0;
+	return 1;
+}
+
+bool CachedStream::Seek( Long npos )
+{
+	if ( npos < 0 ) {
+		return 0;
+	}
+	pos = npos;
+	return 1;
+}
+
+}
@@ -0,0 +1,149 @@
+
+// (c) Martin Sedlak (mar) 2015
+// distributed under the Boost Software License, version 1.0
+// (see accompanying file License.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "../Base/Stream.h"
+#include "../Base/Array.h"
+#include "../Base/NoCopy.h"
+#include "../Base/Thread.h"
+
+namespace KwlKit
+{
+
+// cache of decompressed data in fixed size blocks keyed by (stream key, block index)
+// blocks are spread over lock stripes; each stripe gets an equal share of the memory budget and evicts
+// least recently used blocks
+// all methods are thread safe
+class BlockCache : public NoCopy
+{
+public:
+	struct Stats
+	{
+		Long hits;
+		Long misses;
+		Long evictions;
+		Long memory;		// bytes allocated for cached blocks
+		Int blocks;
+	};
+
+	// budget = max bytes of cached blocks (but at least one block per stripe), stripes is rounded up to a power of two
+	// (at most MAX_STRIPES)
+	explicit BlockCache( Long nbudget = DEFAULT_BUDGET, Int nblockSize = DEFAULT_BLOCK_SIZE,
+		Int nstripes = DEFAULT_STRIPES );
+	~BlockCache();
+
+	inline Int GetBlockSize() const {
+		return blockSize;
+	}
+
+	inline Long GetBudget() const {
+		return budget;
+	}
+
+	// copy up to count bytes starting at offset within block
+	// returns number of bytes copied (less than requested past the end of a short block) or -1 on miss
+	Int Read( ULong key, Long block, Int offset, void *buf, Int count );
+
+	// insert block (size <= block size, only the last block of a stream may be shorter), replaces existing block
+	void Insert( ULong key, Long block, const void *data, Int size );
+
+	// remove all blocks of key (e.g. when the source data changes)
+	void Remove( ULong key );
+	void Clear();
+
+	Stats GetStats() const;
+	void ResetStats();
+
+	static const Long DEFAULT_BUDGET;
+	static const Int DEFAULT_BLOCK_SIZE;
+	static const Int DEFAULT_STRIPES;
+	// stripe is selected by top 8 hash bits (low bits select hash chain)
+	static const Int MAX_STRIPES;
+
+private:
+	struct Block
+	{
+		ULong key;
+		Long index;
+		UInt hash;
+		Int size;
+		Block *hashNext;
+		// LRU list (head = most recently used)
+		Block *lruPrev;
+		Block *lruNext;
+		Array< Byte > data;
+	};
+
+	struct Stripe
+	{
+		mutable Mutex mutex;
+		// hash chains (power of two size)
+		Array< Block * > table;
+		Block *lruHead;
+		Block *lruTail;
+		Int count;
+		Long hits;
+		Long misses;
+		Long evictions;
+	};
+
+	Long budget;
+	Int blockSize;
+	// max blocks per stripe
+	Int stripeBlocks;
+	UInt stripeMask;
+	Array< Stripe * > stripes;
+
+	static inline UInt Hash( ULong key, Long block );
+	inline Stripe &GetStripe( UInt hash );
+
+	// stripe must be locked
+	static Block *FindBlock( Stripe &s, UInt hash, ULong key, Long block );
+	static void Unlink( Stripe &s, Block *b );
+	static void LinkFront( Stripe &s, Block *b );
+	static void Grow( Stripe &s );
+	static void FreeBlocks( Stripe &s );
+
+	// constants (for unity build)
+	static const Int MIN_TABLE_SIZE;
+};
+
+// read-through stream over a seekable source (InflateStream, ZipEntryStream, ...)
+// repeated reads are served from the cache; misses decode whole blocks, sequential misses don't seek the source
+// key must uniquely identify source data within the cache (e.g. archive id and entry index)
+// the stream itself is not thread safe, but any number of streams can share one cache
+class CachedStream : public Stream
+{
+public:
+	KWLKIT_INJECT_STREAM()
+
+	CachedStream( BlockCache &ncache, ULong nkey, Stream &nsource );
+
+	bool Read( void *buf, Int count, Int &nread );
+	bool Rewind();
+	// seeking is lazy (source is only touched on cache miss)
+	bool Seek( Long npos );
+
+	inline Long GetPosition() const {
+		return pos;
+	}
+
+private:
+	BlockCache &cache;
+	ULong key;
+	Stream &source;
+	// read position
+	Long pos;
+	// source position (-1 = unknown)
+	Long sourcePos;
+	// block buffer for misses
+	Array< Byte > buffer;
+
+	// decode block into buffer (and cache), returns block size or -1 on error
+	Int LoadBlock( Long block );
+};
+
+}
@@ -1,4 +1,3 @@
-
 // (c) Martin Sedlak (mar) 2015
 // distributed under the Boost Software License, version 1.0
 // (see accompanying file License.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
@@ -8,22 +7,150 @@
 #include "../Base/Templates.h"
 #include "../Base/Endian.h"
 #include "../Base/Likely.h"
+#include "../Base/Memory.h"
+
+// hardware CRC-32: PCLMULQDQ folding on x86 (detected at runtime), crc32 instructions on ARMv8
+// (only if enabled at compile time, i.e. __ARM_FEATURE_CRC32)
+#if !defined(KWLKIT_NO_SIMD)
+#	if KWLKIT_SIMD_SSE2 && (KWLKIT_COMPILER_MSC || defined(__GNUC__))
+#		define KWLKIT_CRC32_PCLMUL		1
+#		include <emmintrin.h>
+#		include <wmmintrin.h>
+#		if KWLKIT_COMPILER_MSC
+#			include <intrin.h>
+#		else
+#			include <cpuid.h>
+#		endif
+#	elif KWLKIT_CPU_ARM && defined(__ARM_FEATURE_CRC32)
+#		define KWLKIT_CRC32_ARM		1
+#		include <arm_acle.h>
+#	endif
+#endif
+
+#if KWLKIT_CRC32_PCLMUL && defined(__GNUC__)
+#	define KWLKIT_TARGET_PCLMUL __attribute__((target("pclmul")))
+#else
+#	define KWLKIT_TARGET_PCLMUL
+#endif
 
 namespace KwlKit
 {
 
-// use fast slicing with 4 tables
+// slicing-by-16 tables (table 0 is the classic CRC-32 table)
 // reference: http://create.stephan-brumme.com/crc32/ (original version by Intel)
-#define KWLKIT_USE_CRC32_SLICING	1
+#include "Crc32Tables.inl"
+
+#if KWLKIT_CRC32_PCLMUL
+
+// reference: Intel, "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction"
+// (bit-reflected constants as used by Chromium's zlib)
+static const ULong crc32K1K2[2] = { KWLKIT_CONST_ULONG(0x0154442bd4), KWLKIT_CONST_ULONG(0x01c6e41596) };
+static const ULong crc32K3K4[2] = { KWLKIT_CONST_ULONG(0x01751997d0), KWLKIT_CONST_ULONG(0x00ccaa009e) };
+static const ULong crc32K5K0[2] = { KWLKIT_CONST_ULONG(0x0163cd6124), 0 };
+static const ULong crc32Poly[2] = { KWLKIT_CONST_ULONG(0x01db710641), KWLKIT_CONST_ULONG(0x01f7011641) };
+
+static bool HasPclmul()
+{
+	// -1 = not detected yet (racing threads compute the same value)
+	static volatile Int hasPclmul = -1;
+	if ( KWLKIT_UNLIKELY( hasPclmul < 0 ) ) {
+		UInt ecx = 0;
+#	if KWLKIT_COMPILER_MSC
+		int regs[4];
+		__cpuid( regs, 1 );
+		ecx = (UInt)regs[2];
+#	else
+		unsigned int a, b, c, d;
+		if ( __get_cpuid( 1, &a, &b, &c, &d ) ) {
+			ecx = c;
+		}
+#	endif
+		hasPclmul = (ecx >> 1) & 1;
+	}
+	return hasPclmul != 0;
+}
+
+static inline __m128i LoadConst( const ULong *k ) {
+	return _mm_loadu_si128( reinterpret_cast<const __m128i *>(k) );
+}
+
+// fold 16-byte blocks; size must be a multiple of 16, at least 64
+// crc is not inverted here
+KWLKIT_TARGET_PCLMUL static UInt GetCrc32Pclmul( const Byte *b, size_t size, UInt crc )
+{
+	KWLKIT_ASSERT( size >= 64 && !(size & 15) );
+	__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+	x1 = _mm_loadu_si128( reinterpret_cast<const __m128i *>(b) );
+	x2 = _mm_loadu_si128( reinterpret_cast<const __m128i *>(b + 16) );
+	x3 = _mm_loadu_si128( reinterpret_cast<const __m128i *>(b + 32) );
+	x4 = _mm_loadu_si128( reinterpret_cast<const __m128i *>(b + 48) );
+	x1 = _mm_xor_si128( x1, _mm_cvtsi32_si128( (int)crc ) );
+	b += 64;
+	size -= 64;
+
+	// fold 4 lanes in parallel
+	x0 = LoadConst( crc32K1K2 );
+	while ( size >= 64 ) {
+		x5 = _mm_clmulepi64_si128( x1, x0, 0x00 );
+		x6 = _mm_clmulepi64_si128( x2, x0, 0x00 );
+		x7 = _mm_clmulepi64_si128( x3, x0, 0x00 );
+		x8 = _mm_clmulepi64_si128( x4, x0, 0x00 );
+		x1 = _mm_clmulepi64_si128( x1, x0, 0x11 );
+		x2 = _mm_clmulepi64_si128( x2, x0, 0x11 );
+		x3 = _mm_clmulepi64_si128( x3, x0, 0x11 );
+		x4 = _mm_clmulepi64_si128( x4, x0, 0x11 );
+		x1 = _mm_xor_si128( _mm_xor_si128( x1, x5 ), _mm_loadu_si128( reinterpret_cast<const __m128i *>(b) ) );
+		x2 = _mm_xor_si128( _mm_xor_si128( x2, x6 ), _mm_loadu_si128( reinterpret_cast<const __m128i *>(b + 16) ) );
+		x3 = _mm_xor_si128( _mm_xor_si128( x3, x7 ), _mm_loadu_si128( reinterpret_cast<const __m128i *>(b + 32) ) );
+		x4 = _mm_xor_si128( _mm_xor_si128( x4, x8 ), _mm_loadu_si128( reinterpret_cast<const __m128i *>(b + 48) ) );
+		b += 64;
+		size -= 64;
+	}
+
+	// fold into 128 bits
+	x0 = LoadConst( crc32K3K4 );
+	x5 = _mm_clmulepi64_si128( x1, x0, 0x00 );
+	x1 = _mm_clmulepi64_si128( x1, x0, 0x11 );
+	x1 = _mm_xor_si128( _mm_xor_si128( x1, x2 ), x5 );
+	x5 = _mm_clmulepi64_si128( x1, x0, 0x00 );
+	x1 = _mm_clmulepi64_si128( x1, x0, 0x11 );
+	x1 = _mm_xor_si128( _mm_xor_si128( x1, x3 ), x5 );
+	x5 = _mm_clmulepi64_si128( x1, x0, 0x00 );
+	x1 = _mm_clmulepi64_si128( x1, x0, 0x11 );
+	x1 = _mm_xor_si128( _mm_xor_si128( x1, x4 ), x5 );
+
+	// remaining 16-byte blocks
+	while ( size >= 16 ) {
+		x5 = _mm_clmulepi64_si128( x1, x0, 0x00 );
+		x1 = _mm_clmulepi64_si128( x1, x0, 0x11 );
+		x1 = _mm_xor_si128( _mm_xor_si128( x1, _mm_loadu_si128( reinterpret_cast<const __m128i *>(b) ) ), x5 );
+		b += 16;
+		size -= 16;
+	}
 
-// pre-calculated CRC-32 table
-UInt crc32Table[256];
+	// fold 128 to 64 bits
+	x2 = _mm_clmulepi64_si128( x1, x0, 0x10 );
+	x3 = _mm_setr_epi32( ~0, 0, ~0, 0 );
+	x1 = _mm_srli_si128( x1, 8 );
+	x1 = _mm_xor_si128( x1, x2 );
 
-#if KWLKIT_USE_CRC32_SLICING
+	x0 = LoadConst( crc32K5K0 );
+	x2 = _mm_srli_si128( x1, 4 );
+	x1 = _mm_and_si128( x1, x3 );
+	x1 = _mm_clmulepi64_si128( x1, x0, 0x00 );
+	x1 = _mm_xor_si128( x1, x2 );
 
-UInt crc32Table1[256];
-UInt crc32Table2[256];
-UInt crc32Table3[256];
+	// Barrett reduction to 32 bits
+	x0 = LoadConst( crc32Poly );
+	x2 = _mm_and_si128( x1, x3 );
+	x2 = _mm_clmulepi64_si128( x2, x0, 0x10 );
+	x2 = _mm_and_si128( x2, x3 );
+	x2 = _mm_clmulepi64_si128( x2, x0, 0x00 );
+	x1 = _mm_xor_si128( x1, x2 );
+
+	return (UInt)_mm_cvtsi128_si32( _mm_srli_si128( x1, 4 ) );
+}
 
 #endif
 
@@ -36,45 +163,83 @@ UInt GetCrc32( const void *buf, size_t sz, UInt crc )
 	crc = ~crc;
 	const Byte *b = static_cast<const Byte *>(buf);
 
-#if KWLKIT_USE_CRC32_SLICING
-	UInt align = (4u - ((UInt)(UIntPtr)b & 3)) & 3u;
-	if ( sz >= 4 + align ) {
-		sz -= align;
-		while ( align-- ) {
-			crc = (crc >> 8) ^ crc32Table[ (crc ^ *b++) & 255 ];
-		}
-		KWLKIT_ASSERT( !((UIntPtr)b & 3 ) );
-		const UInt *ab = reinterpret_cast< const UInt * >( b );
-		b += sz & ~(size_t)3;
-		if ( Endian::IsLittle() ) {
-			do {
-				crc ^= *ab++;
-				crc =
-					crc32Table[ crc >> 24 ] ^
-					crc32Table1[ (crc >> 16) & 255 ] ^
-					crc32Table2[ (crc >> 8) & 255 ] ^
-					crc32Table3[ crc & 255 ];
-			} while ( (sz -= 4) >= 4 );
-		} else {
-			do {
-				Endian::ByteSwap(crc);
-				crc ^= *ab++;
-				crc =
-					crc32Table3[ crc >> 24 ] ^
-					crc32Table2[ (crc >> 16) & 255 ] ^
-					crc32Table1[ (crc >> 8) & 255 ] ^
-					crc32Table[ crc & 255 ];
-			} while ( (sz -= 4) >= 4 );
-		}
+#if KWLKIT_CRC32_PCLMUL
+	if ( sz >= 64 && HasPclmul() ) {
+		size_t chunk = sz & ~(size_t)15;
+		crc = GetCrc32Pclmul( b, chunk, crc );
+		b += chunk;
+		sz -= chunk;
+	}
+#elif KWLKIT_CRC32_ARM
+	for ( ; sz >= 8; sz -= 8, b += 8 ) {
+		ULong tmp = LoadUnaligned<ULong>( b );
+		Endian::FromLittle( tmp );
+		crc = __crc32d( crc, tmp );
 	}
+	while ( sz-- ) {
+		crc = __crc32b( crc, *b++ );
+	}
+	return ~crc;
 #endif
 
+	// slicing by 16
+	const UInt *t = crc32Table;
+	for ( ; sz >= 16; sz -= 16, b += 16 ) {
+		UInt w0 = LoadUnaligned<UInt>( b );
+		UInt w1 = LoadUnaligned<UInt>( b + 4 );
+		UInt w2 = LoadUnaligned<UInt>( b + 8 );
+		UInt w3 = LoadUnaligned<UInt>( b + 12 );
+		Endian::FromLittle( w0 );
+		Endian::FromLittle( w1 );
+		Endian::FromLittle( w2 );
+		Endian::FromLittle( w3 );
+		w0 ^= crc;
+		crc =
+			t[15*256 + (w0 & 255)] ^ t[14*256 + ((w0 >> 8) & 255)] ^ t[13*256 + ((w0 >> 16) & 255)] ^ t[12*256 + (w0 >> 24)] ^
+			t[11*256 + (w1 & 255)] ^ t[10*256 + ((w1 >> 8) & 255)] ^ t[9*256 + ((w1 >> 16) & 255)] ^ t[8*256 + (w1 >> 24)] ^
+			t[7*256 + (w2 & 255)] ^ t[6*256 + ((w2 >> 8) & 255)] ^ t[5*256 + ((w2 >> 16) & 255)] ^ t[4*256 + (w2 >> 24)] ^
+			t[3*256 + (w3 & 255)] ^ t[2*256 + ((w3 >> 8) & 255)] ^ t[1*256 + ((w3 >> 16) & 255)] ^ t[w3 >> 24];
+	}
+
 	while ( sz-- ) {
-		crc = (crc >> 8) ^ crc32Table[ (crc ^ *b++) & 255 ];
+		crc = (crc >> 8) ^ t[ (crc ^ *b++) & 255 ];
 	}
 	return ~crc;
 }
 
+// a * b modulo CRC-32 polynomial (reflected)
+static UInt Crc32MulModP( UInt a, UInt b )
+{
+	UInt m = 1u << 31;
+	UInt p = 0;
+	for (;;) {
+		if ( a & m ) {
+			p ^= b;
+			if ( !(a & (m - 1)) ) {
+				break;
+			}
+		}
+		m >>= 1;
+		b = (b >> 1) ^ (0xedb88320u * (b & 1));
+	}
+	return p;
+}
+
+// based on crc32_combine from zlib
+UInt CombineCrc32( UInt crc1, UInt crc2, Long len2 )
+{
+	KWLKIT_ASSERT( len2 >= 0 );
+	// x^(8*len2) modulo poly
+	UInt p = 1u << 31;
+	UInt k = 3;
+	for ( ULong n = (ULong)len2; n; n >>= 1, k++ ) {
+		if ( n & 1 ) {
+			p = Crc32MulModP( crc32X2nTable[k & 31], p );
+		}
+	}
+	return Crc32MulModP( p, crc1 ) ^ crc2;
+}
+
 void ComputeCrc32Table( UInt *table, UInt poly )
 {
 	for ( UInt i=0; i<256; i++ ) {
@@ -88,14 +253,7 @@ void ComputeCrc32Table( UInt *table, UInt poly )
 
 void ComputeCrc32SlicingTables()
 {
-	ComputeCrc32Table( crc32Table );
-#if KWLKIT_USE_CRC32_SLICING
-	for ( Int i=0; i<256; i++ ) {
-		crc32Table1[i] = (crc32Table[i] >> 8) ^ crc32Table[ crc32Table[i] & 255 ];
-		crc32Table2[i] = (crc32Table1[i] >> 8) ^ crc32Table[ crc32Table1[i] & 255 ];
-		crc32Table3[i] = (crc32Table2[i] >> 8) ^ crc32Table[ crc32Table2[i] & 255 ];
-	}
-#endif
+	// nothing to do, tables are precomputed now
 }
 
 }
@@ -10,12 +10,17 @@
 namespace KwlKit
 {
 
-extern UInt crc32Table[];
+// 16 slicing tables, first 256 entries is the classic byte table
+extern const UInt crc32Table[];
 static const UInt CRC32_INIT = 0;
 
 // calculate CRC-32 value of a buffer
+// uses PCLMULQDQ on x86 if available (runtime check) or ARMv8 crc32 instructions if enabled at compile time
 UInt GetCrc32( const void *buf, size_t sz, UInt crc = CRC32_INIT );
 
+// combine CRC-32 of two adjacent blocks, len2 = length of second block
+UInt CombineCrc32( UInt crc1, UInt crc2, Long len2 );
+
 inline UInt GetCrc32Byte( Byte b, UInt crc = CRC32_INIT )
 {
 	crc = ~crc;
@@ -32,7 +37,7 @@ inline UInt GetCrc32ByteDirect( Byte b, UInt crc = CRC32_INIT ) {
 // default poly: zip-compatible
 void ComputeCrc32Table( UInt *table, UInt poly = 0xedb88320u );
 
-// compute slicing tables for fast CRC-32 computation
+// tables are precomputed now, kept for compatibility (no-op)
 void ComputeCrc32SlicingTables();
 
 }
@@ -0,0 +1,1085 @@
+
+// (c) Martin Sedlak (mar) 2015
+// distributed under the Boost Software License, version 1.0
+// (see accompanying file License.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "Deflate.h"
+#include "Adler32.h"
+#include "Crc32.h"
+#include "../Base/MemoryStream.h"
+#include "../Base/Memory.h"
+#include "../Base/Bits.h"
+#include "../Base/Endian.h"
+#include "../Base/Templates.h"
+
+#if KWLKIT_SIMD_SSE2
+#	include <emmintrin.h>
+#endif
+
+namespace KwlKit
+{
+
+// Deflate
+
+const Int Deflate::PARALLEL_CHUNK_SIZE = 1 << 20;
+const Int Deflate::WINDOW_SIZE = 32768;
+const Int Deflate::WINDOW_MASK = WINDOW_SIZE - 1;
+// match compares may read up to 16 bytes past MAX_MATCH
+const Int Deflate::WINDOW_PAD = 288;
+const Int Deflate::HASH_BITS = 15;
+const Int Deflate::MIN_MATCH = 3;
+const Int Deflate::MAX_MATCH = 258;
+const Int Deflate::MIN_LOOKAHEAD = MAX_MATCH + MIN_MATCH + 1;
+// farthest match distance so that lookahead always stays within window
+const Int Deflate::MAX_DIST = WINDOW_SIZE - MIN_LOOKAHEAD;
+// 3-byte matches farther than this aren't worth it
+const Int Deflate::TOO_FAR = 4096;
+const Int Deflate::SYM_BUFFER_SIZE = 16384;
+const Int Deflate::MAX_STORED = 65535;
+const Int Deflate::OUTPUT_FLUSH_SIZE = 65536;
+
+// match finder parameters per level: good, lazy, nice, chain (same as zlib)
+static const UShort deflateLevels[10][4] = {
+	{ 0, 0, 0, 0 },
+	{ 4, 4, 8, 4 },
+	{ 4, 5, 16, 8 },
+	{ 4, 6, 32, 32 },
+	{ 4, 4, 16, 16 },
+	{ 8, 16, 32, 32 },
+	{ 8, 16, 128, 128 },
+	{ 8, 32, 128, 256 },
+	{ 32, 128, 258, 1024 },
+	{ 32, 258, 258, 4096 }
+};
+
+const Byte Deflate::lenCode[256] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 12, 12, 13, 13, 13, 13, 14, 14, 14, 14, 15, 15, 15, 15,
+	16, 16, 16, 16, 16, 16, 16, 16, 17, 17, 17, 17, 17, 17, 17, 17, 18, 18, 18, 18, 18, 18, 18, 18, 19, 19, 19, 19, 19, 19, 19, 19,
+	20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21,
+	22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23,
+	24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24,
+	25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25,
+	26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
+	27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 28
+};
+
+const Byte Deflate::distCode[512] = {
+	0, 1, 2, 3, 4, 4, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7, 8, 8, 8, 8, 8, 8, 8, 8, 9, 9, 9, 9, 9, 9, 9, 9,
+	10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11,
+	12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,
+	13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13,
+	14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+	14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+	15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+	15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+	0, 14, 16, 17, 18, 18, 19, 19, 20, 20, 20, 20, 21, 21, 21, 21, 22, 22, 22, 22, 22, 22, 22, 22, 23, 23, 23, 23, 23, 23, 23, 23,
+	24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25,
+	26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
+	27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27,
+	28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+	28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+	29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29,
+	29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29
+};
+
+Deflate::Deflate()
+{
+	Init();
+}
+
+Deflate::Deflate( Stream &sout )
+{
+	Init();
+	SetOutput( sout );
+}
+
+Deflate::~Deflate()
+{
+	ClearQueue();
+	delete ownPool;
+}
+
+void Deflate::Init()
+{
+	output = 0;
+	format = INF_RAW;
+	level = 6;
+	crcFunction = 0;
+	parallel = 0;
+	pool = ownPool = 0;
+	chunkSize = PARALLEL_CHUNK_SIZE;
+	queueHead = 0;
+
+	window.Resize( 2*WINDOW_SIZE + WINDOW_PAD );
+	head.Resize( 1 << HASH_BITS );
+	prev.Resize( WINDOW_SIZE );
+	syms.Resize( SYM_BUFFER_SIZE );
+	outBuf.Resize( OUTPUT_FLUSH_SIZE + 6*SYM_BUFFER_SIZE + 1024 );
+	win = window.GetData();
+	headPtr = head.GetData();
+	prevPtr = prev.GetData();
+	symBuf = syms.GetData();
+
+	SetupLevel();
+	ResetState();
+}
+
+void Deflate::ResetState()
+{
+	ClearQueue();
+	chunk.Clear();
+	crc = format == INF_ZLIB ? ADLER32_INIT : CRC32_INIT;
+	totalInputSize = totalOutputSize = 0;
+	started = finished = error = 0;
+
+	head.MemSet( 0 );
+	strStart = 0;
+	lookahead = 0;
+	blockStart = 0;
+	matchLength = prevLength = MIN_MATCH - 1;
+	matchStart = prevMatch = 0;
+	matchAvailable = 0;
+
+	symCount = 0;
+	MemSet( litFreq, 0, sizeof(litFreq) );
+	MemSet( distFreq, 0, sizeof(distFreq) );
+
+	outPtr = outBuf.GetData();
+	bitBuf = 0;
+	bitCount = 0;
+}
+
+bool Deflate::SetupLevel()
+{
+	if ( level < 0 || level > 9 ) {
+		return 0;
+	}
+	goodMatch = deflateLevels[level][0];
+	maxLazy = deflateLevels[level][1];
+	niceMatch = deflateLevels[level][2];
+	maxChain = deflateLevels[level][3];
+	lazy = level >= 4;
+	return 1;
+}
+
+bool Deflate::SetOutput( Stream &sout )
+{
+	output = &sout;
+	return Reset();
+}
+
+bool Deflate::SetFormat( InflateFormat fmt )
+{
+	if ( started || fmt < INF_RAW || fmt > INF_GZIP ) {
+		return 0;
+	}
+	format = fmt;
+	crcFunction = fmt == INF_RAW ? 0 : fmt == INF_ZLIB ? GetAdler32 : GetCrc32;
+	crc = format == INF_ZLIB ? ADLER32_INIT : CRC32_INIT;
+	return 1;
+}
+
+bool Deflate::SetLevel( Int nlevel )
+{
+	if ( started || nlevel < 0 || nlevel > 9 ) {
+		return 0;
+	}
+	level = nlevel;
+	return SetupLevel();
+}
+
+void Deflate::SetParallel( bool enable, ThreadPool *npool, Int nchunkSize )
+{
+	KWLKIT_ASSERT( !started && nchunkSize > 0 );
+	parallel = enable;
+	chunkSize = nchunkSize;
+	pool = npool;
+	if ( enable && !pool ) {
+		if ( !ownPool ) {
+			ownPool = new ThreadPool;
+		}
+		pool = ownPool;
+	}
+}
+
+bool Deflate::Reset()
+{
+	ResetState();
+	return 1;
+}
+
+// header/trailer
+
+void Deflate::WriteHeader()
+{
+	started = 1;
+	EnsureOutput( 16 );
+	if ( format == INF_ZLIB ) {
+		// deflate, 32K window, FLEVEL hint, FCHECK
+		UInt cmf = 0x78;
+		UInt flg = (level < 2 ? 0u : level < 6 ? 1u : level == 6 ? 2u : 3u) << 6;
+		flg += 31 - (cmf*256 + flg) % 31;
+		*outPtr++ = (Byte)cmf;
+		*outPtr++ = (Byte)flg;
+	} else if ( format == INF_GZIP ) {
+		// no flags, no time, XFL = max compression/fastest, unknown OS
+		static const Byte header[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 255 };
+		MemCpy( outPtr, header, sizeof(header) );
+		outPtr[8] = level == 9 ? 2 : level == 1 ? 4 : 0;
+		outPtr += sizeof(header);
+	}
+}
+
+void Deflate::WriteTrailer()
+{
+	EnsureOutput( 16 );
+	if ( format == INF_ZLIB ) {
+		for ( Int i=3; i>=0; i-- ) {
+			*outPtr++ = (Byte)(crc >> (8*i));
+		}
+	} else if ( format == INF_GZIP ) {
+		for ( Int i=0; i<4; i++ ) {
+			*outPtr++ = (Byte)(crc >> (8*i));
+		}
+		for ( Int i=0; i<4; i++ ) {
+			*outPtr++ = (Byte)((ULong)totalInputSize >> (8*i));
+		}
+	}
+}
+
+// match finder
+
+void Deflate::FillWindow( const Byte *&buf, Int &count )
+{
+	if ( strStart >= WINDOW_SIZE + MAX_DIST ) {
+		SlideWindow();
+	}
+	Int part = Min( count, 2*WINDOW_SIZE - strStart - lookahead );
+	KWLKIT_ASSERT( part > 0 );
+	MemCpy( win + strStart + lookahead, buf, (size_t)part );
+	lookahead += part;
+	buf += part;
+	count -= part;
+}
+
+void Deflate::SlideWindow()
+{
+	if ( !level && strStart > blockStart ) {
+		// stored block needs its data
+		EmitBlock( 0 );
+	}
+	MemCpy( win, win + WINDOW_SIZE, (size_t)WINDOW_SIZE );
+	strStart -= WINDOW_SIZE;
+	matchStart -= WINDOW_SIZE;
+	blockStart -= WINDOW_SIZE;
+	const Int hashSize = 1 << HASH_BITS;
+	for ( Int i=0; i<hashSize; i++ ) {
+		UInt p = headPtr[i];
+		headPtr[i] = (UShort)(p >= (UInt)WINDOW_SIZE ? p - WINDOW_SIZE : 0);
+	}
+	for ( Int i=0; i<WINDOW_SIZE; i++ ) {
+		UInt p = prevPtr[i];
+		prevPtr[i] = (UShort)(p >= (UInt)WINDOW_SIZE ? p - WINDOW_SIZE : 0);
+	}
+}
+
+inline UInt Deflate::InsertString( Int pos )
+{
+	const Byte *p = win + pos;
+	UInt h = (((UInt)p[0] | ((UInt)p[1] << 8) | ((UInt)p[2] << 16)) * 2654435761u) >> (32 - HASH_BITS);
+	UInt res = headPtr[h];
+	prevPtr[ pos & WINDOW_MASK ] = (UShort)res;
+	headPtr[h] = (UShort)pos;
+	return res;
+}
+
+// number of matching bytes (at most maxLen), may read up to 15 bytes past maxLen
+static inline Int DeflateMatchLength( const Byte *scan, const Byte *match, Int maxLen )
+{
+	Int len = 0;
+#if KWLKIT_SIMD_SSE2
+	do {
+		__m128i a = _mm_loadu_si128( reinterpret_cast<const __m128i *>(scan + len) );
+		__m128i b = _mm_loadu_si128( reinterpret_cast<const __m128i *>(match + len) );
+		UInt mask = (UInt)_mm_movemask_epi8( _mm_cmpeq_epi8( a, b ) ) ^ 0xffffu;
+		if ( mask ) {
+			len += Bits::CountTrailingZeros( mask );
+			break;
+		}
+		len += 16;
+	} while ( len < maxLen );
+#elif KWLKIT_64BIT
+	if ( Endian::IsLittle() ) {
+		do {
+			ULong diff = LoadUnaligned<ULong>( scan + len ) ^ LoadUnaligned<ULong>( match + len );
+			if ( diff ) {
+				len += Bits::CountTrailingZeros( diff ) >> 3;
+				break;
+			}
+			len += 8;
+		} while ( len < maxLen );
+	} else {
+		while ( len < maxLen && scan[len] == match[len] ) {
+			len++;
+		}
+	}
+#else
+	while ( len < maxLen && scan[len] == match[len] ) {
+		len++;
+	}
+#endif
+	return Min( len, maxLen );
+}
+
+Int Deflate::LongestMatch( Int curMatch, Int bestLen )
+{
+	Int chain = maxChain;
+	if ( bestLen >= goodMatch ) {
+		chain >>= 2;
+	}
+	const Int maxLen = Min( MAX_MATCH, lookahead );
+	const Int nice = Min( niceMatch, maxLen );
+	const Int limit = strStart > MAX_DIST ? strStart - MAX_DIST : 0;
+	const Byte *scan = win + strStart;
+	do {
+		const Byte *match = win + curMatch;
+		// quick reject: must be able to beat current best
+		if ( match[bestLen] != scan[bestLen] || match[bestLen-1] != scan[bestLen-1] || match[0] != scan[0] ||
+			match[1] != scan[1] ) {
+			continue;
+		}
+		Int len = DeflateMatchLength( scan, match, maxLen );
+		if ( len > bestLen ) {
+			matchStart = curMatch;
+			bestLen = len;
+			if ( len >= nice ) {
+				break;
+			}
+		}
+	} while ( (curMatch = prevPtr[ curMatch & WINDOW_MASK ]) > limit && --chain != 0 );
+	return Min( bestLen, lookahead );
+}
+
+inline Int Deflate::GetDistCode( Int dist )
+{
+	dist--;
+	return dist < 256 ? distCode[dist] : distCode[256 + (dist >> 7)];
+}
+
+inline void Deflate::RecordLiteral( Byte b )
+{
+	symBuf[ symCount++ ] = b;
+	litFreq[b]++;
+}
+
+inline void Deflate::RecordMatch( Int len, Int dist )
+{
+	KWLKIT_ASSERT( len >= MIN_MATCH && len <= MAX_MATCH && dist > 0 && dist <= WINDOW_SIZE );
+	symBuf[ symCount++ ] = ((UInt)dist << 8) | (UInt)(len - MIN_MATCH);
+	litFreq[ 257 + lenCode[ len - MIN_MATCH ] ]++;
+	distFreq[ GetDistCode( dist ) ]++;
+}
+
+void Deflate::Compress( bool flush )
+{
+	if ( !level ) {
+		strStart += lookahead;
+		lookahead = 0;
+		return;
+	}
+	if ( lazy ) {
+		CompressLazy( flush );
+	} else {
+		CompressGreedy( flush );
+	}
+}
+
+void Deflate::CompressGreedy( bool flush )
+{
+	while ( lookahead >= MIN_LOOKAHEAD || (flush && lookahead > 0) ) {
+		Int hashHead = lookahead >= MIN_MATCH ? (Int)InsertString( strStart ) : 0;
+		Int len = 0;
+		if ( hashHead && strStart - hashHead <= MAX_DIST ) {
+			len = LongestMatch( hashHead, MIN_MATCH - 1 );
+		}
+		if ( len >= MIN_MATCH ) {
+			RecordMatch( len, strStart - matchStart );
+			lookahead -= len;
+			if ( len <= maxLazy && lookahead >= MIN_MATCH ) {
+				// insert strings inside short matches
+				Int end = strStart + len;
+				while ( ++strStart < end ) {
+					InsertString( strStart );
+				}
+			} else {
+				strStart += len;
+			}
+		} else {
+			RecordLiteral( win[ strStart++ ] );
+			lookahead--;
+		}
+		if ( symCount == SYM_BUFFER_SIZE ) {
+			EmitBlock( 0 );
+		}
+	}
+}
+
+void Deflate::CompressLazy( bool flush )
+{
+	while ( lookahead >= MIN_LOOKAHEAD || (flush && lookahead > 0) ) {
+		Int hashHead = lookahead >= MIN_MATCH ? (Int)InsertString( strStart ) : 0;
+		prevLength = matchLength;
+		prevMatch = matchStart;
+		matchLength = MIN_MATCH - 1;
+		if ( hashHead && prevLength < maxLazy && strStart - hashHead <= MAX_DIST ) {
+			matchLength = LongestMatch( hashHead, prevLength );
+			if ( matchLength == MIN_MATCH && strStart - matchStart > TOO_FAR ) {
+				matchLength = MIN_MATCH - 1;
+			}
+		}
+		if ( prevLength >= MIN_MATCH && matchLength <= prevLength ) {
+			// previous match is better
+			Int maxInsert = strStart + lookahead - MIN_MATCH;
+			RecordMatch( prevLength, strStart - 1 - prevMatch );
+			lookahead -= prevLength - 1;
+			prevLength -= 2;
+			do {
+				if ( ++strStart <= maxInsert ) {
+					InsertString( strStart );
+				}
+			} while ( --prevLength != 0 );
+			matchAvailable = 0;
+			matchLength = MIN_MATCH - 1;
+			strStart++;
+			if ( symCount == SYM_BUFFER_SIZE ) {
+				EmitBlock( 0 );
+			}
+		} else if ( matchAvailable ) {
+			// previous position is a literal
+			RecordLiteral( win[ strStart - 1 ] );
+			if ( symCount == SYM_BUFFER_SIZE ) {
+				EmitBlock( 0 );
+			}
+			strStart++;
+			lookahead--;
+		} else {
+			// wait for next position to decide
+			matchAvailable = 1;
+			strStart++;
+			lookahead--;
+		}
+	}
+	if ( flush && matchAvailable ) {
+		RecordLiteral( win[ strStart - 1 ] );
+		matchAvailable = 0;
+		matchLength = MIN_MATCH - 1;
+	}
+}
+
+// Huffman codes
+
+// in-place minimum redundancy code lengths (Moffat & Katajainen)
+// freq = sorted frequencies (ascending) on input, code lengths on output
+static void DeflateMinimumRedundancy( UInt *a, Int n )
+{
+	if ( n <= 0 ) {
+		return;
+	}
+	if ( n == 1 ) {
+		a[0] = 1;
+		return;
+	}
+	// build tree (parent pointers)
+	a[0] += a[1];
+	Int root = 0;
+	Int leaf = 2;
+	for ( Int next=1; next < n-1; next++ ) {
+		if ( leaf >= n || a[root] < a[leaf] ) {
+			a[next] = a[root];
+			a[root++] = (UInt)next;
+		} else {
+			a[next] = a[leaf++];
+		}
+		if ( leaf >= n || (root < next && a[root] < a[leaf]) ) {
+			a[next] += a[root];
+			a[root++] = (UInt)next;
+		} else {
+			a[next] += a[leaf++];
+		}
+	}
+	// internal node depths
+	a[n-2] = 0;
+	for ( Int next = n-3; next >= 0; next-- ) {
+		a[next] = a[ a[next] ] + 1;
+	}
+	// leaf depths
+	Int avail = 1;
+	Int used = 0;
+	UInt depth = 0;
+	root = n-2;
+	Int next = n-1;
+	while ( avail > 0 ) {
+		while ( root >= 0 && a[root] == depth ) {
+			used++;
+			root--;
+		}
+		while ( avail > used ) {
+			a[next--] = depth;
+			avail--;
+		}
+		avail = 2*used;
+		depth++;
+		used = 0;
+	}
+}
+
+void Deflate::BuildLengths( const UInt *freq, Int count, Int maxBits, Byte *lens )
+{
+	KWLKIT_ASSERT( count >= 2 && count <= 286 );
+	// used symbols sorted by frequency: freq << 9 | symbol
+	UInt keys[286];
+	Int n = 0;
+	for ( Int i=0; i<count; i++ ) {
+		lens[i] = 0;
+		if ( freq[i] ) {
+			keys[n++] = (freq[i] << 9) | (UInt)i;
+		}
+	}
+	// always build at least two codes (a single code would be incomplete)
+	for ( Int i=0; n < 2; i++ ) {
+		if ( !freq[i] ) {
+			keys[n++] = (1u << 9) | (UInt)i;
+		}
+	}
+	for ( Int i=1; i<n; i++ ) {
+		UInt k = keys[i];
+		Int j = i;
+		for ( ; j > 0 && keys[j-1] > k; j-- ) {
+			keys[j] = keys[j-1];
+		}
+		keys[j] = k;
+	}
+
+	UInt depth[286];
+	for ( Int i=0; i<n; i++ ) {
+		depth[i] = keys[i] >> 9;
+	}
+	DeflateMinimumRedundancy( depth, n );
+
+	// limit code lengths: move overlong codes to maxBits, then fix Kraft sum by demoting shorter codes
+	Int numCodes[33] = {0};
+	for ( Int i=0; i<n; i++ ) {
+		numCodes[ Min( depth[i], 32u ) ]++;
+	}
+	for ( Int i=maxBits+1; i<=32; i++ ) {
+		numCodes[maxBits] += numCodes[i];
+	}
+	UInt total = 0;
+	for ( Int i=maxBits; i>0; i-- ) {
+		total += (UInt)numCodes[i] << (maxBits - i);
+	}
+	while ( total != (1u << maxBits) ) {
+		numCodes[maxBits]--;
+		for ( Int i=maxBits-1; i>0; i-- ) {
+			if ( numCodes[i] ) {
+				numCodes[i]--;
+				numCodes[i+1] += 2;
+				break;
+			}
+		}
+		total--;
+	}
+
+	// least frequent symbols get longest codes
+	Int j = 0;
+	for ( Int len=maxBits; len>0; len-- ) {
+		for ( Int k=numCodes[len]; k>0; k-- ) {
+			lens[ keys[j++] & 511 ] = (Byte)len;
+		}
+	}
+}
+
+void Deflate::BuildCodes( const Byte *lens, Int count, UShort *codes )
+{
+	// canonical codes, bit reversed (deflate stores Huffman codes MSBit first)
+	UShort countPerLength[16] = {0};
+	for ( Int i=0; i<count; i++ ) {
+		countPerLength[ lens[i] ]++;
+	}
+	countPerLength[0] = 0;
+	UShort nextCode[16];
+	UInt code = 0;
+	for ( Int i=1; i<16; i++ ) {
+		code = (code + countPerLength[i-1]) << 1;
+		nextCode[i] = (UShort)code;
+	}
+	for ( Int i=0; i<count; i++ ) {
+		if ( lens[i] ) {
+			UShort c = nextCode[ lens[i] ]++;
+			Bits::Reverse( c, lens[i] );
+			codes[i] = c;
+		} else {
+			codes[i] = 0;
+		}
+	}
+}
+
+// bit output
+
+inline void Deflate::PutBits( UInt bits, Int count )
+{
+	KWLKIT_ASSERT( count < 32 && !(bits >> count) );
+	bitBuf |= (ULong)bits << bitCount;
+	bitCount += count;
+	if ( bitCount >= 32 ) {
+		outPtr[0] = (Byte)bitBuf;
+		outPtr[1] = (Byte)(bitBuf >> 8);
+		outPtr[2] = (Byte)(bitBuf >> 16);
+		outPtr[3] = (Byte)(bitBuf >> 24);
+		outPtr += 4;
+		bitBuf >>= 32;
+		bitCount -= 32;
+	}
+}
+
+void Deflate::AlignBits()
+{
+	while ( bitCount > 0 ) {
+		*outPtr++ = (Byte)bitBuf;
+		bitBuf >>= 8;
+		bitCount -= 8;
+	}
+	bitBuf = 0;
+	bitCount = 0;
+}
+
+void Deflate::EnsureOutput( Int bytes )
+{
+	Int used = (Int)(outPtr - outBuf.GetData());
+	if ( outBuf.GetSize() - used < bytes ) {
+		outBuf.Resize( used + bytes );
+		outPtr = outBuf.GetData() + used;
+	}
+}
+
+bool Deflate::WriteOutput( const void *buf, Int count )
+{
+	if ( !output->Write( buf, count ) ) {
+		error = 1;
+		return 0;
+	}
+	totalOutputSize += count;
+	return 1;
+}
+
+bool Deflate::FlushOutput()
+{
+	Int used = (Int)(outPtr - outBuf.GetData());
+	if ( used > 0 ) {
+		if ( !WriteOutput( outBuf.GetData(), used ) ) {
+			return 0;
+		}
+		outPtr = outBuf.GetData();
+	}
+	return 1;
+}
+
+// blocks
+
+void Deflate::EmitStored( const Byte *data, Int len, bool last )
+{
+	EnsureOutput( len + 5*(len / MAX_STORED + 1) + 8 );
+	do {
+		Int part = Min( len, MAX_STORED );
+		len -= part;
+		PutBits( last && !len, 3 );
+		AlignBits();
+		outPtr[0] = (Byte)part;
+		outPtr[1] = (Byte)(part >> 8);
+		outPtr[2] = (Byte)~part;
+		outPtr[3] = (Byte)(~part >> 8);
+		outPtr += 4;
+		if ( part ) {
+			MemCpy( outPtr, data, (size_t)part );
+			outPtr += part;
+			data += part;
+		}
+	} while ( len > 0 );
+}
+
+void Deflate::EmitSymbols( const UShort *litCodes, const Byte *litLens, const UShort *distCodes, const Byte *distLens )
+{
+	for ( Int i=0; i<symCount; i++ ) {
+		UInt s = symBuf[i];
+		if ( s < 256 ) {
+			PutBits( litCodes[s], litLens[s] );
+			continue;
+		}
+		Int len = (Int)(s & 255);
+		Int lc = lenCode[len];
+		PutBits( litCodes[257 + lc], litLens[257 + lc] );
+		if ( Inflate::extraLenBits[lc] ) {
+			PutBits( (UInt)(len + MIN_MATCH - Inflate::lenBase[lc]), Inflate::extraLenBits[lc] );
+		}
+		Int dist = (Int)(s >> 8);
+		Int dc = GetDistCode( dist );
+		PutBits( distCodes[dc], distLens[dc] );
+		if ( Inflate::extraDistBits[dc] ) {
+			PutBits( (UInt)(dist - Inflate::distBase[dc]), Inflate::extraDistBits[dc] );
+		}
+	}
+	PutBits( litCodes[256], litLens[256] );
+}
+
+void Deflate::EmitBlock( bool last )
+{
+	const Int storedLen = strStart - blockStart;
+	if ( !level ) {
+		EmitStored( win + blockStart, storedLen, last );
+		blockStart = strStart;
+		if ( outPtr - outBuf.GetData() >= OUTPUT_FLUSH_SIZE ) {
+			FlushOutput();
+		}
+		return;
+	}
+
+	litFreq[256]++;
+	Byte litLens[286], distLens[30];
+	BuildLengths( litFreq, 286, 15, litLens );
+	BuildLengths( distFreq, 30, 15, distLens );
+	Int hlit = 286;
+	while ( hlit > 257 && !litLens[hlit-1] ) {
+		hlit--;
+	}
+	Int hdist = 30;
+	while ( hdist > 1 && !distLens[hdist-1] ) {
+		hdist--;
+	}
+
+	// run-length encoded code lengths: symbol | (repeat extra << 8)
+	Byte allLens[286 + 30];
+	MemCpy( allLens, litLens, (size_t)hlit );
+	MemCpy( allLens + hlit, distLens, (size_t)hdist );
+	UShort clSyms[286 + 30];
+	Int clCount = 0;
+	UInt clFreq[19] = {0};
+	for ( Int i=0, n=hlit+hdist; i<n; ) {
+		Byte v = allLens[i];
+		Int run = 1;
+		while ( i + run < n && allLens[i + run] == v ) {
+			run++;
+		}
+		i += run;
+		if ( !v ) {
+			while ( run >= 11 ) {
+				Int r = Min( run, 138 );
+				clSyms[ clCount++ ] = (UShort)(18 | ((r - 11) << 8));
+				clFreq[18]++;
+				run -= r;
+			}
+			if ( run >= 3 ) {
+				clSyms[ clCount++ ] = (UShort)(17 | ((run - 3) << 8));
+				clFreq[17]++;
+				run = 0;
+			}
+		} else {
+			clSyms[ clCount++ ] = v;
+			clFreq[v]++;
+			run--;
+			while ( run >= 3 ) {
+				Int r = Min( run, 6 );
+				clSyms[ clCount++ ] = (UShort)(16 | ((r - 3) << 8));
+				clFreq[16]++;
+				run -= r;
+			}
+		}
+		while ( run-- > 0 ) {
+			clSyms[ clCount++ ] = v;
+			clFreq[v]++;
+		}
+	}
+	Byte clLens[19];
+	BuildLengths( clFreq, 19, 7, clLens );
+	Int hclen = 19;
+	while ( hclen > 4 && !clLens[ Inflate::codeOrder[hclen-1] ] ) {
+		hclen--;
+	}
+
+	// block sizes in bits (without 3-bit block header)
+	static const Byte clExtraBits[3] = { 2, 3, 7 };
+	ULong extraBits = 0;
+	ULong dynBits = 5 + 5 + 4 + 3*hclen;
+	ULong fixedBits = 0;
+	for ( Int i=0; i<19; i++ ) {
+		dynBits += (ULong)clFreq[i] * (clLens[i] + (i >= 16 ? clExtraBits[i-16] : 0));
+	}
+	for ( Int i=0; i<286; i++ ) {
+		dynBits += (ULong)litFreq[i] * litLens[i];
+		fixedBits += (ULong)litFreq[i] * (i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8);
+		if ( i > 256 ) {
+			extraBits += (ULong)litFreq[i] * Inflate::extraLenBits[i - 257];
+		}
+	}
+	for ( Int i=0; i<30; i++ ) {
+		dynBits += (ULong)distFreq[i] * distLens[i];
+		fixedBits += (ULong)distFreq[i] * 5;
+		extraBits += (ULong)distFreq[i] * Inflate::extraDistBits[i];
+	}
+	dynBits += extraBits;
+	fixedBits += extraBits;
+
+	// stored only possible while block data is still in window
+	bool store = 0;
+	if ( blockStart >= 0 ) {
+		ULong storedBits = ((ULong)storedLen + 5*(storedLen / MAX_STORED + 1)) * 8;
+		store = storedBits <= Min( dynBits, fixedBits );
+	}
+
+	if ( store ) {
+		EmitStored( win + blockStart, storedLen, last );
+	} else if ( fixedBits <= dynBits ) {
+		Byte fixedLitLens[288], fixedDistLens[30];
+		UShort fixedLitCodes[288], fixedDistCodes[30];
+		for ( Int i=0; i<288; i++ ) {
+			fixedLitLens[i] = (Byte)(i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8);
+		}
+		for ( Int i=0; i<30; i++ ) {
+			fixedDistLens[i] = 5;
+		}
+		BuildCodes( fixedLitLens, 288, fixedLitCodes );
+		BuildCodes( fixedDistLens, 30, fixedDistCodes );
+		EnsureOutput( (Int)(fixedBits / 8) + 16 );
+		PutBits( (last ? 1u : 0u) | (1u << 1), 3 );
+		EmitSymbols( fixedLitCodes, fixedLitLens, fixedDistCodes, fixedDistLens );
+	} else {
+		UShort litCodes[286], distCodes[30], clCodes[19];
+		BuildCodes( litLens, 286, litCodes );
+		BuildCodes( distLens, 30, distCodes );
+		BuildCodes( clLens, 19, clCodes );
+		EnsureOutput( (Int)(dynBits / 8) + 16 );
+		PutBits( (last ? 1u : 0u) | (2u << 1), 3 );
+		PutBits( (UInt)(hlit - 257), 5 );
+		PutBits( (UInt)(hdist - 1), 5 );
+		PutBits( (UInt)(hclen - 4), 4 );
+		for ( Int i=0; i<hclen; i++ ) {
+			PutBits( clLens[ Inflate::codeOrder[i] ], 3 );
+		}
+		for ( Int i=0; i<clCount; i++ ) {
+			Int sym = clSyms[i] & 255;
+			PutBits( clCodes[sym], clLens[sym] );
+			if ( sym >= 16 ) {
+				PutBits( clSyms[i] >> 8, clExtraBits[sym - 16] );
+			}
+		}
+		EmitSymbols( litCodes, litLens, distCodes, distLens );
+	}
+
+	symCount = 0;
+	MemSet( litFreq, 0, sizeof(litFreq) );
+	MemSet( distFreq, 0, sizeof(distFreq) );
+	blockStart = strStart;
+	if ( outPtr - outBuf.GetData() >= OUTPUT_FLUSH_SIZE ) {
+		FlushOutput();
+	}
+}
+
+// public interface
+
+bool Deflate::Write( const void *buf, Int count )
+{
+	KWLKIT_ASSERT( (buf || !count) && count >= 0 );
+	if ( error || finished || !output ) {
+		return 0;
+	}
+	if ( !started ) {
+		WriteHeader();
+	}
+	const Byte *b = static_cast<const Byte *>(buf);
+	totalInputSize += count;
+	if ( parallel ) {
+		while ( count > 0 ) {
+			Int part = Min( count, chunkSize - chunk.GetSize() );
+			chunk.insert( chunk.end(), b, b + part );
+			b += part;
+			count -= part;
+			if ( chunk.GetSize() == chunkSize && !SubmitChunk( 0 ) ) {
+				return 0;
+			}
+		}
+		return !error;
+	}
+	if ( crcFunction && count > 0 ) {
+		crc = crcFunction( b, (size_t)count, crc );
+	}
+	while ( count > 0 ) {
+		FillWindow( b, count );
+		Compress( 0 );
+	}
+	return !error;
+}
+
+bool Deflate::Flush( bool full )
+{
+	if ( error || finished || !output ) {
+		return 0;
+	}
+	if ( !started ) {
+		WriteHeader();
+	}
+	if ( parallel ) {
+		// chunks end with a full flush anyway
+		if ( (!chunk.IsEmpty() && !SubmitChunk( 0 )) || !DrainQueue( 0 ) ) {
+			return 0;
+		}
+	} else {
+		Compress( 1 );
+		if ( symCount || strStart != blockStart ) {
+			EmitBlock( 0 );
+		}
+		// empty stored block
+		EmitStored( 0, 0, 0 );
+		if ( full ) {
+			head.MemSet( 0 );
+		}
+	}
+	return FlushOutput() && output->Flush();
+}
+
+bool Deflate::Finish()
+{
+	if ( error || finished || !output ) {
+		return 0;
+	}
+	if ( !started ) {
+		WriteHeader();
+	}
+	if ( parallel ) {
+		if ( !SubmitChunk( 1 ) || !DrainQueue( 0 ) ) {
+			return 0;
+		}
+	} else {
+		Compress( 1 );
+		EmitBlock( 1 );
+		AlignBits();
+	}
+	WriteTrailer();
+	finished = 1;
+	return FlushOutput() && output->Flush();
+}
+
+// parallel mode
+
+void Deflate::CompressJob( void *param )
+{
+	Job *job = static_cast<Job *>(param);
+	Deflate *owner = job->owner;
+	const Int size = job->input.GetSize();
+	const Byte *src = size ? job->input.GetData() : 0;
+	if ( owner->crcFunction ) {
+		job->crc = owner->crcFunction( src, (size_t)size, owner->format == INF_ZLIB ? ADLER32_INIT : CRC32_INIT );
+	}
+	ArrayStream out( job->output );
+	Deflate enc( out );
+	enc.SetLevel( owner->level );
+	bool ok = enc.Write( src, size ) && (job->final ? enc.Finish() : enc.Flush( 1 ));
+	MutexLock lock( owner->mutex );
+	job->ok = ok;
+	job->done = 1;
+	owner->done.Broadcast();
+}
+
+bool Deflate::SubmitChunk( bool final )
+{
+	Job *job = new Job;
+	job->owner = this;
+	job->input.swap( chunk );
+	job->crc = 0;
+	job->final = final;
+	job->ok = 0;
+	job->done = 0;
+	queue.Add( job );
+	pool->Submit( CompressJob, job );
+	if ( !final ) {
+		chunk.Reserve( chunkSize );
+	}
+	// keep a few chunks in flight
+	return DrainQueue( 2 * Max( pool->GetThreadCount(), (Int)1 ) );
+}
+
+bool Deflate::WriteJob( Job *job )
+{
+	{
+		MutexLock lock( mutex );
+		while ( !job->done ) {
+			done.Wait( mutex );
+		}
+	}
+	bool ok = job->ok && FlushOutput();
+	if ( ok && !job->output.IsEmpty() ) {
+		ok = WriteOutput( job->output.GetData(), job->output.GetSize() );
+	}
+	if ( ok && crcFunction ) {
+		Long len = job->input.GetSize();
+		crc = format == INF_ZLIB ? CombineAdler32( crc, job->crc, len ) : CombineCrc32( crc, job->crc, len );
+	}
+	delete job;
+	if ( !ok ) {
+		error = 1;
+	}
+	return ok;
+}
+
+bool Deflate::DrainQueue( Int maxQueued )
+{
+	while ( queue.GetSize() - queueHead > maxQueued ) {
+		Job *job = queue[ queueHead++ ];
+		if ( queueHead == queue.GetSize() ) {
+			queue.Clear();
+			queueHead = 0;
+		}
+		if ( !WriteJob( job ) ) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+void Deflate::ClearQueue()
+{
+	for ( Int i=queueHead; i<queue.GetSize(); i++ ) {
+		Job *job = queue[i];
+		{
+			MutexLock lock( mutex );
+			while ( !job->done ) {
+				done.Wait( mutex );
+			}
+		}
+		delete job;
+	}
+	queue.Clear();
+	queueHead = 0;
+}
+
+// one-shot
+
+bool DeflateBuffer( const void *src, size_t srcLen, Array< Byte > &dst, InflateFormat fmt, Int level )
+{
+	KWLKIT_ASSERT( src || !srcLen );
+	ArrayStream out( dst );
+	Deflate enc( out );
+	if ( !enc.SetFormat( fmt ) || !enc.SetLevel( level ) ) {
+		return 0;
+	}
+	const Byte *b = static_cast<const Byte *>(src);
+	while ( srcLen > 0 ) {
+		Int part = (Int)Min( srcLen, (size_t)1 << 30 );
+		if ( !enc.Write( b, part ) ) {
+			return 0;
+		}
+		b += part;
+		srcLen -= (size_t)part;
+	}
+	return enc.Finish();
+}
+
+}
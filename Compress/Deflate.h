@@ -0,0 +1,214 @@
+
+// (c) Martin Sedlak (mar) 2015
+// distributed under the Boost Software License, version 1.0
+// (see accompanying file License.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "Inflate.h"
+#include "../Base/Stream.h"
+#include "../Base/Array.h"
+#include "../Base/NoCopy.h"
+#include "../Base/Thread.h"
+
+namespace KwlKit
+{
+
+// Deflate algorithm (compression counterpart of Inflate)
+
+// one-shot compression of a whole buffer (appended to dst)
+// INF_ZIP produces a raw stream (CRC-32 for Zip headers is up to the caller)
+bool DeflateBuffer( const void *src, size_t srcLen, Array< Byte > &dst, InflateFormat fmt = INF_RAW,
+	Int level = 6 );
+
+class Deflate : public NoCopy
+{
+public:
+	Deflate();
+	explicit Deflate( Stream &sout );
+	~Deflate();
+
+	// set output stream (starts a new stream)
+	bool SetOutput( Stream &sout );
+	// INF_ZIP = raw stream, CRC-32 available through GetCrc
+	bool SetFormat( InflateFormat fmt = INF_RAW );
+	// 0 = store only, 1-3 = greedy matching, 4-9 = lazy matching (default 6)
+	// must be called before writing
+	bool SetLevel( Int nlevel );
+
+	// compress large inputs on a thread pool: input is split into chunkSize chunks which are compressed
+	// independently (each ends with a full flush) and written in order
+	// pool = thread pool to use (null = own pool with one thread per CPU)
+	// must be called before writing
+	void SetParallel( bool enable, ThreadPool *pool = 0, Int chunkSize = PARALLEL_CHUNK_SIZE );
+
+	// compress bytes
+	bool Write( const void *buf, Int count );
+
+	// sync flush: write all pending output, byte aligned (empty stored block)
+	// full flush also resets the window so that decoding can start here
+	bool Flush( bool full = 0 );
+
+	// finish stream (final block and ZLib/GZip trailer), Reset starts a new one
+	bool Finish();
+
+	// start new stream (same output, format and level)
+	bool Reset();
+
+	// checksum of input so far (CRC-32 or Adler-32 for ZLib), only valid after Finish in parallel mode
+	inline UInt GetCrc() const {
+		return crc;
+	}
+
+	// get number of bytes compressed so far
+	inline Long GetInputSize() const {
+		return totalInputSize;
+	}
+
+	// get number of compressed bytes written so far
+	inline Long GetOutputSize() const {
+		return totalOutputSize;
+	}
+
+	// default parallel chunk size
+	static const Int PARALLEL_CHUNK_SIZE;
+
+private:
+	struct Job
+	{
+		Deflate *owner;
+		Array< Byte > input;
+		Array< Byte > output;
+		UInt crc;			// input checksum
+		bool final;
+		bool ok;
+		bool done;			// guarded by owner mutex
+	};
+
+	Stream *output;
+	InflateFormat format;
+	Int level;
+	UInt (*crcFunction)( const void *buf, size_t len, UInt chsum );
+	UInt crc;
+	Long totalInputSize;
+	Long totalOutputSize;
+	// header written
+	bool started;
+	bool finished;
+	bool error;
+
+	// match finder parameters (see levels)
+	Int maxChain;		// max hash chain length to follow
+	Int goodMatch;		// reduce chain search above this match length
+	Int maxLazy;		// don't look for lazy matches above this length (greedy: max length to insert into hash)
+	Int niceMatch;		// stop searching above this length
+	bool lazy;
+
+	// sliding window: 2*WINDOW_SIZE bytes (followed by WINDOW_PAD bytes so that match compares may overrun)
+	Array< Byte > window;
+	// hash chains (positions within window, 0 = none)
+	Array< UShort > head;
+	Array< UShort > prev;
+	Byte *win;
+	UShort *headPtr;
+	UShort *prevPtr;
+	Int strStart;		// current position
+	Int lookahead;		// bytes available past strStart
+	Int blockStart;		// window position where current block starts (negative = no longer in window)
+	// lazy matching state
+	Int matchLength;
+	Int matchStart;
+	Int prevLength;
+	Int prevMatch;
+	bool matchAvailable;
+
+	// symbols of current block: literal (< 256) or (distance << 8) | (length - 3)
+	Array< UInt > syms;
+	UInt *symBuf;
+	Int symCount;
+	UInt litFreq[286];
+	UInt distFreq[30];
+
+	// output buffer
+	Array< Byte > outBuf;
+	Byte *outPtr;
+	ULong bitBuf;
+	Int bitCount;
+
+	// parallel mode
+	bool parallel;
+	ThreadPool *pool;
+	ThreadPool *ownPool;
+	Int chunkSize;
+	Array< Byte > chunk;
+	Array< Job * > queue;
+	Int queueHead;
+	Mutex mutex;
+	CondVar done;
+
+	// compressor state
+	void Init();
+	void ResetState();
+	bool SetupLevel();
+	// write ZLib/GZip header
+	void WriteHeader();
+	void WriteTrailer();
+
+	// copy input into window
+	void FillWindow( const Byte *&buf, Int &count );
+	void SlideWindow();
+	inline UInt InsertString( Int pos );
+	// find longest match better than bestLen (sets matchStart)
+	Int LongestMatch( Int curMatch, Int bestLen );
+	// compress window (flush = consume all lookahead)
+	void Compress( bool flush );
+	void CompressGreedy( bool flush );
+	void CompressLazy( bool flush );
+	inline void RecordLiteral( Byte b );
+	inline void RecordMatch( Int len, Int dist );
+	static inline Int GetDistCode( Int dist );
+
+	// emit block covering blockStart..strStart (stored, fixed or dynamic Huffman, whichever is smallest)
+	void EmitBlock( bool last );
+	void EmitStored( const Byte *data, Int len, bool last );
+	void EmitSymbols( const UShort *litCodes, const Byte *litLens, const UShort *distCodes, const Byte *distLens );
+	static void BuildLengths( const UInt *freq, Int count, Int maxBits, Byte *lens );
+	static void BuildCodes( const Byte *lens, Int count, UShort *codes );
+
+	// bit output (LSBit first)
+	inline void PutBits( UInt bits, Int count );
+	void AlignBits();
+	void EnsureOutput( Int bytes );
+	bool FlushOutput();
+	bool WriteOutput( const void *buf, Int count );
+
+	// parallel mode
+	// queue chunk for compression
+	bool SubmitChunk( bool final );
+	// wait for chunk and write it
+	bool WriteJob( Job *job );
+	// write finished chunks until at most maxQueued are left
+	bool DrainQueue( Int maxQueued );
+	// wait for and free queued chunks (without writing)
+	void ClearQueue();
+	static void CompressJob( void *param );
+
+	static const Byte lenCode[256];		// [length-3]
+	static const Byte distCode[512];	// [dist-1] for dist <= 256, else [256 + ((dist-1) >> 7)]
+
+	// constants (for unity build)
+	static const Int WINDOW_SIZE;
+	static const Int WINDOW_MASK;
+	static const Int WINDOW_PAD;
+	static const Int HASH_BITS;
+	static const Int MIN_MATCH;
+	static const Int MAX_MATCH;
+	static const Int MIN_LOOKAHEAD;
+	static const Int MAX_DIST;
+	static const Int TOO_FAR;
+	static const Int SYM_BUFFER_SIZE;
+	static const Int MAX_STORED;
+	static const Int OUTPUT_FLUSH_SIZE;
+};
+
+}
@@ -4,15 +4,23 @@
 // (see accompanying file License.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
 
 #include "Inflate.h"
+#include "InflateIndex.h"
 #include "../Base/Assert.h"
 #include "../Base/Stream.h"
 #include "../Base/Memory.h"
 #include "../Base/Bits.h"
 #include "../Base/Likely.h"
 #include "../Base/Templates.h"
+#include "../Base/Thread.h"
 #include "Adler32.h"
 #include "Crc32.h"
 
+#if KWLKIT_SIMD_SSE2
+#	include <emmintrin.h>
+#elif KWLKIT_SIMD_NEON
+#	include <arm_neon.h>
+#endif
+
 /*
 	for a complete, valid Huffman tree (I'm not talking about adaptive Huffman),
 	NO COMBINATION OF INPUT BITS can ever be invalid, a path is always ensured that leads to a symbol
@@ -24,64 +32,48 @@ namespace KwlKit
 
 // Inflate
 
-const Int Inflate::DICTIONARY_SIZE = 32768;
+const Int Inflate::DICTIONARY_SIZE = 65536;
+const Int Inflate::DICTIONARY_PAD = 32;
+const Int Inflate::WINDOW_SIZE = 32768;
+const Int Inflate::DIRECT_MIN_OUTPUT = 4096;
 const Int Inflate::DIRECT_LUT_BITS = 11;
 const Int Inflate::DIRECT_LUT_SIZE = 1 << DIRECT_LUT_BITS;
+const Int Inflate::MAX_HUFFMAN_CODES = 288;
+const Long Inflate::MAX_BATCH_TASK_SIZE = 256 << 10;
+const Long Inflate::BATCH_ITEM_COST = 256;
+// worst case table sizes: primary table plus at most one (up to 16-entry) sub-table per long code
+const Int Inflate::HUFFMAN_LITLEN_ENOUGH = DIRECT_LUT_SIZE + 16*MAX_HUFFMAN_CODES;
+const Int Inflate::HUFFMAN_DIST_ENOUGH = DIRECT_LUT_SIZE + 16*32;
+const UInt Inflate::HUFFMAN_LINK = 0x80000000u;
+const UInt Inflate::HUFFMAN_LITERAL = 0x40000000u;
+const UInt Inflate::HUFFMAN_END = 0x20000000u;
+// invalid entries (incomplete codes, invalid symbols); unused entries have zero code length
+const UInt Inflate::HUFFMAN_INVALID = 0x10000000u;
 
 // Huffman
 
-void Inflate::Huffman::Init( Int maxCodes )
+void Inflate::Huffman::Init( UInt *nstorage, Int ncapacity )
 {
-	// pre-allocating here
-	codes.Reserve( maxCodes );
-	nodes.Reserve( 2*maxCodes-1 );
-	directLut.Reserve( DIRECT_LUT_SIZE );
+	table = storage = nstorage;
+	capacity = ncapacity;
+	maxBits = tableBits = 0;
 }
 
-
-bool Inflate::Huffman::AddNode( UInt code, Int len, Int sym )
+void Inflate::Huffman::SetFixed( const UInt *ntable, Byte bits )
 {
-	Int ni = 0;
-	if ( KWLKIT_UNLIKELY( nodes.IsEmpty() ) ) {
-		nodes.Resize(1);
-		Node &nn = nodes[0];
-		nn.nodes[0] = nn.nodes[1] = -1;
-		nn.leaf = -1;
-	}
-	for ( Int bit = 0; bit < len; bit++ ) {
-		UInt b = code & (1 << bit);
-		Node &n = nodes[ni];
-		KWLKIT_RET_FALSE_UNLIKELY( n.leaf < 0 );
-		Int nni = n.nodes[ b != 0 ];
-		if ( nni < 0 ) {
-			nni = nodes.Add( Node() );
-			KWLKIT_ASSERT( nni < 32768 );
-			n.nodes[ b != 0 ] = Short(nni);
-			Node &nn = nodes[ nni ];
-			nn.leaf = -1;
-			nn.nodes[0] = nn.nodes[1] = -1;
-		}
-		if ( bit+1 == len ) {
-			nodes[nni].leaf = sym;
-			return 1;
-		}
-		ni = nni;
-	}
-	return 0;
+	table = ntable;
+	maxBits = tableBits = bits;
 }
 
-bool Inflate::Huffman::Reconstruct( const Byte *codeLengths, Int count )
+bool Inflate::Huffman::Reconstruct( const Byte *codeLengths, Int count, Alphabet alphabet )
 {
-	if ( count <= 0 ) {
+	if ( KWLKIT_UNLIKELY( count <= 0 || count > MAX_HUFFMAN_CODES ) ) {
 		return 0;
 	}
-	codes.Resize(count);
-	nodes.Clear();
 
 	// assuming 0..15
 	UShort countPerLength[16] = {0};
-	UInt nextCode[16] = {0};
-	Int ncodes = 0;
+	UShort offsets[16];
 	maxBits = 0;
 	for ( Int i=0; i<count; i++ ) {
 		Byte clen = codeLengths[i];
@@ -93,128 +85,141 @@ bool Inflate::Huffman::Reconstruct( const Byte *codeLengths, Int count )
 		}
 		countPerLength[ clen ]++;
 	}
-	UInt code = 0;
 	countPerLength[0] = 0;
-	for ( Int bit = 1; bit <= maxBits; bit++ ) {
-		UShort count = countPerLength[bit-1];
-		code += count;
-		code <<= 1;
-		nextCode[bit] = code;
-		if ( countPerLength[bit] > 0 ) {
-			ncodes++;
-		}
-	}
-	if ( KWLKIT_UNLIKELY( !ncodes ) ) {
+	if ( KWLKIT_UNLIKELY( !maxBits ) ) {
 		return 0;
 	}
 
-	Byte prevLen = 255;
-	Int startCode = -1;
+	// sort symbols by code length => canonical order
+	UShort sorted[MAX_HUFFMAN_CODES];
+	offsets[1] = 0;
+	for ( Int len = 1; len < 15; len++ ) {
+		offsets[len+1] = (UShort)(offsets[len] + countPerLength[len]);
+	}
+	Int nsorted = 0;
 	for ( Int i=0; i<count; i++ ) {
-		Code &c = codes[i];
-		c.count = 0;
-		c.len = codeLengths[i];
-		if ( !c.len ) {
-			c.code = 0;
-			prevLen = 255;
-			continue;
-		}
-		if ( prevLen != c.len ) {
-			prevLen = c.len;
-			startCode = i;
-		} else if ( prevLen != 255 && codes[startCode].code < 255 ) {
-			codes[startCode].count++;
-		}
-		KWLKIT_ASSERT( c.len > 0 && c.len < 16 );
-		UInt code = nextCode[ c.len ]++;
-		if ( KWLKIT_UNLIKELY( code > 32767 || (code & ~(((UInt)1 << c.len)-1) ) ) ) {
-			// bad code, unfortunately this doesn't catch all problems
-			return 0;
+		Byte clen = codeLengths[i];
+		if ( clen ) {
+			sorted[ offsets[clen]++ ] = (UShort)i;
+			nsorted++;
 		}
+	}
 
-		Bits::Reverse(code, c.len);
-		c.code = (UShort)code;
+	tableBits = (Byte)Min( (Int)maxBits, DIRECT_LUT_BITS );
+	Int tsize = 1 << tableBits;
+	UInt tmask = (UInt)tsize - 1;
+	KWLKIT_ASSERT( tsize <= capacity );
+	for ( Int j=0; j<tsize; j++ ) {
+		storage[j] = HUFFMAN_INVALID;
+	}
+	Int used = tsize;
+	table = storage;
 
-		if ( KWLKIT_UNLIKELY( !AddNode( code, c.len, i ) ) ) {
+	UInt code = 0;
+	Int prevLen = 0;
+	// current sub-table
+	Int subPrefix = -1;
+	Int subOffset = 0;
+	Int subBits = 0;
+
+	for ( Int i=0; i<nsorted; i++ ) {
+		UInt sym = sorted[i];
+		Int len = codeLengths[sym];
+		code <<= len - prevLen;
+		prevLen = len;
+		if ( KWLKIT_UNLIKELY( code >> len ) ) {
+			// oversubscribed
 			return 0;
 		}
-	}
-
-	// FIXME: Ken Silverman's pngout produces incomplete trees
-	// ... so no completeness check here
-
-	// build direct lut
-	Int dbits = Min( (Int)maxBits, DIRECT_LUT_BITS );
-	maxBits = (Byte)dbits;
-	Int dsize = 1 << dbits;
-	directLut.Resize( dsize );
-	directLut.Fill(-1);
-	for ( Int i=0; i<codes.GetSize(); i++ ) {
-		const Code &c = codes[i];
-		if ( !c.len || c.len > dbits ) {
+		UInt rev = code;
+		Bits::Reverse( rev, (Byte)len );
+		code++;
+
+		UInt entry = GetSymbolEntry( (Int)sym, alphabet ) | ((UInt)len << 16);
+		if ( len <= tableBits ) {
+			for ( Int j = (Int)rev; j < tsize; j += 1 << len ) {
+				storage[j] = entry;
+			}
+			countPerLength[len]--;
 			continue;
 		}
-		UShort rev = c.code;
-		KWLKIT_ASSERT(dbits - c.len < 256);
-		Byte remBits = Byte(dbits - c.len);
-		for ( Int j=0; j<((Int)1 << remBits); j++ ) {
-			Int idx = j << c.len;
-			directLut[rev+idx] = (Short)i;
+
+		// long code => goes to sub-table
+		if ( (Int)(rev & tmask) != subPrefix ) {
+			// start new sub-table; size it so that all remaining codes sharing this prefix fit
+			subPrefix = (Int)(rev & tmask);
+			subBits = len - tableBits;
+			Int left = 1 << subBits;
+			while ( subBits + tableBits < maxBits ) {
+				left -= countPerLength[ subBits + tableBits ];
+				if ( left <= 0 ) {
+					break;
+				}
+				subBits++;
+				left <<= 1;
+			}
+			subOffset = used;
+			used += 1 << subBits;
+			if ( KWLKIT_UNLIKELY( used > capacity ) ) {
+				return 0;
+			}
+			for ( Int j = subOffset; j < used; j++ ) {
+				storage[j] = HUFFMAN_INVALID;
+			}
+			storage[subPrefix] = HUFFMAN_LINK | ((UInt)subBits << 24) | (UInt)subOffset;
+		}
+		for ( Int j = (Int)(rev >> tableBits); j < (1 << subBits); j += 1 << (len - tableBits) ) {
+			storage[subOffset + j] = entry;
 		}
+		countPerLength[len]--;
 	}
+
+	// FIXME: Ken Silverman's pngout produces incomplete trees
+	// ... so no completeness check here (missing codes decode as invalid entries)
 	return 1;
 }
 
-// decode value from stream, returns max int on error
-template< Byte hidx, bool fast > Int Inflate::Decode()
+inline UInt Inflate::Huffman::Lookup( UInt bits ) const
+{
+	UInt entry = table[ bits & (((UInt)1 << tableBits)-1) ];
+	if ( KWLKIT_UNLIKELY( entry & HUFFMAN_LINK ) ) {
+		UInt smask = ((UInt)1 << ((entry >> 24) & 7)) - 1;
+		entry = table[ (entry & 0xffffu) + ((bits >> tableBits) & smask) ];
+	}
+	return entry;
+}
+
+// decode table entry from stream, returns invalid entry on error
+template< Byte hidx, bool fast > UInt Inflate::Decode()
 {
+	const Huffman &h = huf[hidx];
 	if ( fast ) {
-		Byte tsize = huf[hidx].maxBits;
-		UInt tmp = inbit.PeekBitsFast(tsize);
-		Int res = huf[hidx].directLut[(Int)tmp];
-		if ( KWLKIT_LIKELY( res >= 0 ) ) {
-			Byte bits = huf[hidx].codes[res].len;
-			inbit.PopBitsFast( bits );
-			return res;
-		}
-		// at this point, we got tsize bits but we need more
-		inbit.PopBitsFast( tsize );
-		Int inode = 0;
-		while ( tsize-- ) {
-			if ( KWLKIT_UNLIKELY( inode < 0 ) ) {
-				return Limits<Int>::MAX;
-			}
-			const Huffman::Node &n = huf[hidx].nodes[inode];
-			KWLKIT_ASSERT( n.leaf < 0 );
-			inode = n.nodes[ tmp & 1 ];
-			tmp >>= 1;
-		}
-		while ( inode >= 0 ) {
-			Int leaf = huf[hidx].nodes[inode].leaf;
-			if ( KWLKIT_UNLIKELY( leaf >= 0 ) ) {
-				return leaf;
-			}
-			Int b = inbit.ReadBit();
-			if ( KWLKIT_UNLIKELY( b < 0 ) ) {
-				break;
-			}
-			inode = huf[hidx].nodes[inode].nodes[b];
-		}
-		return Limits<Int>::MAX;
+		// at most two table lookups; caller must call RefillFast
+		UInt entry = h.Lookup( inbit.PeekAccum( h.maxBits ) );
+		inbit.PopBitsFast( (Byte)((entry >> 16) & 15) );
+		return entry;
 	} else {
-		Int inode = 0;
-		do {
-			Int leaf = huf[hidx].nodes[inode].leaf;
-			if ( KWLKIT_UNLIKELY( leaf >= 0 ) ) {
-				return leaf;
-			}
+		// near end of input: single lookup if what's left fills the accumulator enough
+		if ( KWLKIT_LIKELY( inbit.RefillSlow() >= h.maxBits ) ) {
+			UInt entry = h.Lookup( inbit.PeekAccum( h.maxBits ) );
+			inbit.PopBitsFast( (Byte)((entry >> 16) & 15) );
+			return entry;
+		}
+		// last few bits: fetch bit by bit until a complete code is found
+		UInt bits = 0;
+		for ( Int len = 1; len <= h.maxBits; len++ ) {
 			Int b = inbit.ReadBit();
 			if ( KWLKIT_UNLIKELY( b < 0 ) ) {
 				break;
 			}
-			inode = huf[hidx].nodes[inode].nodes[b];
-		} while ( inode >= 0 );
-		return Limits<Int>::MAX;
+			bits |= (UInt)b << (len-1);
+			UInt entry = h.Lookup( bits );
+			Int elen = (Int)((entry >> 16) & 15);
+			if ( elen && elen <= len ) {
+				return entry;
+			}
+		}
+		return HUFFMAN_INVALID;
 	}
 }
 
@@ -241,31 +246,118 @@ const Byte Inflate::codeOrder[19] = {
 	16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
 };
 
-template< Byte hidx > bool Inflate::BuildHuffman( const Byte *codeLengths, Int count ) {
-	return huf[hidx].Reconstruct( codeLengths, count );
-}
+// fixed Huffman decode tables (btype 1), as built by Huffman::Reconstruct from fixed code lengths:
+// literal/length: 0-143 => 8 bits, 144-255 => 9 bits, 256-279 => 7 bits, 280-287 => 8 bits
+const UInt Inflate::fixedLitLenTable[512] = {
+	0x20070000u, 0x40080050u, 0x40080010u, 0x00480073u, 0x0027001fu, 0x40080070u, 0x40080030u, 0x400900c0u,
+	0x0007000au, 0x40080060u, 0x40080020u, 0x400900a0u, 0x40080000u, 0x40080080u, 0x40080040u, 0x400900e0u,
+	0x00070006u, 0x40080058u, 0x40080018u, 0x40090090u, 0x0037003bu, 0x40080078u, 0x40080038u, 0x400900d0u,
+	0x00170011u, 0x40080068u, 0x40080028u, 0x400900b0u, 0x40080008u, 0x40080088u, 0x40080048u, 0x400900f0u,
+	0x00070004u, 0x40080054u, 0x40080014u, 0x005800e3u, 0x0037002bu, 0x40080074u, 0x40080034u, 0x400900c8u,
+	0x0017000du, 0x40080064u, 0x40080024u, 0x400900a8u, 0x40080004u, 0x40080084u, 0x40080044u, 0x400900e8u,
+	0x00070008u, 0x4008005cu, 0x4008001cu, 0x40090098u, 0x00470053u, 0x4008007cu, 0x4008003cu, 0x400900d8u,
+	0x00270017u, 0x4008006cu, 0x4008002cu, 0x400900b8u, 0x4008000cu, 0x4008008cu, 0x4008004cu, 0x400900f8u,
+	0x00070003u, 0x40080052u, 0x40080012u, 0x005800a3u, 0x00370023u, 0x40080072u, 0x40080032u, 0x400900c4u,
+	0x0017000bu, 0x40080062u, 0x40080022u, 0x400900a4u, 0x40080002u, 0x40080082u, 0x40080042u, 0x400900e4u,
+	0x00070007u, 0x4008005au, 0x4008001au, 0x40090094u, 0x00470043u, 0x4008007au, 0x4008003au, 0x400900d4u,
+	0x00270013u, 0x4008006au, 0x4008002au, 0x400900b4u, 0x4008000au, 0x4008008au, 0x4008004au, 0x400900f4u,
+	0x00070005u, 0x40080056u, 0x40080016u, 0x10080000u, 0x00370033u, 0x40080076u, 0x40080036u, 0x400900ccu,
+	0x0017000fu, 0x40080066u, 0x40080026u, 0x400900acu, 0x40080006u, 0x40080086u, 0x40080046u, 0x400900ecu,
+	0x00070009u, 0x4008005eu, 0x4008001eu, 0x4009009cu, 0x00470063u, 0x4008007eu, 0x4008003eu, 0x400900dcu,
+	0x0027001bu, 0x4008006eu, 0x4008002eu, 0x400900bcu, 0x4008000eu, 0x4008008eu, 0x4008004eu, 0x400900fcu,
+	0x20070000u, 0x40080051u, 0x40080011u, 0x00580083u, 0x0027001fu, 0x40080071u, 0x40080031u, 0x400900c2u,
+	0x0007000au, 0x40080061u, 0x40080021u, 0x400900a2u, 0x40080001u, 0x40080081u, 0x40080041u, 0x400900e2u,
+	0x00070006u, 0x40080059u, 0x40080019u, 0x40090092u, 0x0037003bu, 0x40080079u, 0x40080039u, 0x400900d2u,
+	0x00170011u, 0x40080069u, 0x40080029u, 0x400900b2u, 0x40080009u, 0x40080089u, 0x40080049u, 0x400900f2u,
+	0x00070004u, 0x40080055u, 0x40080015u, 0x00080102u, 0x0037002bu, 0x40080075u, 0x40080035u, 0x400900cau,
+	0x0017000du, 0x40080065u, 0x40080025u, 0x400900aau, 0x40080005u, 0x40080085u, 0x40080045u, 0x400900eau,
+	0x00070008u, 0x4008005du, 0x4008001du, 0x4009009au, 0x00470053u, 0x4008007du, 0x4008003du, 0x400900dau,
+	0x00270017u, 0x4008006du, 0x4008002du, 0x400900bau, 0x4008000du, 0x4008008du, 0x4008004du, 0x400900fau,
+	0x00070003u, 0x40080053u, 0x40080013u, 0x005800c3u, 0x00370023u, 0x40080073u, 0x40080033u, 0x400900c6u,
+	0x0017000bu, 0x40080063u, 0x40080023u, 0x400900a6u, 0x40080003u, 0x40080083u, 0x40080043u, 0x400900e6u,
+	0x00070007u, 0x4008005bu, 0x4008001bu, 0x40090096u, 0x00470043u, 0x4008007bu, 0x4008003bu, 0x400900d6u,
+	0x00270013u, 0x4008006bu, 0x4008002bu, 0x400900b6u, 0x4008000bu, 0x4008008bu, 0x4008004bu, 0x400900f6u,
+	0x00070005u, 0x40080057u, 0x40080017u, 0x10080000u, 0x00370033u, 0x40080077u, 0x40080037u, 0x400900ceu,
+	0x0017000fu, 0x40080067u, 0x40080027u, 0x400900aeu, 0x40080007u, 0x40080087u, 0x40080047u, 0x400900eeu,
+	0x00070009u, 0x4008005fu, 0x4008001fu, 0x4009009eu, 0x00470063u, 0x4008007fu, 0x4008003fu, 0x400900deu,
+	0x0027001bu, 0x4008006fu, 0x4008002fu, 0x400900beu, 0x4008000fu, 0x4008008fu, 0x4008004fu, 0x400900feu,
+	0x20070000u, 0x40080050u, 0x40080010u, 0x00480073u, 0x0027001fu, 0x40080070u, 0x40080030u, 0x400900c1u,
+	0x0007000au, 0x40080060u, 0x40080020u, 0x400900a1u, 0x40080000u, 0x40080080u, 0x40080040u, 0x400900e1u,
+	0x00070006u, 0x40080058u, 0x40080018u, 0x40090091u, 0x0037003bu, 0x40080078u, 0x40080038u, 0x400900d1u,
+	0x00170011u, 0x40080068u, 0x40080028u, 0x400900b1u, 0x40080008u, 0x40080088u, 0x40080048u, 0x400900f1u,
+	0x00070004u, 0x40080054u, 0x40080014u, 0x005800e3u, 0x0037002bu, 0x40080074u, 0x40080034u, 0x400900c9u,
+	0x0017000du, 0x40080064u, 0x40080024u, 0x400900a9u, 0x40080004u, 0x40080084u, 0x40080044u, 0x400900e9u,
+	0x00070008u, 0x4008005cu, 0x4008001cu, 0x40090099u, 0x00470053u, 0x4008007cu, 0x4008003cu, 0x400900d9u,
+	0x00270017u, 0x4008006cu, 0x4008002cu, 0x400900b9u, 0x4008000cu, 0x4008008cu, 0x4008004cu, 0x400900f9u,
+	0x00070003u, 0x40080052u, 0x40080012u, 0x005800a3u, 0x00370023u, 0x40080072u, 0x40080032u, 0x400900c5u,
+	0x0017000bu, 0x40080062u, 0x40080022u, 0x400900a5u, 0x40080002u, 0x40080082u, 0x40080042u, 0x400900e5u,
+	0x00070007u, 0x4008005au, 0x4008001au, 0x40090095u, 0x00470043u, 0x4008007au, 0x4008003au, 0x400900d5u,
+	0x00270013u, 0x4008006au, 0x4008002au, 0x400900b5u, 0x4008000au, 0x4008008au, 0x4008004au, 0x400900f5u,
+	0x00070005u, 0x40080056u, 0x40080016u, 0x10080000u, 0x00370033u, 0x40080076u, 0x40080036u, 0x400900cdu,
+	0x0017000fu, 0x40080066u, 0x40080026u, 0x400900adu, 0x40080006u, 0x40080086u, 0x40080046u, 0x400900edu,
+	0x00070009u, 0x4008005eu, 0x4008001eu, 0x4009009du, 0x00470063u, 0x4008007eu, 0x4008003eu, 0x400900ddu,
+	0x0027001bu, 0x4008006eu, 0x4008002eu, 0x400900bdu, 0x4008000eu, 0x4008008eu, 0x4008004eu, 0x400900fdu,
+	0x20070000u, 0x40080051u, 0x40080011u, 0x00580083u, 0x0027001fu, 0x40080071u, 0x40080031u, 0x400900c3u,
+	0x0007000au, 0x40080061u, 0x40080021u, 0x400900a3u, 0x40080001u, 0x40080081u, 0x40080041u, 0x400900e3u,
+	0x00070006u, 0x40080059u, 0x40080019u, 0x40090093u, 0x0037003bu, 0x40080079u, 0x40080039u, 0x400900d3u,
+	0x00170011u, 0x40080069u, 0x40080029u, 0x400900b3u, 0x40080009u, 0x40080089u, 0x40080049u, 0x400900f3u,
+	0x00070004u, 0x40080055u, 0x40080015u, 0x00080102u, 0x0037002bu, 0x40080075u, 0x40080035u, 0x400900cbu,
+	0x0017000du, 0x40080065u, 0x40080025u, 0x400900abu, 0x40080005u, 0x40080085u, 0x40080045u, 0x400900ebu,
+	0x00070008u, 0x4008005du, 0x4008001du, 0x4009009bu, 0x00470053u, 0x4008007du, 0x4008003du, 0x400900dbu,
+	0x00270017u, 0x4008006du, 0x4008002du, 0x400900bbu, 0x4008000du, 0x4008008du, 0x4008004du, 0x400900fbu,
+	0x00070003u, 0x40080053u, 0x40080013u, 0x005800c3u, 0x00370023u, 0x40080073u, 0x40080033u, 0x400900c7u,
+	0x0017000bu, 0x40080063u, 0x40080023u, 0x400900a7u, 0x40080003u, 0x40080083u, 0x40080043u, 0x400900e7u,
+	0x00070007u, 0x4008005bu, 0x4008001bu, 0x40090097u, 0x00470043u, 0x4008007bu, 0x4008003bu, 0x400900d7u,
+	0x00270013u, 0x4008006bu, 0x4008002bu, 0x400900b7u, 0x4008000bu, 0x4008008bu, 0x4008004bu, 0x400900f7u,
+	0x00070005u, 0x40080057u, 0x40080017u, 0x10080000u, 0x00370033u, 0x40080077u, 0x40080037u, 0x400900cfu,
+	0x0017000fu, 0x40080067u, 0x40080027u, 0x400900afu, 0x40080007u, 0x40080087u, 0x40080047u, 0x400900efu,
+	0x00070009u, 0x4008005fu, 0x4008001fu, 0x4009009fu, 0x00470063u, 0x4008007fu, 0x4008003fu, 0x400900dfu,
+	0x0027001bu, 0x4008006fu, 0x4008002fu, 0x400900bfu, 0x4008000fu, 0x4008008fu, 0x4008004fu, 0x400900ffu
+};
+
+// distance: all 32 codes 5 bits
+const UInt Inflate::fixedDistTable[32] = {
+	0x00050001u, 0x00750101u, 0x00350011u, 0x00b51001u, 0x00150005u, 0x00950401u, 0x00550041u, 0x00d54001u,
+	0x00050003u, 0x00850201u, 0x00450021u, 0x00c52001u, 0x00250009u, 0x00a50801u, 0x00650081u, 0x10050000u,
+	0x00050002u, 0x00750181u, 0x00350019u, 0x00b51801u, 0x00150007u, 0x00950601u, 0x00550061u, 0x00d56001u,
+	0x00050004u, 0x00850301u, 0x00450031u, 0x00c53001u, 0x0025000du, 0x00a50c01u, 0x006500c1u, 0x10050000u
+};
 
-void Inflate::BuildFixedLitLenHuffman()
+UInt Inflate::GetSymbolEntry( Int sym, Huffman::Alphabet alphabet )
 {
-	// these tricky constants avoid FP in PVS studio
-	const Int BITSIZE_PART0 = 8;
-	const Int BITSIZE_PART1 = BITSIZE_PART0+1;
-	const Int BITSIZE_PART2 = BITSIZE_PART0-1;
-	const Int BITSIZE_PART3 = BITSIZE_PART0;
+	switch( alphabet )
+	{
+	case Huffman::ALPHABET_LITLEN:
+		if ( sym < 256 ) {
+			return HUFFMAN_LITERAL | (UInt)sym;
+		}
+		if ( sym == 256 ) {
+			return HUFFMAN_END;
+		}
+		if ( KWLKIT_UNLIKELY( sym > 285 ) ) {
+			return HUFFMAN_INVALID;
+		}
+		return lenBase[sym-257] | ((UInt)extraLenBits[sym-257] << 20);
+	case Huffman::ALPHABET_DIST:
+		if ( KWLKIT_UNLIKELY( sym >= 30 ) ) {
+			return HUFFMAN_INVALID;
+		}
+		return distBase[sym] | ((UInt)extraDistBits[sym] << 20);
+	default:
+		return (UInt)sym;
+	}
+}
 
-	Byte codeLengths[288];
-	MemSet( codeLengths+0, BITSIZE_PART0, 144 );
-	MemSet( codeLengths+144, BITSIZE_PART1, 112 );
-	MemSet( codeLengths+256, BITSIZE_PART2, 24 );
-	MemSet( codeLengths+280, BITSIZE_PART3, 8 );
-	BuildHuffman<0>( codeLengths, 288 );
+template< Byte hidx > bool Inflate::BuildHuffman( const Byte *codeLengths, Int count, Huffman::Alphabet alphabet )
+{
+	KWLKIT_PROFILE_SCOPE( profile, PROFILE_HUFFMAN_BUILD );
+	return huf[hidx].Reconstruct( codeLengths, count, alphabet );
 }
 
-void Inflate::BuildFixedDistHuffman()
+void Inflate::SetFixedHuffman()
 {
-	Byte codeLengths[32];
-	MemSet( codeLengths, 5, 32 );
-	BuildHuffman<1>( codeLengths, 32 );
+	huf[0].SetFixed( fixedLitLenTable, 9 );
+	huf[1].SetFixed( fixedDistTable, 5 );
 }
 
 void Inflate::Init()
@@ -273,21 +365,36 @@ void Inflate::Init()
 	// "init" format/crcFunction just to keep some static analyzers happy
 	format = INF_RAW;
 	crcFunction = 0;
+	trusted = 0;
 
-	huf[0].Init( 288 );
-	huf[1].Init( 32 );
+	if ( !oneShot ) {
+		hufStorage.Resize( HUFFMAN_LITLEN_ENOUGH + HUFFMAN_DIST_ENOUGH );
+		hufTables = hufStorage.GetData();
+	}
+	huf[0].Init( hufTables, HUFFMAN_LITLEN_ENOUGH );
+	huf[1].Init( hufTables + HUFFMAN_LITLEN_ENOUGH, HUFFMAN_DIST_ENOUGH );
 	zipCrc = 0;
+	multiMember = 1;
+	pushMode = pushEnd = needInput = 0;
 	outLimit = Limits<Long>::MAX;
+	checkpointAt = Limits<Long>::MAX;
+	stopBit = Limits<Long>::MAX;
+	strictHeader = 0;
 	SetFormat();
 	ResetState();
 }
 
-Inflate::Inflate() : input(0)
+Inflate::Inflate() : input(0), profile(0), hufTables(0), oneShot(0)
 {
 	Init();
 }
 
-Inflate::Inflate( Stream &sin ) : input(&sin), inbit(sin)
+Inflate::Inflate( Stream &sin ) : input(&sin), inbit(sin), profile(0), hufTables(0), oneShot(0)
+{
+	Init();
+}
+
+Inflate::Inflate( UInt *tables ) : input(0), profile(0), hufTables(tables), oneShot(1)
 {
 	Init();
 }
@@ -295,13 +402,32 @@ Inflate::Inflate( Stream &sin ) : input(&sin), inbit(sin)
 bool Inflate::SetInput( Stream &sin )
 {
 	input = &sin;
+	pushMode = pushEnd = needInput = 0;
+	pushBuffer.Clear();
 	return inbit.SetStream(sin);
 }
 
+bool Inflate::Reset( Stream &sin, InflateFormat fmt )
+{
+	KWLKIT_ASSERT( !oneShot );
+	input = &sin;
+	// don't flush previous stream
+	inbit.DetachStream();
+	if ( !inbit.SetStream(sin) ) {
+		return 0;
+	}
+	pushBuffer.Clear();
+	Init();
+	return SetFormat( fmt );
+}
+
 bool Inflate::SetFormat( InflateFormat fmt )
 {
 	format = fmt;
 	crcFunction = 0;
+	if ( trusted ) {
+		return 1;
+	}
 	if ( fmt == INF_ZLIB ) {
 		crcFunction = GetAdler32;
 	} else if ( fmt == INF_GZIP || fmt == INF_ZIP ) {
@@ -310,6 +436,12 @@ bool Inflate::SetFormat( InflateFormat fmt )
 	return 1;
 }
 
+void Inflate::SetTrusted( bool enable )
+{
+	trusted = enable;
+	SetFormat( format );
+}
+
 bool Inflate::Flush()
 {
 	Int delta = (Int)dictIndex - (Int)dictFlushIndex;
@@ -338,18 +470,163 @@ inline void Inflate::OutByte( Byte b )
 	dictIndex &= DICTIONARY_SIZE - 1;
 }
 
+// output single byte to dictionary or directly to caller buffer
+template< Inflate::OutputMode mode > inline void Inflate::Emit( Byte b )
+{
+	if ( mode == OUTPUT_DICTIONARY ) {
+		OutByte( b );
+	} else if ( mode == OUTPUT_MARKER ) {
+		*markerPtr++ = b;
+	} else if ( mode == OUTPUT_DIRECT || KWLKIT_LIKELY( directPtr < directEnd ) ) {
+		*directPtr++ = b;
+	} else {
+		directOverflow = 1;
+	}
+}
+
+template< Inflate::OutputMode mode > inline void Inflate::EmitRep( Int len, Int dist )
+{
+	if ( mode == OUTPUT_DICTIONARY ) {
+		OutRep( len, dist );
+	} else if ( mode == OUTPUT_DIRECT ) {
+		OutRepDirect( len, dist );
+	} else if ( mode == OUTPUT_MARKER ) {
+		OutRepMarker( len, dist );
+	} else {
+		OutRepExact( len, dist );
+	}
+}
+
+// copy 16 bytes (may overlap only if dst >= src + 16)
+static inline void Copy16( Byte *dst, const Byte *src )
+{
+#if KWLKIT_SIMD_SSE2
+	_mm_storeu_si128( reinterpret_cast<__m128i *>(dst), _mm_loadu_si128( reinterpret_cast<const __m128i *>(src) ) );
+#elif KWLKIT_SIMD_NEON
+	vst1q_u8( dst, vld1q_u8( src ) );
+#else
+	StoreUnaligned<ULong>( dst, LoadUnaligned<ULong>( src ) );
+	StoreUnaligned<ULong>( dst + 8, LoadUnaligned<ULong>( src + 8 ) );
+#endif
+}
+
+// copy match of len bytes, may write up to 15 bytes past dst + len (and read past src + len)
+// src must either precede dst by dist bytes or not overlap with dst at all
+static inline void CopyMatch( Byte *dst, const Byte *src, Int len, Int dist )
+{
+	Byte *dstEnd = dst + len;
+	if ( dist >= 16 ) {
+		do {
+			Copy16( dst, src );
+			dst += 16;
+			src += 16;
+		} while ( dst < dstEnd );
+		return;
+	}
+	if ( dist == 1 ) {
+		// run of single byte
+		MemSet( dst, *src, (size_t)len );
+		return;
+	}
+	if ( dist >= 8 ) {
+		do {
+			StoreUnaligned<ULong>( dst, LoadUnaligned<ULong>( src ) );
+			dst += 8;
+			src += 8;
+		} while ( dst < dstEnd );
+		return;
+	}
+	// short period: replicate pattern to 8 bytes and store in steps of a multiple of dist
+	Byte pattern[8];
+	for ( Int i=0; i<8; i++ ) {
+		pattern[i] = src[i % dist];
+	}
+	ULong pat = LoadUnaligned<ULong>( pattern );
+	Int step = 8 - 8 % dist;
+	do {
+		StoreUnaligned<ULong>( dst, pat );
+		dst += step;
+	} while ( dst < dstEnd );
+}
+
 // output rep
 void Inflate::OutRep( Int len, Int dist )
 {
 	KWLKIT_ASSERT( len >= 3 && len <= 258 );
-	KWLKIT_ASSERT( dist >= 1 && dist <= DICTIONARY_SIZE );
+	KWLKIT_ASSERT( dist >= 1 && dist <= WINDOW_SIZE );
 	UInt ptr = dictIndex - (UInt)dist;
 	ptr &= DICTIONARY_SIZE - 1;
 
-	if ( (Int)ptr + len <= DICTIONARY_SIZE && (Int)dictIndex + len < DICTIONARY_SIZE ) {
-		Byte *dst = dictionary.GetData() + dictIndex;
-		const Byte *src = dictionary.GetData() + ptr;
+	if ( KWLKIT_LIKELY( (Int)ptr + len <= DICTIONARY_SIZE && (Int)dictIndex + len < DICTIONARY_SIZE ) ) {
+		// no wrap: overrun lands in free part of the ring (or in padding),
+		// way more than WINDOW_SIZE bytes back, so it never clobbers the window
+		CopyMatch( dictionary.GetData() + dictIndex, dictionary.GetData() + ptr, len, dist );
 		dictIndex += len;
+		return;
+	}
+
+	while ( len-- > 0 ) {
+		OutByte( dictionary[ ptr++ ] );
+		ptr &= DICTIONARY_SIZE - 1;
+	}
+}
+
+// output rep (direct mode)
+void Inflate::OutRepDirect( Int len, Int dist )
+{
+	KWLKIT_ASSERT( len >= 3 && len <= 258 );
+	KWLKIT_ASSERT( dist >= 1 && dist <= WINDOW_SIZE );
+	Int avail = (Int)(directPtr - directBase);
+
+	if ( KWLKIT_LIKELY( dist <= avail ) ) {
+		// caller buffer has space for overrun (see PrefetchOutput limits)
+		CopyMatch( directPtr, directPtr - dist, len, dist );
+		directPtr += len;
+		return;
+	}
+
+	// reaches back into dictionary (only near start of direct output)
+	Int srcOfs = avail - dist;
+	while ( len-- > 0 ) {
+		*directPtr++ = srcOfs >= 0 ? directBase[ srcOfs ] :
+			(oneShot ? 0 : dictionary[ (dictIndex + (UInt)srcOfs) & (DICTIONARY_SIZE - 1) ]);
+		srcOfs++;
+	}
+}
+
+// output rep (direct mode near end of one-shot output buffer: no overrun)
+void Inflate::OutRepExact( Int len, Int dist )
+{
+	KWLKIT_ASSERT( oneShot );
+	KWLKIT_ASSERT( len >= 3 && len <= 258 );
+	KWLKIT_ASSERT( dist >= 1 && dist <= WINDOW_SIZE );
+	if ( KWLKIT_UNLIKELY( len > directEnd - directPtr ) ) {
+		directOverflow = 1;
+		len = (Int)(directEnd - directPtr);
+	}
+	// before start of output => zeros (same as initial dictionary)
+	Int srcOfs = (Int)(directPtr - directBase) - dist;
+	while ( len-- > 0 ) {
+		*directPtr++ = srcOfs >= 0 ? directBase[ srcOfs ] : 0;
+		srcOfs++;
+	}
+}
+
+// output rep (marker mode: no overrun, references before markerBase become window markers)
+void Inflate::OutRepMarker( Int len, Int dist )
+{
+	KWLKIT_ASSERT( len >= 3 && len <= 258 );
+	KWLKIT_ASSERT( dist >= 1 && dist <= WINDOW_SIZE );
+	Int srcOfs = (Int)(markerPtr - markerBase) - dist;
+	UShort *dst = markerPtr;
+	markerPtr += len;
+
+	if ( KWLKIT_LIKELY( srcOfs >= 0 ) ) {
+		const UShort *src = markerBase + srcOfs;
+		if ( dist >= len ) {
+			MemCpy( dst, src, (size_t)len * sizeof(UShort) );
+			return;
+		}
 		while ( len-- > 0 ) {
 			*dst++ = *src++;
 		}
@@ -357,21 +634,54 @@ void Inflate::OutRep( Int len, Int dist )
 	}
 
 	while ( len-- > 0 ) {
-		OutByte( dictionary[ ptr++ ] );
-		ptr &= DICTIONARY_SIZE - 1;
+		*dst++ = srcOfs >= 0 ? markerBase[ srcOfs ] : (UShort)(256 + WINDOW_SIZE + srcOfs);
+		srcOfs++;
 	}
 }
 
+// sync direct output: update CRC, size and keep last window in dictionary
+void Inflate::SyncDirect()
+{
+	Int count = (Int)(directPtr - directSync);
+	if ( !count ) {
+		return;
+	}
+	totalOutputSize += count;
+	if ( crcFunction ) {
+		crc = crcFunction( directSync, (size_t)count, crc );
+	}
+	directSync = directPtr;
+	if ( oneShot ) {
+		// whole output buffer serves as window
+		return;
+	}
+	KWLKIT_ASSERT( directBase + count == directPtr );
+	Int keep = Min( count, WINDOW_SIZE );
+	const Byte *src = directPtr - keep;
+	dictIndex += (UInt)(count - keep);
+	dictIndex &= DICTIONARY_SIZE - 1;
+	while ( keep > 0 ) {
+		Int part = Min( keep, DICTIONARY_SIZE - (Int)dictIndex );
+		MemCpy( dictionary.GetData() + dictIndex, src, (size_t)part );
+		src += part;
+		keep -= part;
+		dictIndex += part;
+		dictIndex &= DICTIONARY_SIZE - 1;
+	}
+	dictFlushIndex = dictSyncIndex = dictIndex;
+	directBase = directPtr;
+}
+
 bool Inflate::UncompressedHeader( UInt &len )
 {
 	UInt nlen;
 	if ( !inbit.ReadBits(len, 16) || !inbit.ReadBits(nlen, 16) ) {
 		return 0;
 	}
-	return len == (~nlen & 0xffffu);
+	return trusted || len == (~nlen & 0xffffu);
 }
 
-bool Inflate::CopyBytes( Int len )
+template< Inflate::OutputMode mode > bool Inflate::CopyBytes( Int len )
 {
 	// we'll copy data now!
 	while ( len-- > 0 ) {
@@ -379,112 +689,120 @@ bool Inflate::CopyBytes( Int len )
 		if ( KWLKIT_UNLIKELY( !inbit.ReadByte(b) ) ) {
 			return 0;
 		}
-		OutByte(b);
+		Emit<mode>( b );
 	}
 	return 1;
 }
 
-template< bool fast > Int Inflate::DecodeLen( Int lit )
+template< bool fast > Int Inflate::DecodeValue( UInt entry )
 {
-	Int ilen = lit - 257;
-	Int len = lenBase[ilen];
-	Byte xlen = extraLenBits[ilen];
-	if ( xlen ) {
-		// read extra length bits
-		UInt lenExtra;
-		if ( fast ) {
-			inbit.ReadBitsFast( lenExtra, xlen );
-		} else {
-			if ( KWLKIT_UNLIKELY( !inbit.ReadBits( lenExtra, xlen ) ) ) {
-				return -1;
-			}
-		}
-		len += (Int)lenExtra;
-	}
-	return len;
-}
-
-template< bool fast > Int Inflate::DecodeDist( Int code )
-{
-	KWLKIT_ASSERT( code >= 0 && code < 30 );
-	Int dist = distBase[code];
-	Byte xdist = extraDistBits[code];
-	if ( xdist ) {
-		// read extra dist bits
-		UInt distExtra;
-		if ( fast ) {
-			inbit.ReadBitsFast( distExtra, xdist );
-		} else {
-			if ( KWLKIT_UNLIKELY( !inbit.ReadBits( distExtra, xdist ) ) ) {
-				return -1;
-			}
+	Int value = (Int)(entry & 0xffffu);
+	Byte xbits = (Byte)((entry >> 20) & 15);
+	if ( fast ) {
+		// branchless, bits already in accumulator
+		value += (Int)inbit.PeekAccum( xbits );
+		inbit.PopBitsFast( xbits );
+	} else if ( xbits ) {
+		// read extra bits
+		UInt extra;
+		if ( KWLKIT_UNLIKELY( !inbit.ReadBits( extra, xbits ) ) ) {
+			return -1;
 		}
-		dist += (Int)distExtra;
+		value += (Int)extra;
 	}
-	return dist;
+	return value;
 }
 
-bool Inflate::CompressedBlock( Int &tlen )
+template< Inflate::OutputMode mode > bool Inflate::CompressedBlock( Int &tlen )
 {
+	// maximum command (len+dist) = 48 bits; does it fit after a single refill? (64-bit accumulator)
+	const bool wideRefill = BitStream::FAST_REFILL_BITS >= 48;
 compressedLoop:
-	// maximum command (len+dist) = 48 bits = 6 bytes
-	while ( tlen > 0 && inbit.GetBufferedBytes() >= 6 ) {
-		Int lit;
-		if ( (lit = Decode<0,1>()) < 256 ) {
+	// fast loop: enough buffered input => no bounds checks within a command
+	while ( tlen > 0 && inbit.CanRefillFast() ) {
+		inbit.RefillFast();
+		UInt entry = Decode<0,1>();
+		if ( KWLKIT_LIKELY( entry & HUFFMAN_LITERAL ) ) {
 			// just output literal!
-			OutByte( (Byte)(lit) );
+			Emit<mode>( (Byte)entry );
 			tlen--;
+			if ( wideRefill ) {
+				// enough bits left to decode another literal without refill
+				entry = huf[0].Lookup( inbit.PeekAccum( huf[0].maxBits ) );
+				if ( entry & HUFFMAN_LITERAL ) {
+					inbit.PopBitsFast( (Byte)((entry >> 16) & 15) );
+					Emit<mode>( (Byte)entry );
+					tlen--;
+				}
+			}
 			continue;
 		}
-		if ( KWLKIT_UNLIKELY( lit > 285 ) ) {
-			return 0;
-		}
-		if ( KWLKIT_UNLIKELY( lit == 256 ) ) {
+		if ( KWLKIT_UNLIKELY( entry & (HUFFMAN_END | HUFFMAN_INVALID) ) ) {
+			if ( entry & HUFFMAN_INVALID ) {
+				return 0;
+			}
 			// end of block code
 			state = nextBlockState;
 			return 1;
 		}
 
 		// have rep here!
-		Int len = DecodeLen<1>( lit );
-		Int distCode = Decode<1,1>();
-		if ( KWLKIT_UNLIKELY( distCode >= 30 ) ) {
+		Int len = DecodeValue<1>( entry );
+		if ( !wideRefill ) {
+			inbit.RefillFast();
+		}
+		UInt distEntry = Decode<1,1>();
+		if ( KWLKIT_UNLIKELY( distEntry & HUFFMAN_INVALID ) ) {
 			return 0;
 		}
-		OutRep( len, DecodeDist<1>( distCode ) );
+		if ( !wideRefill ) {
+			inbit.RefillFast();
+		}
+		EmitRep<mode>( len, DecodeValue<1>( distEntry ) );
 		tlen -= len;
 	}
-	while ( tlen > 0 && inbit.GetBufferedBytes() < 6 ) {
-		Int lit;
-		if ( (lit = Decode<0, 0>()) < 256 ) {
+	if ( tlen > 0 && KWLKIT_UNLIKELY( !inbit.CanRefillFast() ) ) {
+		// top up input buffer, slow loop only handles the end of input
+		if ( !inbit.FillBuffer() ) {
+			return 0;
+		}
+		if ( inbit.CanRefillFast() ) {
+			goto compressedLoop;
+		}
+	}
+	while ( tlen > 0 && !inbit.CanRefillFast() ) {
+		// nothing is output until the whole command is decoded => can resume from here in push mode
+		Long cmdBit = inbit.GetBitPosition();
+		UInt entry = Decode<0,0>();
+		if ( KWLKIT_LIKELY( entry & HUFFMAN_LITERAL ) ) {
 			// just output literal!
-			OutByte( (Byte)(lit) );
+			Emit<mode>( (Byte)entry );
 			tlen--;
 			continue;
 		}
-		if ( KWLKIT_UNLIKELY( lit > 285 ) ) {
-			return 0;
-		}
-		if ( KWLKIT_UNLIKELY( lit == 256 ) ) {
+		if ( KWLKIT_UNLIKELY( entry & (HUFFMAN_END | HUFFMAN_INVALID) ) ) {
+			if ( entry & HUFFMAN_INVALID ) {
+				return Suspend( cmdBit );
+			}
 			// end of block code
 			state = nextBlockState;
 			return 1;
 		}
 
 		// have rep here!
-		Int len = DecodeLen<0>( lit );
+		Int len = DecodeValue<0>( entry );
 		if ( KWLKIT_UNLIKELY( len < 0 ) ) {
-			return 0;
+			return Suspend( cmdBit );
 		}
-		Int distCode = Decode<1, 0>();
-		if ( KWLKIT_UNLIKELY( distCode >= 30 ) ) {
-			return 0;
+		UInt distEntry = Decode<1,0>();
+		if ( KWLKIT_UNLIKELY( distEntry & HUFFMAN_INVALID ) ) {
+			return Suspend( cmdBit );
 		}
-		Int dist = DecodeDist<0>( distCode );
+		Int dist = DecodeValue<0>( distEntry );
 		if ( KWLKIT_UNLIKELY( dist < 0 ) ) {
-			return 0;
+			return Suspend( cmdBit );
 		}
-		OutRep( len, dist );
+		EmitRep<mode>( len, dist );
 		tlen -= len;
 	}
 	if ( tlen <= 0 ) {
@@ -498,8 +816,16 @@ bool Inflate::ReadCodeLengths( Byte *clens, UInt count )
 {
 	Byte currentLen = 0;
 	while ( count ) {
-		Int cl = Decode<1, 0>();
-		if ( KWLKIT_UNLIKELY( cl >= 19 ) ) {
+		UInt entry;
+		if ( KWLKIT_LIKELY( inbit.CanRefillFast() ) ) {
+			// code and extra bits (at most 7+7) come straight from accumulator after a single refill
+			inbit.RefillFast();
+			entry = Decode<1, 1>();
+		} else {
+			entry = Decode<1, 0>();
+		}
+		Int cl = (Int)(entry & 0xffffu);
+		if ( KWLKIT_UNLIKELY( (entry & HUFFMAN_INVALID) || cl >= 19 ) ) {
 			return 0;
 		}
 		if ( cl < 16 ) {
@@ -557,6 +883,20 @@ bool Inflate::ReadCodeLengths( Byte *clens, UInt count )
 	return 1;
 }
 
+bool Inflate::IsCompleteCode( const Byte *codeLengths, Int count, bool allowSingle )
+{
+	// Kraft sum in units of 2^-15
+	UInt sum = 0;
+	Int used = 0;
+	for ( Int i=0; i<count; i++ ) {
+		if ( codeLengths[i] ) {
+			sum += 32768u >> codeLengths[i];
+			used++;
+		}
+	}
+	return sum == 32768u || (allowSingle && used <= 1);
+}
+
 bool Inflate::DynamicHeader()
 {
 	UInt hlit, hdist, hclen;
@@ -582,7 +922,7 @@ bool Inflate::DynamicHeader()
 		}
 		clen[ codeOrder[i] ] = (Byte)(tmp & 7);
 	}
-	if ( KWLKIT_UNLIKELY( !BuildHuffman<1>( clen, 19 ) ) ) {
+	if ( KWLKIT_UNLIKELY( !BuildHuffman<1>( clen, 19, Huffman::ALPHABET_PLAIN ) ) ) {
 		return 0;
 	}
 
@@ -594,11 +934,15 @@ bool Inflate::DynamicHeader()
 	if ( KWLKIT_UNLIKELY( !ReadCodeLengths( codeLengths, allCodes ) ) ) {
 		return 0;
 	}
+	if ( strictHeader && (!codeLengths[256] || !IsCompleteCode( codeLengths, hlit + 257, 0 ) ||
+		!IsCompleteCode( codeLengths + hlit + 257, hdist + 1, 1 )) ) {
+		return 0;
+	}
 	// all that remains is to build the codes
-	if ( KWLKIT_UNLIKELY( !BuildHuffman<0>( codeLengths, hlit + 257 ) ) ) {
+	if ( KWLKIT_UNLIKELY( !BuildHuffman<0>( codeLengths, hlit + 257, Huffman::ALPHABET_LITLEN ) ) ) {
 		return 0;
 	}
-	return BuildHuffman<1>( codeLengths + hlit + 257, hdist+1 );
+	return BuildHuffman<1>( codeLengths + hlit + 257, hdist+1, Huffman::ALPHABET_DIST );
 }
 
 inline Int Inflate::GetBufferedBytes() const
@@ -611,29 +955,27 @@ inline Int Inflate::GetBufferedBytes() const
 	return filled;
 }
 
+inline Int Inflate::GetUnsyncedBytes() const
+{
+	return (Int)((dictIndex - dictSyncIndex) & (DICTIONARY_SIZE - 1));
+}
+
 void Inflate::UpdateCrc()
 {
 	// and also total output size so far
-	totalOutputSize += GetBufferedBytes();
-	if ( format == INF_RAW ) {
-		return;
-	}
-	Int delta = (Int)dictIndex - (Int)dictFlushIndex;
-	if ( delta > 0 ) {
-		// no need to split
-		crc = crcFunction( dictionary.GetData() + dictFlushIndex, dictIndex - dictFlushIndex, crc );
+	Int count = GetUnsyncedBytes();
+	UInt start = dictSyncIndex;
+	dictSyncIndex = dictIndex;
+	totalOutputSize += count;
+	if ( !crcFunction || !count ) {
 		return;
 	}
-	if ( KWLKIT_UNLIKELY( !delta ) ) {
-		return;
+	// split in two parts if necessary
+	Int upperPartSize = Min( count, DICTIONARY_SIZE - (Int)start );
+	crc = crcFunction( dictionary.GetData() + start, upperPartSize, crc );
+	if ( count > upperPartSize ) {
+		crc = crcFunction( dictionary.GetData(), count - upperPartSize, crc );
 	}
-	// split in two parts
-	KWLKIT_ASSERT( dictIndex <= dictFlushIndex );
-
-	Int upperPartSize = DICTIONARY_SIZE - (Int)dictFlushIndex;
-
-	crc = crcFunction( dictionary.GetData() + dictFlushIndex, upperPartSize, crc );
-	crc = crcFunction( dictionary.GetData(), dictIndex, crc );
 }
 
 bool Inflate::FinalizeStream()
@@ -643,7 +985,7 @@ bool Inflate::FinalizeStream()
 	}
 	// here we do crc check if necessary
 	if ( format == INF_ZIP ) {
-		return zipCrc == crc;
+		return trusted || zipCrc == crc;
 	}
 	UInt storedCrc;
 	// because we're reading, FlushByte never fails
@@ -654,16 +996,20 @@ bool Inflate::FinalizeStream()
 			return 0;
 		}
 		Endian::FromBig( storedCrc );
-		return storedCrc == crc;
+		return trusted || storedCrc == crc;
 	}
 	KWLKIT_ASSERT( format == INF_GZIP );
-	if ( !inbit.ReadBits32( storedCrc, 32 ) || storedCrc != crc ) {
+	UInt storedSize;
+	if ( !inbit.ReadBits32( storedCrc, 32 ) || !inbit.ReadBits32( storedSize, 32 ) ) {
 		return 0;
 	}
+	if ( trusted ) {
+		// trailer skipped
+		return 1;
+	}
 	// here we can validate file size
-	UInt sizeLo = (UInt)(totalOutputSize & Limits<UInt>::MAX);
-	UInt storedSize;
-	return inbit.ReadBits32( storedSize, 32 ) && sizeLo == storedSize;
+	UInt sizeLo = (UInt)((totalOutputSize - memberOffset) & Limits<UInt>::MAX);
+	return storedCrc == crc && sizeLo == storedSize;
 }
 
 // read ZLib/GZip headers
@@ -788,7 +1134,7 @@ bool Inflate::ReadGZipHeader()
 		if ( !inbit.ReadBits( crcLo, 16 ) ) {
 			return 0;
 		}
-		if ( crcLo != (hcrc & 65535) ) {
+		if ( !trusted && crcLo != (hcrc & 65535) ) {
 			// header CRC mismatch
 			return 0;
 		}
@@ -796,16 +1142,32 @@ bool Inflate::ReadGZipHeader()
 	return 1;
 }
 
-bool Inflate::PrefetchOutput()
+bool Inflate::NextMember()
 {
-	// bytes to fill
-	Int toFill;
-	Int filled = GetBufferedBytes();
-	toFill = DICTIONARY_SIZE - 258 - 1 - filled;	// -1 to avoid overflow
-	if ( toFill <= 0 ) {
-		// ok, we don't need more at the moment
+	// trailer is byte aligned => peek magic; anything else (including trailing garbage) ends the stream
+	UInt magic;
+	if ( !inbit.ReadBits( magic, 16 ) ) {
+		return 0;
+	}
+	inbit.ReturnBitsFast( magic, 16 );
+	if ( magic != 0x8b1fu ) {
+		return 0;
+	}
+	name.Clear();
+	comment.Clear();
+	crc = 0;
+	memberOffset = totalOutputSize;
+	return 1;
+}
+
+template< Inflate::OutputMode mode > bool Inflate::PrefetchOutput( Int toFill )
+{
+	if ( toFill <= 0 || needInput ) {
+		// ok, we don't need more at the moment (or can't produce more until next Feed)
 		return 1;
 	}
+	// input bit position at start of current header (to resume from in push mode)
+	Long unitBit;
 loopstate:
 	switch( state )
 	{
@@ -814,6 +1176,7 @@ loopstate:
 		comment.Clear();
 		unixTime = 0;
 		totalOutputSize = 0;			// Total size of output
+		memberOffset = 0;
 		crc = format == INF_ZLIB;		// Trick to preinitialize adler32 CRC to 1
 		state = INF_STATE_BLOCK_HEADER;
 		if ( format == INF_ZLIB ) {
@@ -823,7 +1186,11 @@ loopstate:
 		}
 		goto loopstate;
 	case INF_STATE_ZLIB_HEADER:
+		unitBit = inbit.GetBitPosition();
 		if ( !ReadZLibHeader() ) {
+			if ( Suspend( unitBit ) ) {
+				break;
+			}
 			// error reading/verifying ZLib header
 			state = INF_STATE_ERROR;
 			return 0;
@@ -831,7 +1198,11 @@ loopstate:
 		state = INF_STATE_BLOCK_HEADER;
 		goto loopstate;
 	case INF_STATE_GZIP_HEADER:
+		unitBit = inbit.GetBitPosition();
 		if ( !ReadGZipHeader() ) {
+			if ( Suspend( unitBit ) ) {
+				break;
+			}
 			// error reading/verifying GZip header
 			state = INF_STATE_ERROR;
 			return 0;
@@ -839,9 +1210,19 @@ loopstate:
 		state = INF_STATE_BLOCK_HEADER;
 		// fall through
 	case INF_STATE_BLOCK_HEADER:
+		if ( KWLKIT_UNLIKELY( totalOutputSize + (mode == OUTPUT_DICTIONARY ? GetUnsyncedBytes() :
+			mode == OUTPUT_MARKER ? 0 : (Int)(directPtr - directSync)) >= checkpointAt ||
+			inbit.GetBitPosition() >= stopBit ) ) {
+			// pause at block boundary (building index, speculative decoding)
+			break;
+		}
 		{
+			unitBit = inbit.GetBitPosition();
 			UInt bfinal;
 			if ( !inbit.ReadBits(bfinal, 3) ) {
+				if ( Suspend( unitBit ) ) {
+					break;
+				}
 				state = INF_STATE_ERROR;
 				return 0;
 			}
@@ -858,14 +1239,16 @@ loopstate:
 				goto loopstate;
 			case 1:
 				// fixed Huffman
-				BuildFixedLitLenHuffman();
-				BuildFixedDistHuffman();
+				SetFixedHuffman();
 				state = INF_STATE_COMPRESSED;
 				// fall through to next state
 				break;
 			case 2:
 				// dynamic Huffman
 				if ( !DynamicHeader() ) {
+					if ( Suspend( unitBit ) ) {
+						goto suspended;
+					}
 					state = INF_STATE_ERROR;
 					return 0;
 				}
@@ -880,18 +1263,25 @@ loopstate:
 		}
 	case INF_STATE_COMPRESSED:
 		// must follow INF_STATE_BLOCK_HEADER
-		if ( !CompressedBlock( toFill ) ) {
-			// failed to read input stream
-			state = INF_STATE_ERROR;
-			return 0;
+		{
+			KWLKIT_PROFILE_SCOPE( profile, PROFILE_COMPRESSED_BLOCK );
+			if ( !CompressedBlock<mode>( toFill ) ) {
+				// failed to read input stream
+				state = INF_STATE_ERROR;
+				return 0;
+			}
 		}
-		if ( toFill > 0 ) {
+		if ( toFill > 0 && !needInput ) {
 			goto loopstate;
 		}
 		// we don't need more at the moment => done for now
 		break;
 	case INF_STATE_UNCOMPRESSED_HEADER:
+		unitBit = inbit.GetBitPosition();
 		if ( !UncompressedHeader(uncLen) ) {
+			if ( Suspend( unitBit ) ) {
+				break;
+			}
 			// invalid header
 			state = INF_STATE_ERROR;
 			return 0;
@@ -901,7 +1291,13 @@ loopstate:
 	case INF_STATE_UNCOMPRESSED:
 		{
 			Int loopLen = Min( toFill, (Int)uncLen );
-			if ( !CopyBytes( loopLen ) ) {
+			Int avail = GetPushAvailable();
+			if ( avail < loopLen ) {
+				// copy what we have and wait for the rest
+				loopLen = avail;
+				needInput = 1;
+			}
+			if ( !CopyBytes<mode>( loopLen ) ) {
 				// failed to read input stream
 				state = INF_STATE_ERROR;
 				return 0;
@@ -911,19 +1307,45 @@ loopstate:
 			if ( !uncLen ) {
 				state = nextBlockState;
 			}
-			if ( toFill > 0 ) {
+			if ( toFill > 0 && !needInput ) {
 				goto loopstate;
 			}
 			// we don't need more at the moment => done for now
 			break;
 		}
 	case INF_STATE_EOS_FINALIZE:
+		if ( mode == OUTPUT_DIRECT || mode == OUTPUT_DIRECT_EXACT ) {
+			SyncDirect();
+		}
 		UpdateCrc();
+		unitBit = inbit.GetBitPosition();
 		if ( !FinalizeStream() ) {
+			if ( Suspend( unitBit ) ) {
+				break;
+			}
 			// CRC failure
 			state = INF_STATE_ERROR;
 			return 0;
 		}
+		if ( format != INF_GZIP || !multiMember ) {
+			state = INF_STATE_EOS;
+			return 1;
+		}
+		state = INF_STATE_NEXT_MEMBER;
+		// fall through
+	case INF_STATE_NEXT_MEMBER:
+		unitBit = inbit.GetBitPosition();
+		if ( NextMember() ) {
+			// another GZip member follows
+			state = INF_STATE_GZIP_HEADER;
+			if ( toFill > 0 ) {
+				goto loopstate;
+			}
+			break;
+		}
+		if ( Suspend( unitBit ) ) {
+			break;
+		}
 		state = INF_STATE_EOS;
 		// fall through
 	case INF_STATE_EOS:
@@ -932,7 +1354,11 @@ loopstate:
 		// invalid case
 		return 0;
 	}
+suspended:
 	// here we should update CRC if needed rather than in Flush which may never get called due to Read!
+	if ( mode == OUTPUT_DIRECT || mode == OUTPUT_DIRECT_EXACT ) {
+		SyncDirect();
+	}
 	UpdateCrc();
 	return 1;
 }
@@ -945,14 +1371,27 @@ void Inflate::ResetState()
 	unixTime = 0;
 	state = INF_STATE_BEGIN;
 	nextBlockState = INF_STATE_ERROR;
-	dictionary.Resize( DICTIONARY_SIZE );
-	dictionary.Fill(0);
-	dictIndex = dictFlushIndex = 0;
+	needInput = 0;
+	if ( !oneShot ) {
+		dictionary.Resize( DICTIONARY_SIZE + DICTIONARY_PAD );
+		dictionary.MemSet( 0 );
+	}
+	dictIndex = dictFlushIndex = dictSyncIndex = 0;
+	memberOffset = 0;
+	directBase = directSync = directPtr = directEnd = 0;
+	directOverflow = 0;
+	markerBase = markerPtr = 0;
 }
 
 bool Inflate::Rewind()
 {
 	ResetState();
+	if ( pushMode ) {
+		// start over, expecting input from the beginning
+		pushEnd = 0;
+		pushBuffer.Clear();
+		return inbit.SetMemory( 0, 0 );
+	}
 	if ( !input ) {
 		return 1;
 	}
@@ -962,13 +1401,104 @@ bool Inflate::Rewind()
 	return input->Rewind();
 }
 
+Long Inflate::GetPosition() const
+{
+	return totalOutputSize - GetBufferedBytes();
+}
+
+bool Inflate::Restore( Long bitPos, const Byte *window, Int wsize, Long outOffset, Long nmemberOffset, UInt ncrc )
+{
+	KWLKIT_ASSERT( !oneShot && wsize >= 0 && wsize <= WINDOW_SIZE );
+	// keep GZip header info
+	UInt time = unixTime;
+	ResetState();
+	unixTime = time;
+	if ( KWLKIT_UNLIKELY( !inbit.SeekBits( bitPos ) ) ) {
+		state = INF_STATE_ERROR;
+		return 0;
+	}
+	SetWindow( window, wsize );
+	totalOutputSize = outOffset;
+	memberOffset = nmemberOffset;
+	crc = ncrc;
+	state = INF_STATE_BLOCK_HEADER;
+	return 1;
+}
+
+bool Inflate::RestoreCheckpoint( const InflateIndex &index, Int checkpoint )
+{
+	const InflateIndex::Checkpoint &cp = index.GetCheckpoint( checkpoint );
+	return Restore( cp.inBitOffset, cp.window.GetData(), cp.window.GetSize(), cp.outOffset, cp.memberOffset, cp.crc );
+}
+
+void Inflate::SetWindow( const Byte *window, Int wsize )
+{
+	KWLKIT_ASSERT( !oneShot && wsize >= 0 && wsize <= WINDOW_SIZE );
+	// window goes right before dictIndex
+	if ( wsize > 0 ) {
+		MemCpy( dictionary.GetData(), window, (size_t)wsize );
+	}
+	dictIndex = dictFlushIndex = dictSyncIndex = (UInt)wsize;
+}
+
+void Inflate::CopyWindow( Byte *dst, Int wsize ) const
+{
+	KWLKIT_ASSERT( wsize >= 0 && wsize <= WINDOW_SIZE );
+	UInt src = (dictIndex - (UInt)wsize) & (DICTIONARY_SIZE - 1);
+	Int ofs = 0;
+	while ( ofs < wsize ) {
+		Int part = Min( wsize - ofs, DICTIONARY_SIZE - (Int)src );
+		MemCpy( dst + ofs, dictionary.GetData() + src, (size_t)part );
+		ofs += part;
+		src = (src + (UInt)part) & (DICTIONARY_SIZE - 1);
+	}
+}
+
+bool Inflate::Seek( Long pos, const InflateIndex *index )
+{
+	KWLKIT_ASSERT( pos >= 0 && !oneShot );
+	KWLKIT_ASSERT( !index || index->GetFormat() == format );
+	Long cur = GetPosition();
+	bool restart = state == INF_STATE_ERROR || pos < cur;
+	Int cp = index ? index->Find( pos ) : -1;
+	if ( cp >= 0 && (restart || index->GetCheckpoint( cp ).outOffset > cur) ) {
+		if ( !RestoreCheckpoint( *index, cp ) ) {
+			return 0;
+		}
+	} else if ( restart && !Rewind() ) {
+		return 0;
+	}
+	// decode forward, skipping buffered output
+	Long skip = pos - GetPosition();
+	KWLKIT_ASSERT( skip >= 0 );
+	while ( skip > 0 ) {
+		Int filled = GetBufferedBytes();
+		if ( !filled ) {
+			if ( KWLKIT_UNLIKELY( !PrefetchOutput<OUTPUT_DICTIONARY>( DICTIONARY_SIZE - 258 - 1 - DICTIONARY_PAD ) ) ) {
+				return 0;
+			}
+			filled = GetBufferedBytes();
+			if ( !filled ) {
+				// past end of stream
+				return 0;
+			}
+		}
+		Int part = (Int)Min( skip, (Long)filled );
+		dictFlushIndex += part;
+		dictFlushIndex &= DICTIONARY_SIZE - 1;
+		skip -= part;
+	}
+	return 1;
+}
+
 // read uncompressed bytes
 bool Inflate::Read( void *buf, Int count, Int &nread )
 {
 	KWLKIT_ASSERT( buf && count >= 0 );
+	KWLKIT_PROFILE_SCOPE( profile, PROFILE_INFLATE );
 	nread = 0;
 	Byte *b = static_cast<Byte *>(buf);
-	do {
+	for (;;) {
 		Int filled = GetBufferedBytes();
 		Int toCopy = Min( count, filled );
 		nread += toCopy;
@@ -989,15 +1519,254 @@ bool Inflate::Read( void *buf, Int count, Int &nread )
 			break;
 		}
 		KWLKIT_ASSERT( dictIndex == dictFlushIndex );
-		if ( KWLKIT_UNLIKELY( !PrefetchOutput() ) ) {
+		if ( count >= DIRECT_MIN_OUTPUT ) {
+			// large request: decode straight into caller buffer, leaving enough space for match copy overrun
+			Int ndirect;
+			bool res = DecodeDirect( b, count - 258 - 1 - DICTIONARY_PAD, ndirect );
+			if ( KWLKIT_UNLIKELY( !res ) ) {
+				return 0;
+			}
+			nread += ndirect;
+			count -= ndirect;
+			b += ndirect;
+			if ( ndirect > 0 ) {
+				continue;
+			}
+		}
+		if ( KWLKIT_UNLIKELY( !PrefetchOutput<OUTPUT_DICTIONARY>( DICTIONARY_SIZE - 258 - 1 - DICTIONARY_PAD ) ) ) {
 			return 0;
 		}
-	} while ( dictIndex != dictFlushIndex );
+		if ( dictIndex == dictFlushIndex ) {
+			break;
+		}
+	}
 	return state != INF_STATE_ERROR;
 }
 
+bool Inflate::Feed( const void *data, Int size )
+{
+	KWLKIT_ASSERT( (data || !size) && size >= 0 );
+	Long bitPos = 0;
+	if ( pushMode ) {
+		bitPos = inbit.GetBitPosition();
+	} else {
+		pushMode = 1;
+		pushBuffer.Clear();
+	}
+	Int consumed = (Int)(bitPos >> 3);
+	Int left = pushBuffer.GetSize() - consumed;
+	if ( consumed > 0 && consumed >= left ) {
+		// drop consumed input (amortized, so that feeding small chunks doesn't move data over and over)
+		if ( left > 0 ) {
+			MemMove( pushBuffer.GetData(), pushBuffer.GetData() + consumed, left );
+		}
+		pushBuffer.Resize( left );
+		bitPos &= 7;
+	}
+	if ( size > 0 ) {
+		Int offset = pushBuffer.GetSize();
+		pushBuffer.Resize( offset + size );
+		MemCpy( pushBuffer.GetData() + offset, data, size );
+	}
+	needInput = 0;
+	if ( pushBuffer.IsEmpty() ) {
+		return inbit.SetMemory( 0, 0 );
+	}
+	return inbit.SetMemory( pushBuffer.GetData(), pushBuffer.GetSize() ) && inbit.SeekBits( bitPos );
+}
+
+void Inflate::EndInput()
+{
+	pushEnd = 1;
+	needInput = 0;
+}
+
+bool Inflate::Suspend( Long bitPos )
+{
+	if ( !pushMode || pushEnd || inbit.GetBufferedBytes() ) {
+		// not out of input => real error
+		return 0;
+	}
+	needInput = inbit.SeekBits( bitPos );
+	return needInput;
+}
+
+Int Inflate::GetPushAvailable() const
+{
+	if ( !pushMode || pushEnd ) {
+		return Limits<Int>::MAX;
+	}
+	return (Int)(((Long)pushBuffer.GetSize()*8 - inbit.GetBitPosition()) >> 3);
+}
+
 bool Inflate::Close() {
 	return inbit.Close(1);
 }
 
+// one-shot decode into directBase..directEnd
+bool Inflate::DecodeBuffer()
+{
+	// bulk: decode with match copy overrun as long as there's enough space left
+	Int cap = (Int)(directEnd - directBase);
+	if ( KWLKIT_UNLIKELY( !PrefetchOutput<OUTPUT_DIRECT>( cap - 258 - 1 - DICTIONARY_PAD ) ) ) {
+		return 0;
+	}
+	// tail: exact output until end of stream, +1 to detect streams that don't fit
+	if ( KWLKIT_UNLIKELY( !PrefetchOutput<OUTPUT_DIRECT_EXACT>( (Int)(directEnd - directPtr) + 1 ) ) ) {
+		return 0;
+	}
+	return !directOverflow && state == INF_STATE_EOS;
+}
+
+bool Inflate::DecodeDirect( Byte *dst, Int toFill, Int &count )
+{
+	directBase = directSync = directPtr = dst;
+	bool res = PrefetchOutput<OUTPUT_DIRECT>( toFill );
+	count = (Int)(directPtr - dst);
+	directBase = directSync = directPtr = 0;
+	return res;
+}
+
+bool Inflate::DecodeMarkers( Int toFill )
+{
+	return PrefetchOutput<OUTPUT_MARKER>( toFill );
+}
+
+bool InflateBuffer( const void *src, size_t srcLen, void *dst, size_t dstCap, InflateFormat fmt, size_t *outSize,
+	UInt zipCrc, size_t *inSize )
+{
+	UInt tables[ Inflate::HUFFMAN_LITLEN_ENOUGH + Inflate::HUFFMAN_DIST_ENOUGH ];
+	Inflate inf( tables );
+	inf.SetFormat( fmt );
+	inf.SetZipCrc( zipCrc );
+	return inf.DecodeOneShot( src, srcLen, dst, dstCap, outSize, inSize );
+}
+
+bool Inflate::DecodeOneShot( const void *src, size_t srcLen, void *dst, size_t dstCap, size_t *outSize,
+	size_t *inSize )
+{
+	KWLKIT_ASSERT( oneShot );
+	if ( outSize ) {
+		*outSize = 0;
+	}
+	if ( inSize ) {
+		*inSize = 0;
+	}
+	if ( KWLKIT_UNLIKELY( (!src && srcLen) || (!dst && dstCap) ||
+		srcLen > (size_t)Limits<Int>::MAX || dstCap >= (size_t)Limits<Int>::MAX ) ) {
+		return 0;
+	}
+	// one-shot reset is cheap (no dictionary)
+	ResetState();
+	inbit.SetMemory( src, (Int)srcLen );
+	directBase = directSync = directPtr = static_cast<Byte *>(dst);
+	directEnd = directBase + dstCap;
+	bool res = DecodeBuffer();
+	if ( outSize ) {
+		*outSize = (size_t)(directPtr - directBase);
+	}
+	if ( inSize ) {
+		*inSize = (size_t)((inbit.GetBitPosition() + 7) >> 3);
+	}
+	return res;
+}
+
+// batch task: contiguous range of batch items
+struct InflateBatchTask
+{
+	InflateBatchItem *items;
+	Int count;
+	InflateFormat format;
+	Mutex *mutex;
+	CondVar *done;
+	Int *pending;
+	bool ok;
+};
+
+bool Inflate::DecodeBatch( InflateBatchItem *items, Int count, InflateFormat fmt )
+{
+	// one context for the whole range
+	UInt tables[ HUFFMAN_LITLEN_ENOUGH + HUFFMAN_DIST_ENOUGH ];
+	Inflate inf( tables );
+	inf.SetFormat( fmt );
+	bool ok = 1;
+	for ( Int i=0; i<count; i++ ) {
+		InflateBatchItem &item = items[i];
+		inf.SetZipCrc( item.zipCrc );
+		item.ok = inf.DecodeOneShot( item.src, item.srcLen, item.dst, item.dstCap, &item.outSize, 0 );
+		ok &= item.ok;
+	}
+	return ok;
+}
+
+void Inflate::BatchWorker( void *param )
+{
+	InflateBatchTask *t = static_cast<InflateBatchTask *>(param);
+	bool ok = DecodeBatch( t->items, t->count, t->format );
+	MutexLock lock( *t->mutex );
+	t->ok = ok;
+	if ( !--*t->pending ) {
+		t->done->Broadcast();
+	}
+}
+
+bool InflateBatch( InflateBatchItem *items, Int count, InflateFormat fmt, ThreadPool *pool )
+{
+	KWLKIT_ASSERT( count >= 0 && (items || !count) );
+	if ( !count ) {
+		return 1;
+	}
+	if ( !pool || pool->GetThreadCount() < 1 ) {
+		return Inflate::DecodeBatch( items, count, fmt );
+	}
+
+	// group items into tasks so that tiny items don't pay per-task overhead, but keep enough tasks
+	// per thread to balance the load
+	Long total = 0;
+	for ( Int i=0; i<count; i++ ) {
+		total += (Long)items[i].srcLen + Inflate::BATCH_ITEM_COST;
+	}
+	Long taskLimit = Min( Inflate::MAX_BATCH_TASK_SIZE, total / (4 * (Long)pool->GetThreadCount()) );
+
+	Mutex mutex;
+	CondVar done;
+	Int pending = 0;
+	Array< InflateBatchTask > tasks;
+	Long taskSize = 0;
+	Int start = 0;
+	for ( Int i=0; i<count; i++ ) {
+		taskSize += (Long)items[i].srcLen + Inflate::BATCH_ITEM_COST;
+		if ( taskSize < taskLimit && i+1 < count ) {
+			continue;
+		}
+		InflateBatchTask t;
+		t.items = items + start;
+		t.count = i+1 - start;
+		t.format = fmt;
+		t.mutex = &mutex;
+		t.done = &done;
+		t.pending = &pending;
+		t.ok = 0;
+		tasks.Add( t );
+		start = i+1;
+		taskSize = 0;
+	}
+
+	// tasks array must not be touched until all tasks are done
+	pending = tasks.GetSize();
+	for ( Int i=0; i<tasks.GetSize(); i++ ) {
+		pool->Submit( Inflate::BatchWorker, &tasks[i] );
+	}
+
+	bool ok = 1;
+	MutexLock lock( mutex );
+	while ( pending ) {
+		done.Wait( mutex );
+	}
+	for ( Int i=0; i<tasks.GetSize(); i++ ) {
+		ok &= tasks[i].ok;
+	}
+	return ok;
+}
+
 }
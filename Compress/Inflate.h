@@ -14,6 +14,11 @@
 namespace KwlKit
 {
 
+class InflateIndex;
+class SpeculativeInflate;
+class Deflate;
+class ThreadPool;
+
 // Inflate algorithm...
 
 enum InflateFormat
@@ -24,16 +29,55 @@ enum InflateFormat
 	INF_GZIP,				// GZip stream
 };
 
+// one-shot decode of a complete compressed buffer (no allocations, Huffman tables live on stack ~36k)
+// fails if decompressed data doesn't fit into dstCap bytes (bytes up to dstCap may be overwritten)
+// outSize (optional) receives number of decompressed bytes, zipCrc is used to verify INF_ZIP streams
+// inSize (optional) receives number of compressed bytes consumed
+bool InflateBuffer( const void *src, size_t srcLen, void *dst, size_t dstCap, InflateFormat fmt = INF_RAW,
+	size_t *outSize = 0, UInt zipCrc = 0, size_t *inSize = 0 );
+
+// single buffer for InflateBatch
+struct InflateBatchItem
+{
+	const void *src;
+	size_t srcLen;
+	void *dst;
+	size_t dstCap;
+	UInt zipCrc;			// INF_ZIP only
+	// results
+	size_t outSize;
+	bool ok;
+};
+
+// decode many small independent buffers (like InflateBuffer), reusing one decoder context per thread
+// (no allocations or setup per item)
+// pool = spread items over pool threads (null = decode on calling thread)
+// returns 1 if all items were decoded successfully
+bool InflateBatch( InflateBatchItem *items, Int count, InflateFormat fmt = INF_RAW, ThreadPool *pool = 0 );
+
 class Inflate
 {
+	friend bool InflateBuffer( const void *src, size_t srcLen, void *dst, size_t dstCap, InflateFormat fmt,
+		size_t *outSize, UInt zipCrc, size_t *inSize );
+	friend bool InflateBatch( InflateBatchItem *items, Int count, InflateFormat fmt, ThreadPool *pool );
+	friend class InflateIndex;
+	friend class SpeculativeInflate;
+	friend class Deflate;
 public:
 	Inflate();
 	explicit Inflate( Stream &sin );
 
 	// if supportRewind is true, remember stream position for rewinding
 	bool SetInput( Stream &sin );
+	// start over on new input (format, trusted/push mode etc. back to defaults), reusing all storage
+	// (no allocations after first use); previous input stream is only detached (may be destroyed already)
+	bool Reset( Stream &sin, InflateFormat fmt = INF_RAW );
 	bool SetFormat( InflateFormat fmt = INF_RAW );
 
+	inline InflateFormat GetFormat() const {
+		return format;
+	}
+
 	// get input bit stream
 	inline BitStream &GetStream() {
 		return inbit;
@@ -49,7 +93,7 @@ public:
 		return totalOutputSize;
 	}
 
-	// get GZip name
+	// get GZip name (of current member)
 	inline const String &GetName() const {
 		return name;
 	}
@@ -69,13 +113,67 @@ public:
 		zipCrc = zcrc;
 	}
 
+	inline UInt GetZipCrc() const {
+		return zipCrc;
+	}
+
+	// trusted input (assets we produced ourselves): skip Adler-32/CRC-32 computation and verification
+	// and redundant header checks (stored block length complement, GZip header CRC)
+	// corrupt input may then decode to garbage without an error, but never reads/writes out of bounds
+	// call before decoding
+	void SetTrusted( bool enable );
+
+	inline bool IsTrusted() const {
+		return trusted;
+	}
+
+	// GZip: continue with next member at end of member (concatenated .gz files), enabled by default
+	// data following last member that doesn't start with GZip magic is ignored
+	void SetMultiMember( bool enable ) {
+		multiMember = enable;
+	}
+
+	// set profiling stats sink (can be null), only used if KWLKIT_PROFILE is enabled
+	void SetProfileStats( ProfileStats *stats ) {
+		profile = stats;
+		inbit.SetProfileStats( stats );
+	}
+
 	// read uncompressed bytes
 	// note: read (obviously) ignores outLimit
+	// large reads decode directly into buf (which then also serves as back-reference window);
+	// note that bytes past nread (up to count) may be overwritten in that case
 	bool Read( void *buf, Int count, Int &nread );
 
 	// rewind
 	bool Rewind();
 
+	// get current (uncompressed) read position
+	Long GetPosition() const;
+
+	// seek to uncompressed position: restores nearest checkpoint from index (if any, must be built
+	// for the same stream and format) or rewinds, then decodes forward
+	// seeking forward past current position without a closer checkpoint just decodes forward
+	// input stream must support Seek (default Stream::Seek rewinds and skips)
+	// note: GZip name/comment are only available if the header has been read before
+	bool Seek( Long pos, const InflateIndex *index = 0 );
+
+	// push mode (non-blocking input): Feed compressed data as it arrives and Drain output
+	// the first Feed switches to push mode (input stream is ignored from then on); decoding suspends
+	// whenever fed input runs out (even in the middle of a block or header) and resumes on next Feed
+	// unconsumed input is kept internally, so the caller's buffer can be reused right after Feed
+	bool Feed( const void *data, Int size );
+	// no more input will follow => truncated stream is an error from now on
+	void EndInput();
+	// decode as much as fed input allows; nread < cap and !IsEof() => NeedsInput()
+	inline bool Drain( void *buf, Int cap, Int &nread ) {
+		return Read( buf, cap, nread );
+	}
+	// decoding suspended until next Feed
+	inline bool NeedsInput() const {
+		return needInput;
+	}
+
 	// close
 	bool Close();
 private:
@@ -89,32 +187,84 @@ private:
 		INF_STATE_UNCOMPRESSED_HEADER,			// uncompressed block header
 		INF_STATE_UNCOMPRESSED,					// within uncompressed block
 		INF_STATE_EOS_FINALIZE,					// finalize
+		INF_STATE_NEXT_MEMBER,					// check for next GZip member
 		INF_STATE_EOS,							// end of stream reached - no more data for us
 		INF_STATE_ERROR							// an error occurred
 	};
 
 	Stream *input;
 	BitStream inbit;
+	ProfileStats *profile;
 	static const Byte extraLenBits[29];	// [code-257]
 	static const UShort lenBase[29];
 	static const Byte extraDistBits[30];	// [code]
 	static const UShort distBase[30];
 	static const Byte codeOrder[19];
+	static const UInt fixedLitLenTable[512];
+	static const UInt fixedDistTable[32];
 
 	// current decoder state
 	InflateState state;
 	// state to switch to when current block is finished
 	InflateState nextBlockState;
 
-	// sliding dictionary buffer, most likely a local separate 32K circular buffer
+	// sliding dictionary buffer, 64K circular buffer holding the 32K window plus buffered output
+	// (followed by DICTIONARY_PAD bytes so that match copies may overrun)
 	Array< Byte > dictionary;
 	// cyclic index
 	UInt dictIndex;
 	// cyclic flush index
 	UInt dictFlushIndex;
+	// cyclic index up to which CRC and output size are up to date
+	UInt dictSyncIndex;
+
+	// direct output mode (decoding straight into caller buffer), null if not active
+	// dictIndex corresponds to directBase
+	Byte *directBase;		// start of direct output (back-references before it go to dictionary)
+	Byte *directSync;		// start of direct output not synced yet (CRC, size)
+	Byte *directPtr;		// current direct output pointer
+	Byte *directEnd;		// end of output buffer (one-shot mode only)
+	bool directOverflow;	// one-shot output didn't fit
+
+	// Huffman table storage (caller-provided in one-shot mode)
+	Array< UInt > hufStorage;
+	UInt *hufTables;
+	// one-shot mode: reading from memory and writing to a single output buffer, no dictionary
+	bool oneShot;
+
+	enum OutputMode
+	{
+		OUTPUT_DICTIONARY,		// circular dictionary
+		OUTPUT_DIRECT,			// caller buffer (with enough space for match copy overrun)
+		OUTPUT_DIRECT_EXACT,	// caller buffer, bounds checked (one-shot mode only)
+		OUTPUT_MARKER			// 16-bit buffer, unknown window => markers (speculative decoding only)
+	};
+
+	// marker output: values < 256 are literals, 256 + i refers to byte i of the (unknown) WINDOW_SIZE window
+	// preceding markerBase
+	UShort *markerBase;
+	UShort *markerPtr;
+
+	// one-shot mode constructor (tables = HUFFMAN_LITLEN_ENOUGH + HUFFMAN_DIST_ENOUGH entries)
+	explicit Inflate( UInt *tables );
+	// one-shot decode into directBase..directEnd
+	bool DecodeBuffer();
+	// reset and decode whole src into dst (one-shot mode), outSize/inSize can be null
+	bool DecodeOneShot( const void *src, size_t srcLen, void *dst, size_t dstCap, size_t *outSize, size_t *inSize );
+	// decode a range of InflateBatch items
+	static bool DecodeBatch( InflateBatchItem *items, Int count, InflateFormat fmt );
+	static void BatchWorker( void *param );
+	// decode roughly toFill bytes straight into dst (needs room for toFill + 258 + 1 + DICTIONARY_PAD bytes)
+	bool DecodeDirect( Byte *dst, Int toFill, Int &count );
+	// decode into markerBase..markerPtr (roughly toFill entries, see PrefetchOutput)
+	bool DecodeMarkers( Int toFill );
 
 	// limit output to this
 	Long outLimit;
+	// pause at first block boundary at or past this output position (used to build InflateIndex)
+	Long checkpointAt;
+	// pause at first block boundary at or past this input bit position (speculative decoding)
+	Long stopBit;
 
 	// total output size
 	Long totalOutputSize;
@@ -123,77 +273,106 @@ private:
 	inline void OutByte( Byte b );
 	// output rep
 	void OutRep( Int len, Int dist );
+	// output rep (direct mode)
+	void OutRepDirect( Int len, Int dist );
+	// output rep (direct mode, bounds checked)
+	void OutRepExact( Int len, Int dist );
+	// output rep (marker mode)
+	void OutRepMarker( Int len, Int dist );
+	// output to dictionary or directly to caller buffer
+	template< OutputMode mode > inline void Emit( Byte b );
+	template< OutputMode mode > inline void EmitRep( Int len, Int dist );
+	// sync direct output: update CRC, size and keep last window in dictionary
+	void SyncDirect();
 
 	// handle uncompressed block header
 	bool UncompressedHeader( UInt &len );
 	// copy uncompressed bytes
-	bool CopyBytes( Int len );
+	template< OutputMode mode > bool CopyBytes( Int len );
 	// reads code lengths
 	bool ReadCodeLengths( Byte *clens, UInt count );
 	// dynamic Huffman header (reads clen Huffman)
 	bool DynamicHeader();
+	// reject dynamic headers zlib would reject (incomplete codes, no end of block code), used to filter out
+	// false block matches in speculative decoding
+	bool strictHeader;
+	static bool IsCompleteCode( const Byte *codeLengths, Int count, bool allowSingle );
 	// initialize
 	void Init();
 
 	// get number of buffered bytes that can be read
 	inline Int GetBufferedBytes() const;
-	// produce as much buffered output as fits in dictionary
-	bool PrefetchOutput();
+	// get number of dictionary bytes not included in CRC/output size yet
+	inline Int GetUnsyncedBytes() const;
+	// produce (roughly) toFill bytes of output, may overshoot by up to 258 bytes
+	// mode = where to put output (OutputMode)
+	template< OutputMode mode > bool PrefetchOutput( Int toFill );
 	// finalize stream: handles CRC check if necessary
 	bool FinalizeStream();
 
-	// decode length from lit/len code
-	template< bool fast > Int DecodeLen( Int lit );
-	// decode distance from dist code
-	template< bool fast > Int DecodeDist( Int code );
+	// decode final match length/distance from table entry (base + extra bits), returns -1 on error
+	template< bool fast > Int DecodeValue( UInt entry );
 
 	class Huffman
 	{
 	public:
-		struct Code
-		{
-			UShort code;		// code
-			Byte len;			// length
-			Byte count;		// (if first code: count-1 repcodes of same length)
-		};
-		struct Node
+		// symbol interpretation (baked into table entries)
+		enum Alphabet
 		{
-			Int leaf;			// decoded code (symbol), -1 => no leaf
-			Short nodes[2];	// left[0]/right[1]
+			ALPHABET_PLAIN,		// entry value = symbol (code lengths)
+			ALPHABET_LITLEN,	// literal, end of block or match length base + extra bits
+			ALPHABET_DIST		// distance base + extra bits
 		};
 
-		Array< Code > codes;	// indexed directly by values!
-		Array< Node > nodes;
-		// direct LUT size is 2048 entries (could be less or more)
-		// direct LUT: >= 0 => code, -1 => invalid
-		Array< Short >
-			directLut;
-		Byte maxBits;			// maximum bits (=longest code, clamped to max LUT bits)
-
-		void Init( Int maxCodes );
-		bool AddNode( UInt code, Int len, Int sym );
-
-		bool Reconstruct( const Byte *codeLengths, Int count );
+		// two-level decode table: primary table indexed by tableBits (LSBit first) input bits,
+		// codes longer than that link to a secondary sub-table indexed by the following bits
+		// entry: bits 0-15 = value (symbol, literal, length/distance base or sub-table offset for links),
+		// bits 16-19 = code length to consume, bits 20-23 = extra bits, bits 24-26 = sub-table index bits,
+		// bits 28-31 = flags (HUFFMAN_INVALID, HUFFMAN_END, HUFFMAN_LITERAL, HUFFMAN_LINK)
+		const UInt *table;		// current table (storage or static fixed table)
+		UInt *storage;			// owned by Inflate
+		Int capacity;			// storage capacity (entries)
+		Byte maxBits;			// maximum bits (=longest code)
+		Byte tableBits;			// primary table bits (=longest code, clamped to max LUT bits)
+
+		void Init( UInt *nstorage, Int ncapacity );
+		// use precomputed table
+		void SetFixed( const UInt *ntable, Byte bits );
+
+		bool Reconstruct( const Byte *codeLengths, Int count, Alphabet alphabet );
+
+		// look up entry for (possibly partial) LSBit first code
+		inline UInt Lookup( UInt bits ) const;
 	};
 
 	Huffman huf[2];			// literal/length, distance/code (reused)
 
-	// decode Huffman value from stream, returns max int on error
-	template< Byte hidx, bool fast > Int Decode();
+	// decode Huffman table entry from stream, returns HUFFMAN_INVALID entry on error
+	template< Byte hidx, bool fast > UInt Decode();
 
-	template< Byte hidx> bool BuildHuffman(const Byte *codeLengths, Int count );
-	void BuildFixedLitLenHuffman();
-	void BuildFixedDistHuffman();
+	template< Byte hidx> bool BuildHuffman(const Byte *codeLengths, Int count, Huffman::Alphabet alphabet );
+	// get table entry for symbol (without code length)
+	static UInt GetSymbolEntry( Int sym, Huffman::Alphabet alphabet );
+	// use precomputed fixed Huffman tables
+	void SetFixedHuffman();
 
 	// handle compressed block (common)
 	// len = number of output bytes to decompress
-	bool CompressedBlock( Int &len );
+	template< OutputMode mode > bool CompressedBlock( Int &len );
 	// flush output buffer
 	bool Flush();
 	// update CRC on unpacked dictionary data
 	void UpdateCrc();
 	// reset state (necessary for Rewind)
 	void ResetState();
+	// restore decoder state at block boundary (window = wsize bytes preceding outOffset)
+	bool Restore( Long bitPos, const Byte *window, Int wsize, Long outOffset, Long nmemberOffset, UInt ncrc );
+	// restore decoder state from index checkpoint
+	bool RestoreCheckpoint( const InflateIndex &index, Int checkpoint );
+	// set window preceding current output position (doesn't flush anything)
+	void SetWindow( const Byte *window, Int wsize );
+	// copy last wsize bytes of output (at most WINDOW_SIZE) from dictionary
+	void CopyWindow( Byte *dst, Int wsize ) const;
 
 	// state processing
 	UInt uncLen;		// uncompressed block length in bytes
@@ -202,11 +381,34 @@ private:
 	InflateFormat format;
 	UInt crc;			// pending CRC
 	UInt zipCrc;		// stored zip CRC (for verification, INF_ZIP format only)
+	// null = no checksum (raw or trusted)
 	UInt (*crcFunction)( const void *buf, size_t len, UInt chsum );
+	// skip checksums and redundant validation
+	bool trusted;
 	// GZip name/comment/time (Unix)
 	String name, comment;
 	UInt unixTime;
 
+	// output position where current GZip member starts
+	Long memberOffset;
+	// continue with next GZip member
+	bool multiMember;
+	// check for next GZip member after trailer
+	bool NextMember();
+
+	// push mode: unconsumed input (BitStream reads from memory)
+	Array< Byte > pushBuffer;
+	bool pushMode;
+	// no more input
+	bool pushEnd;
+	// suspended, waiting for input
+	bool needInput;
+	// push mode: input ran out within a unit starting at bitPos => rewind there and wait for input
+	// returns 0 if not suspended (error)
+	bool Suspend( Long bitPos );
+	// push mode: number of whole input bytes not consumed yet, Limits<Int>::MAX if no more input follows
+	Int GetPushAvailable() const;
+
 	// read ZLib/GZip headers
 	bool ReadZLibHeader();
 	bool ReadGZipHeader();
@@ -215,8 +417,20 @@ private:
 
 	// constants (for unity build)
 	static const Int DICTIONARY_SIZE;
+	static const Int DICTIONARY_PAD;
+	static const Int WINDOW_SIZE;
+	static const Int DIRECT_MIN_OUTPUT;
 	static const Int DIRECT_LUT_BITS;
 	static const Int DIRECT_LUT_SIZE;
+	static const Int MAX_HUFFMAN_CODES;
+	static const Long MAX_BATCH_TASK_SIZE;
+	static const Long BATCH_ITEM_COST;
+	static const Int HUFFMAN_LITLEN_ENOUGH;
+	static const Int HUFFMAN_DIST_ENOUGH;
+	static const UInt HUFFMAN_LINK;
+	static const UInt HUFFMAN_LITERAL;
+	static const UInt HUFFMAN_END;
+	static const UInt HUFFMAN_INVALID;
 };
 
 }
@@ -0,0 +1,195 @@
+
+// (c) Martin Sedlak (mar) 2015
+// distributed under the Boost Software License, version 1.0
+// (see accompanying file License.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "InflateIndex.h"
+#include "../Base/Memory.h"
+#include "../Base/Endian.h"
+#include "../Base/Templates.h"
+#include "../Base/Likely.h"
+
+namespace KwlKit
+{
+
+const Long InflateIndex::DEFAULT_SPACING = 1 << 20;
+const Int InflateIndex::BUILD_BUFFER_SIZE = 65536;
+const UInt InflateIndex::MAGIC = 0x58444e49u;		// "INDX"
+const Byte InflateIndex::VERSION = 1;
+
+// serialization helpers (little endian)
+template< typename T > static void IndexPut( Array< Byte > &data, T v )
+{
+	Endian::ToLittle( v );
+	Int ofs = data.GetSize();
+	data.Resize( ofs + (Int)sizeof(T) );
+	MemCpy( data.GetData() + ofs, &v, sizeof(T) );
+}
+
+template< typename T > static bool IndexGet( const Byte *&ptr, const Byte *top, T &v )
+{
+	if ( KWLKIT_UNLIKELY( top - ptr < (Int)sizeof(T) ) ) {
+		return 0;
+	}
+	MemCpy( &v, ptr, sizeof(T) );
+	Endian::FromLittle( v );
+	ptr += sizeof(T);
+	return 1;
+}
+
+// InflateIndex
+
+InflateIndex::InflateIndex() : outputSize(0), format(INF_RAW)
+{
+}
+
+void InflateIndex::Clear()
+{
+	checkpoints.Clear();
+	outputSize = 0;
+	format = INF_RAW;
+}
+
+void InflateIndex::AddCheckpoint( const Inflate &inf )
+{
+	Checkpoint &cp = checkpoints[ checkpoints.Add( Checkpoint() ) ];
+	cp.outOffset = inf.totalOutputSize;
+	cp.inBitOffset = inf.inbit.GetBitPosition();
+	cp.memberOffset = inf.memberOffset;
+	cp.crc = inf.crc;
+	// last window is always kept in dictionary
+	Int wsize = (Int)Min( inf.totalOutputSize, (Long)Inflate::WINDOW_SIZE );
+	cp.window.Resize( wsize );
+	inf.CopyWindow( cp.window.GetData(), wsize );
+}
+
+bool InflateIndex::Build( Stream &s, InflateFormat fmt, Long spacing )
+{
+	KWLKIT_ASSERT( spacing > 0 );
+	Clear();
+	format = fmt;
+	Inflate inf( s );
+	inf.SetFormat( fmt );
+	inf.checkpointAt = spacing;
+	Array< Byte > buf;
+	buf.Resize( BUILD_BUFFER_SIZE );
+
+	for (;;) {
+		Int nread;
+		if ( KWLKIT_UNLIKELY( !inf.Read( buf.GetData(), buf.GetSize(), nread ) ) ) {
+			Clear();
+			return 0;
+		}
+		if ( inf.IsEof() ) {
+			break;
+		}
+		if ( inf.state == Inflate::INF_STATE_BLOCK_HEADER && inf.GetPosition() == inf.totalOutputSize &&
+			inf.totalOutputSize >= inf.checkpointAt ) {
+			// decoder paused at block boundary
+			AddCheckpoint( inf );
+			inf.checkpointAt = inf.totalOutputSize + spacing;
+			continue;
+		}
+		if ( KWLKIT_UNLIKELY( !nread ) ) {
+			// truncated stream
+			Clear();
+			return 0;
+		}
+	}
+	outputSize = inf.GetOutputSize();
+	return 1;
+}
+
+Int InflateIndex::Find( Long pos ) const
+{
+	// binary search: last checkpoint with outOffset <= pos
+	Int lo = 0;
+	Int hi = checkpoints.GetSize();
+	while ( lo < hi ) {
+		Int mid = (lo + hi) / 2;
+		if ( checkpoints[ mid ].outOffset <= pos ) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo - 1;
+}
+
+bool InflateIndex::Save( Array< Byte > &data ) const
+{
+	IndexPut( data, MAGIC );
+	IndexPut( data, VERSION );
+	IndexPut( data, (Byte)format );
+	IndexPut( data, (ULong)outputSize );
+	IndexPut( data, (UInt)checkpoints.GetSize() );
+	for ( Int i=0; i<checkpoints.GetSize(); i++ ) {
+		const Checkpoint &cp = checkpoints[i];
+		IndexPut( data, (ULong)cp.outOffset );
+		IndexPut( data, (ULong)cp.inBitOffset );
+		IndexPut( data, (ULong)cp.memberOffset );
+		IndexPut( data, cp.crc );
+		IndexPut( data, (UShort)(cp.window.GetSize() - 1) );
+		if ( !cp.window.IsEmpty() ) {
+			Int ofs = data.GetSize();
+			data.Resize( ofs + cp.window.GetSize() );
+			MemCpy( data.GetData() + ofs, cp.window.GetData(), (size_t)cp.window.GetSize() );
+		}
+	}
+	return 1;
+}
+
+bool InflateIndex::Load( const void *data, Int size )
+{
+	KWLKIT_ASSERT( data || !size );
+	Clear();
+	const Byte *ptr = static_cast<const Byte *>(data);
+	const Byte *top = ptr + size;
+	UInt magic, count;
+	Byte version, fmt;
+	ULong total;
+	if ( !IndexGet( ptr, top, magic ) || !IndexGet( ptr, top, version ) || !IndexGet( ptr, top, fmt ) ||
+		!IndexGet( ptr, top, total ) || !IndexGet( ptr, top, count ) ) {
+		return 0;
+	}
+	if ( magic != MAGIC || version != VERSION || fmt > INF_GZIP || (Long)total < 0 ) {
+		return 0;
+	}
+	// each checkpoint takes at least 31 bytes => don't trust count blindly
+	if ( count > (UInt)(top - ptr) / 31 ) {
+		return 0;
+	}
+	checkpoints.Resize( (Int)count );
+	Long prev = 0;
+	for ( UInt i=0; i<count; i++ ) {
+		Checkpoint &cp = checkpoints[i];
+		ULong outOffset, inBitOffset, memberOffset;
+		UShort wsize;
+		if ( !IndexGet( ptr, top, outOffset ) || !IndexGet( ptr, top, inBitOffset ) ||
+			!IndexGet( ptr, top, memberOffset ) ||
+			!IndexGet( ptr, top, cp.crc ) || !IndexGet( ptr, top, wsize ) ) {
+			Clear();
+			return 0;
+		}
+		cp.outOffset = (Long)outOffset;
+		cp.inBitOffset = (Long)inBitOffset;
+		cp.memberOffset = (Long)memberOffset;
+		// stored as size-1, window is never empty (no checkpoint at output start)
+		Int wlen = (Int)wsize + 1;
+		if ( cp.outOffset <= prev || cp.outOffset > (Long)total || cp.inBitOffset < 0 ||
+			cp.memberOffset < 0 || cp.memberOffset > cp.outOffset ||
+			wlen > Inflate::WINDOW_SIZE || (Long)wlen > cp.outOffset || top - ptr < wlen ) {
+			Clear();
+			return 0;
+		}
+		prev = cp.outOffset;
+		cp.window.Resize( wlen );
+		MemCpy( cp.window.GetData(), ptr, (size_t)wlen );
+		ptr += wlen;
+	}
+	outputSize = (Long)total;
+	format = (InflateFormat)fmt;
+	return 1;
+}
+
+}
@@ -0,0 +1,79 @@
+
+// (c) Martin Sedlak (mar) 2015
+// distributed under the Boost Software License, version 1.0
+// (see accompanying file License.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "Inflate.h"
+#include "../Base/Array.h"
+
+namespace KwlKit
+{
+
+// random access index for deflate streams (zran-style)
+// built in a single pass, holds a checkpoint (input bit position + 32k window) roughly every spacing bytes
+// of output, so that Inflate::Seek only has to decode from the nearest checkpoint
+class InflateIndex
+{
+public:
+	struct Checkpoint
+	{
+		Long outOffset;			// uncompressed position (start of deflate block)
+		Long inBitOffset;		// compressed position in bits
+		Long memberOffset;		// uncompressed position of current GZip member
+		UInt crc;				// running CRC-32/Adler-32 up to outOffset (current member)
+		Array< Byte > window;	// preceding output (up to 32k)
+	};
+
+	InflateIndex();
+
+	// build index by decoding whole stream (s must be at its start, i.e. where Rewind goes)
+	// spacing = uncompressed distance between checkpoints
+	bool Build( Stream &s, InflateFormat fmt = INF_RAW, Long spacing = DEFAULT_SPACING );
+
+	void Clear();
+
+	// get stream format index was built for
+	inline InflateFormat GetFormat() const {
+		return format;
+	}
+
+	// get total uncompressed size
+	inline Long GetOutputSize() const {
+		return outputSize;
+	}
+
+	inline Int GetCheckpointCount() const {
+		return checkpoints.GetSize();
+	}
+
+	inline const Checkpoint &GetCheckpoint( Int index ) const {
+		return checkpoints[ index ];
+	}
+
+	// find last checkpoint at or before pos, -1 if none
+	Int Find( Long pos ) const;
+
+	// serialize (appends to data)
+	bool Save( Array< Byte > &data ) const;
+	// deserialize, returns 0 on corrupt data
+	bool Load( const void *data, Int size );
+
+	static const Long DEFAULT_SPACING;
+
+private:
+	Array< Checkpoint > checkpoints;
+	Long outputSize;
+	InflateFormat format;
+
+	// add checkpoint from decoder paused at block boundary
+	void AddCheckpoint( const Inflate &inf );
+
+	// constants (for unity build)
+	static const Int BUILD_BUFFER_SIZE;
+	static const UInt MAGIC;
+	static const Byte VERSION;
+};
+
+}
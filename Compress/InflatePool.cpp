@@ -0,0 +1,83 @@
+
+// (c) Martin Sedlak (mar) 2015
+// distributed under the Boost Software License, version 1.0
+// (see accompanying file License.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "InflatePool.h"
+#include "../Base/Templates.h"
+
+namespace KwlKit
+{
+
+const Int InflatePool::DEFAULT_MAX_IDLE = 16;
+
+// InflatePool
+
+InflatePool::InflatePool( Int nmaxIdle ) : maxIdle( nmaxIdle )
+{
+	KWLKIT_ASSERT( maxIdle >= 0 );
+	idle.Reserve( maxIdle );
+}
+
+InflatePool::~InflatePool()
+{
+	for ( Int i=0; i<idle.GetSize(); i++ ) {
+		delete idle[i];
+	}
+}
+
+void InflatePool::Reserve( Int count )
+{
+	MutexLock lock( mutex );
+	count = Min( count, maxIdle );
+	while ( idle.GetSize() < count ) {
+		InflateStream *ctx = new InflateStream;
+		idle.Add( ctx );
+	}
+}
+
+InflateStream *InflatePool::Acquire( Stream &s, InflateFormat fmt, bool owned )
+{
+	InflateStream *res = 0;
+	{
+		MutexLock lock( mutex );
+		Int n = idle.GetSize();
+		if ( n > 0 ) {
+			res = idle[n-1];
+			idle.Resize( n-1 );
+		}
+	}
+	if ( !res ) {
+		res = new InflateStream;
+	}
+	if ( !res->Reset( s, fmt, owned ) ) {
+		Release( res );
+		return 0;
+	}
+	return res;
+}
+
+void InflatePool::Release( InflateStream *ctx )
+{
+	if ( !ctx ) {
+		return;
+	}
+	ctx->Detach();
+	ctx->GetInflate().SetProfileStats( 0 );
+	{
+		MutexLock lock( mutex );
+		if ( idle.GetSize() < maxIdle ) {
+			idle.Add( ctx );
+			return;
+		}
+	}
+	delete ctx;
+}
+
+Int InflatePool::GetIdleCount() const
+{
+	MutexLock lock( mutex );
+	return idle.GetSize();
+}
+
+}
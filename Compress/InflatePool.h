@@ -0,0 +1,46 @@
+
+// (c) Martin Sedlak (mar) 2015
+// distributed under the Boost Software License, version 1.0
+// (see accompanying file License.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "InflateStream.h"
+#include "../Base/Array.h"
+#include "../Base/NoCopy.h"
+#include "../Base/Thread.h"
+
+namespace KwlKit
+{
+
+// pool of ready to use Inflate contexts (~110k each: dictionary, Huffman tables, input buffer)
+// borrowing a context just resets it => opening many streams one after another (asset loading) doesn't allocate
+// all methods are thread safe, borrowed contexts are used by one thread at a time as usual
+class InflatePool : public NoCopy
+{
+public:
+	// maxIdle = max contexts kept for reuse, contexts released above that are deleted
+	explicit InflatePool( Int nmaxIdle = DEFAULT_MAX_IDLE );
+	~InflatePool();
+
+	// preallocate contexts (up to max idle)
+	void Reserve( Int count );
+
+	// borrow context reset to decode s (see InflateStream::Reset)
+	// returns null on failure (owned stream is deleted in that case)
+	InflateStream *Acquire( Stream &s, InflateFormat fmt = INF_RAW, bool owned = 0 );
+	// return borrowed context (null is ignored), detaches its input stream
+	void Release( InflateStream *ctx );
+
+	Int GetIdleCount() const;
+
+	static const Int DEFAULT_MAX_IDLE;
+
+private:
+	mutable Mutex mutex;
+	Int maxIdle;
+	// capacity reserved up front
+	Array< InflateStream * > idle;
+};
+
+}
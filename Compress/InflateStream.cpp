@@ -10,16 +10,19 @@ namespace KwlKit
 
 // InflateStream
 
-InflateStream::InflateStream() : stream(0) {
+InflateStream::InflateStream() : stream(0), index(0) {
+	Init();
 	infl.SetFormat( INF_RAW );
 }
 
-InflateStream::InflateStream( InflateFormat fmt ) : stream(0) {
+InflateStream::InflateStream( InflateFormat fmt ) : stream(0), index(0) {
+	Init();
 	infl.SetFormat( fmt );
 }
 
-InflateStream::InflateStream( Stream &refs, InflateFormat fmt, bool owned ) : stream(0)
+InflateStream::InflateStream( Stream &refs, InflateFormat fmt, bool owned ) : stream(0), index(0)
 {
+	Init();
 	if ( owned ) {
 		stream = &refs;
 	}
@@ -28,12 +31,29 @@ InflateStream::InflateStream( Stream &refs, InflateFormat fmt, bool owned ) : st
 }
 
 InflateStream::~InflateStream() {
+	delete engine;
 	infl.Close();
 	delete stream;
 }
 
+void InflateStream::Init()
+{
+	parallel = parallelEnabled = 0;
+	parallelPool = 0;
+	parallelMinSize = SpeculativeInflate::MIN_INPUT_SIZE;
+	engine = 0;
+}
+
+void InflateStream::ResetEngine()
+{
+	delete engine;
+	engine = 0;
+	parallel = parallelEnabled;
+}
+
 bool InflateStream::SetStream( Stream &refs, bool owned )
 {
+	ResetEngine();
 	delete stream;
 	stream = 0;
 	if ( owned ) {
@@ -42,9 +62,66 @@ bool InflateStream::SetStream( Stream &refs, bool owned )
 	return infl.SetInput( refs );
 }
 
+bool InflateStream::Reset( Stream &refs, InflateFormat fmt, bool owned )
+{
+	ResetEngine();
+	delete stream;
+	stream = 0;
+	index = 0;
+	Init();
+	if ( owned ) {
+		stream = &refs;
+	}
+	return infl.Reset( refs, fmt );
+}
+
+void InflateStream::Detach()
+{
+	ResetEngine();
+	infl.Close();
+	delete stream;
+	stream = 0;
+}
+
 bool InflateStream::Rewind()
 {
+	ResetEngine();
 	return infl.Rewind();
 }
 
+bool InflateStream::Seek( Long pos )
+{
+	// engine never touches infl => seeking starts from scratch (or index checkpoint)
+	ResetEngine();
+	parallel = 0;
+	return infl.Seek( pos, index );
+}
+
+void InflateStream::SetParallel( bool enable, ThreadPool *pool, Long minSize )
+{
+	parallelEnabled = enable;
+	parallelPool = pool;
+	parallelMinSize = minSize;
+	ResetEngine();
+}
+
+bool InflateStream::ParallelRead( void *buf, Int size, Int &nread )
+{
+	if ( !engine ) {
+		// first read: decide once
+		parallel = 0;
+		Stream *input = infl.GetStream().GetStream();
+		size_t msize = 0;
+		const void *mem = input ? input->GetMemory( msize ) : 0;
+		Int threads = parallelPool ? parallelPool->GetThreadCount() + 1 : Thread::GetCpuCount();
+		if ( mem && (Long)msize >= parallelMinSize && msize <= (size_t)Limits<Int>::MAX && threads >= SpeculativeInflate::MIN_THREADS ) {
+			engine = new SpeculativeInflate( mem, msize, infl.GetFormat(), parallelPool );
+			engine->SetZipCrc( infl.GetZipCrc() );
+			engine->SetTrusted( infl.IsTrusted() );
+			parallel = 1;
+		}
+	}
+	return engine ? engine->Read( buf, size, nread ) : infl.Read( buf, size, nread );
+}
+
 }
@@ -6,6 +6,8 @@
 #pragma once
 
 #include "Inflate.h"
+#include "InflateIndex.h"
+#include "SpeculativeInflate.h"
 #include "../Base/Stream.h"
 
 namespace KwlKit
@@ -22,6 +24,11 @@ public:
 	~InflateStream();
 
 	bool SetStream( Stream &refs, bool owned );
+	// start decoding new input from scratch, reusing all storage (see Inflate::Reset)
+	// format, trusted mode, index and parallel settings go back to defaults
+	bool Reset( Stream &refs, InflateFormat fmt = INF_RAW, bool owned = 0 );
+	// detach input stream (deletes it if owned), keeps storage for next Reset
+	void Detach();
 
 	inline bool SetFormat( InflateFormat fmt ) {
 		return infl.SetFormat(fmt);
@@ -31,12 +38,20 @@ public:
 		infl.SetZipCrc( zcrc );
 	}
 
+	// skip checksums for trusted input (see Inflate::SetTrusted), call before reading
+	inline void SetTrusted( bool enable ) {
+		infl.SetTrusted( enable );
+	}
+
 	inline bool Read( void *buf, Int size, Int &nread ) {
+		if ( KWLKIT_UNLIKELY( parallel ) ) {
+			return ParallelRead( buf, size, nread );
+		}
 		return infl.Read( buf, size, nread );
 	}
 
 	inline bool IsEof() {
-		return infl.IsEof();
+		return engine ? engine->IsEof() : infl.IsEof();
 	}
 
 	inline BitStream &GetBitStream() {
@@ -49,10 +64,39 @@ public:
 
 	bool Rewind();
 
+	// set random access index used by Seek (reference only, can be null)
+	inline void SetIndex( const InflateIndex *idx ) {
+		index = idx;
+	}
+
+	// seek to uncompressed position (see Inflate::Seek), switches back to sequential decoding
+	bool Seek( Long pos );
+
+	// get current uncompressed position
+	inline Long Tell() const {
+		return engine ? engine->GetPosition() : infl.GetPosition();
+	}
+
+	// decode large memory-backed input (see Stream::GetMemory) in parallel using SpeculativeInflate
+	// decided on first read (call before reading), requires at least SpeculativeInflate::MIN_THREADS threads
+	// pool = thread pool to use (null = own pool with one thread per CPU), minSize = minimum compressed size
+	void SetParallel( bool enable, ThreadPool *pool = 0, Long minSize = SpeculativeInflate::MIN_INPUT_SIZE );
+
 private:
 	// owned stream (if any)
 	Stream *stream;
+	const InflateIndex *index;
 	Inflate infl;
+	// parallel decoding
+	bool parallel;				// route reads through ParallelRead
+	bool parallelEnabled;
+	ThreadPool *parallelPool;
+	Long parallelMinSize;
+	SpeculativeInflate *engine;
+
+	void Init();
+	bool ParallelRead( void *buf, Int size, Int &nread );
+	void ResetEngine();
 };
 
 }
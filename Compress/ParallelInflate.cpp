@@ -0,0 +1,267 @@
+
+// (c) Martin Sedlak (mar) 2015
+// distributed under the Boost Software License, version 1.0
+// (see accompanying file License.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "ParallelInflate.h"
+#include "../Base/Memory.h"
+#include "../Base/Templates.h"
+
+namespace KwlKit
+{
+
+const Int ParallelInflateStream::MAX_MEMBER_OUTPUT = 64 << 20;
+const Long ParallelInflateStream::MAX_QUEUED_OUTPUT = 256 << 20;
+
+// ParallelInflateStream
+
+ParallelInflateStream::ParallelInflateStream( const void *ndata, size_t nsize, ThreadPool *npool )
+	: data( static_cast<const Byte *>(ndata) )
+	, size( nsize )
+	, pool( npool )
+	, ownPool( 0 )
+	, queueHead( 0 )
+	, queuedBytes( 0 )
+	, scanPos( 0 )
+	, current( 0 )
+	, currentOfs( 0 )
+	, streaming( 0 )
+	, pos( 0 )
+	, eof( 0 )
+	, error( 0 )
+{
+	KWLKIT_ASSERT( data || !size );
+	if ( !pool ) {
+		pool = ownPool = new ThreadPool;
+	}
+	infl.SetFormat( INF_GZIP );
+	infl.SetMultiMember( 0 );
+}
+
+ParallelInflateStream::~ParallelInflateStream()
+{
+	ClearQueue();
+	delete current;
+	delete ownPool;
+}
+
+bool ParallelInflateStream::IsMemberHeader( size_t ofs ) const
+{
+	// header + empty deflate block + trailer = 20 bytes
+	if ( ofs > size || size - ofs < 20 ) {
+		return 0;
+	}
+	const Byte *p = data + ofs;
+	// magic, deflate, no reserved flags, XFL 0/2/4, known OS
+	return p[0] == 0x1f && p[1] == 0x8b && p[2] == 8 && !(p[3] & 0xe0) && (p[8] == 0 || p[8] == 2 || p[8] == 4) &&
+		(p[9] <= 13 || p[9] == 255);
+}
+
+size_t ParallelInflateStream::FindNextMember( size_t ofs ) const
+{
+	const Byte *p = data + ofs;
+	if ( (p[3] & 4) && size - ofs >= 12 ) {
+		// BGZF: BSIZE subfield ('B', 'C') holds total member size - 1
+		size_t x = ofs + 12;
+		size_t xend = x + (p[10] | ((size_t)p[11] << 8));
+		while ( xend <= size && x + 4 <= xend ) {
+			size_t slen = data[x+2] | ((size_t)data[x+3] << 8);
+			if ( data[x] == 'B' && data[x+1] == 'C' && slen == 2 && x + 6 <= xend ) {
+				size_t next = ofs + (data[x+4] | ((size_t)data[x+5] << 8)) + 1;
+				if ( next == size || IsMemberHeader( next ) ) {
+					return next;
+				}
+				break;
+			}
+			x += 4 + slen;
+		}
+	}
+	// scan for next plausible header
+	size_t i = ofs + 20;
+	while ( i < size ) {
+		const void *hit = memchr( data + i, 0x1f, size - i );
+		if ( !hit ) {
+			break;
+		}
+		i = (size_t)(static_cast<const Byte *>(hit) - data);
+		if ( IsMemberHeader( i ) ) {
+			return i;
+		}
+		i++;
+	}
+	return size;
+}
+
+void ParallelInflateStream::DecodeMember( void *param )
+{
+	Member *m = static_cast<Member *>(param);
+	ParallelInflateStream *s = m->owner;
+	size_t len = m->end - m->start;
+	size_t osize = (size_t)m->output.GetSize();
+	size_t outSize, inSize;
+	// member must fill the whole range exactly
+	bool ok = InflateBuffer( s->data + m->start, len, osize ? m->output.GetData() : 0, osize, INF_GZIP, &outSize, 0,
+		&inSize ) && outSize == osize && inSize == len;
+	MutexLock lock( s->mutex );
+	m->status = ok ? MEMBER_OK : MEMBER_FAILED;
+	s->done.Broadcast();
+}
+
+void ParallelInflateStream::Schedule()
+{
+	const Int maxQueued = 2 * Max( pool->GetThreadCount(), (Int)1 );
+	if ( scanPos < pos ) {
+		scanPos = pos;
+	}
+	while ( queue.GetSize() - queueHead < maxQueued && (queuedBytes < MAX_QUEUED_OUTPUT || queueHead == queue.GetSize()) ) {
+		if ( !IsMemberHeader( scanPos ) ) {
+			break;
+		}
+		Member *m = new Member;
+		m->owner = this;
+		m->start = scanPos;
+		m->end = scanPos = FindNextMember( scanPos );
+		m->status = MEMBER_FAILED;
+		// output size from ISIZE (don't trust it blindly: max deflate ratio is ~1032:1)
+		const Byte *trailer = data + m->end - 4;
+		UInt isize = trailer[0] | ((UInt)trailer[1] << 8) | ((UInt)trailer[2] << 16) | ((UInt)trailer[3] << 24);
+		if ( isize <= (UInt)MAX_MEMBER_OUTPUT && (ULong)isize <= (ULong)(m->end - m->start) * 1032 ) {
+			m->output.Resize( (Int)isize );
+			m->status = MEMBER_PENDING;
+		}
+		queuedBytes += m->output.GetSize();
+		queue.Add( m );
+		if ( m->status == MEMBER_PENDING ) {
+			pool->Submit( DecodeMember, m );
+		}
+	}
+}
+
+void ParallelInflateStream::Wait( Member *m )
+{
+	MutexLock lock( mutex );
+	while ( m->status == MEMBER_PENDING ) {
+		done.Wait( mutex );
+	}
+}
+
+ParallelInflateStream::Member *ParallelInflateStream::PopMember()
+{
+	KWLKIT_ASSERT( queueHead < queue.GetSize() );
+	Member *m = queue[ queueHead++ ];
+	queuedBytes -= m->output.GetSize();
+	if ( queueHead == queue.GetSize() ) {
+		queue.Clear();
+		queueHead = 0;
+	} else if ( queueHead >= 256 ) {
+		queue.erase( queue.begin(), queue.begin() + queueHead );
+		queueHead = 0;
+	}
+	return m;
+}
+
+void ParallelInflateStream::ClearQueue()
+{
+	while ( queueHead < queue.GetSize() ) {
+		Member *m = PopMember();
+		Wait( m );
+		delete m;
+	}
+}
+
+bool ParallelInflateStream::NextMember()
+{
+	if ( size - pos < 2 || data[pos] != 0x1f || data[pos+1] != 0x8b ) {
+		// end of data (anything not starting with GZip magic is ignored, same as Inflate)
+		eof = 1;
+		return 0;
+	}
+	Schedule();
+	// drop members starting inside previous member (false header match)
+	while ( queueHead < queue.GetSize() && queue[ queueHead ]->start < pos ) {
+		Member *m = PopMember();
+		Wait( m );
+		delete m;
+	}
+	if ( queueHead < queue.GetSize() && queue[ queueHead ]->start == pos ) {
+		Member *m = PopMember();
+		Schedule();
+		Wait( m );
+		if ( m->status == MEMBER_OK ) {
+			current = m;
+			currentOfs = 0;
+			pos = m->end;
+			return 1;
+		}
+		delete m;
+	}
+	// decode sequentially (this also finds where the member really ends)
+	memStream.SetData( data + pos, size - pos );
+	if ( !infl.SetInput( memStream ) || !infl.Rewind() ) {
+		error = 1;
+		return 0;
+	}
+	streaming = 1;
+	return 1;
+}
+
+bool ParallelInflateStream::Read( void *buf, Int count, Int &nread )
+{
+	KWLKIT_ASSERT( buf && count >= 0 );
+	nread = 0;
+	Byte *b = static_cast<Byte *>(buf);
+	while ( count > 0 && !error ) {
+		if ( streaming ) {
+			Int nr;
+			if ( !infl.Read( b, count, nr ) ) {
+				error = 1;
+				break;
+			}
+			b += nr;
+			count -= nr;
+			nread += nr;
+			if ( count > 0 ) {
+				// member done
+				if ( !infl.IsEof() ) {
+					error = 1;
+					break;
+				}
+				pos += (size_t)((infl.GetStream().GetBitPosition() + 7) >> 3);
+				streaming = 0;
+			}
+			continue;
+		}
+		if ( current ) {
+			Int part = Min( count, current->output.GetSize() - currentOfs );
+			if ( part > 0 ) {
+				MemCpy( b, current->output.GetData() + currentOfs, (size_t)part );
+				currentOfs += part;
+				b += part;
+				count -= part;
+				nread += part;
+				continue;
+			}
+			delete current;
+			current = 0;
+		}
+		if ( !NextMember() ) {
+			break;
+		}
+	}
+	return !error;
+}
+
+bool ParallelInflateStream::Rewind()
+{
+	ClearQueue();
+	delete current;
+	current = 0;
+	currentOfs = 0;
+	streaming = 0;
+	queuedBytes = 0;
+	scanPos = pos = 0;
+	eof = error = 0;
+	return 1;
+}
+
+}
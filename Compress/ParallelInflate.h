@@ -0,0 +1,105 @@
+
+// (c) Martin Sedlak (mar) 2015
+// distributed under the Boost Software License, version 1.0
+// (see accompanying file License.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "Inflate.h"
+#include "../Base/Stream.h"
+#include "../Base/MemoryStream.h"
+#include "../Base/Thread.h"
+
+namespace KwlKit
+{
+
+// parallel decoder for multi-member GZip data (concatenated .gz files, pigz/bgzip output)
+// members are located by scanning for GZip headers (BGZF blocks use the BSIZE extra field),
+// decoded on a thread pool into separate buffers and read back in order
+// members that can't be decoded speculatively (too large, false header match) are decoded on the fly
+// input must be in memory (e.g. memory mapped file) and stay valid while reading
+class ParallelInflateStream : public Stream
+{
+public:
+	KWLKIT_INJECT_STREAM()
+
+	// pool = thread pool to use (null = create own pool with one thread per CPU)
+	ParallelInflateStream( const void *ndata, size_t nsize, ThreadPool *npool = 0 );
+	~ParallelInflateStream();
+
+	bool Read( void *buf, Int size, Int &nread );
+	bool Rewind();
+
+	inline bool IsEof() const {
+		return eof;
+	}
+
+private:
+	enum MemberStatus
+	{
+		MEMBER_PENDING,
+		MEMBER_OK,
+		MEMBER_FAILED
+	};
+
+	struct Member
+	{
+		ParallelInflateStream *owner;
+		size_t start;			// input range (assumed to hold exactly one member)
+		size_t end;
+		Array< Byte > output;	// sized from ISIZE
+		MemberStatus status;	// guarded by owner mutex
+	};
+
+	const Byte *data;
+	size_t size;
+	ThreadPool *pool;
+	ThreadPool *ownPool;
+
+	// members scheduled for decoding, in input order
+	Array< Member * > queue;
+	Int queueHead;
+	// total output size of queued members
+	Long queuedBytes;
+	// input position where next member to schedule starts
+	size_t scanPos;
+
+	Mutex mutex;
+	CondVar done;
+
+	// member being read
+	Member *current;
+	Int currentOfs;
+	// fallback: sequential decoding of member at pos
+	bool streaming;
+	MemoryStream memStream;
+	Inflate infl;
+
+	// input position of next member to read
+	size_t pos;
+	bool eof;
+	bool error;
+
+	// is there a plausible GZip member header at ofs?
+	bool IsMemberHeader( size_t ofs ) const;
+	// find start of next member (or size)
+	size_t FindNextMember( size_t ofs ) const;
+	// queue members for decoding
+	void Schedule();
+	// wait until member is decoded
+	void Wait( Member *m );
+	// remove first queued member
+	Member *PopMember();
+	// wait for all queued members and free them
+	void ClearQueue();
+	// switch to next member, returns 0 at end of stream or on error
+	bool NextMember();
+
+	static void DecodeMember( void *param );
+
+	// constants (for unity build)
+	static const Int MAX_MEMBER_OUTPUT;
+	static const Long MAX_QUEUED_OUTPUT;
+};
+
+}
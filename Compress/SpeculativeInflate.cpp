@@ -0,0 +1,452 @@
+
+// (c) Martin Sedlak (mar) 2015
+// distributed under the Boost Software License, version 1.0
+// (see accompanying file License.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "SpeculativeInflate.h"
+#include "../Base/Memory.h"
+#include "../Base/Endian.h"
+#include "../Base/Templates.h"
+
+namespace KwlKit
+{
+
+const Int SpeculativeInflate::CHUNK_SIZE = 4 << 20;
+const Long SpeculativeInflate::MIN_INPUT_SIZE = 16 << 20;
+const Int SpeculativeInflate::MIN_THREADS = 4;
+const Int SpeculativeInflate::MAX_CHUNK_OUTPUT = 64 << 20;
+const Int SpeculativeInflate::DECODE_STEP = 1 << 20;
+const Int SpeculativeInflate::MARKER_STEP = 128 << 10;
+const Int SpeculativeInflate::SEARCH_SIZE = 1 << 20;
+
+// SpeculativeInflate
+
+SpeculativeInflate::SpeculativeInflate( const void *ndata, size_t nsize, InflateFormat fmt, ThreadPool *npool )
+	: data( static_cast<const Byte *>(ndata) )
+	, size( nsize )
+	, pool( npool )
+	, ownPool( 0 )
+	, queueHead( 0 )
+	, nextChunk( 1 )
+	, numChunks( 0 )
+	, skipBit( -1 )
+	, current( 0 )
+	, currentOfs( 0 )
+	, outPos( 0 )
+	, memberOffset( 0 )
+	, crc( 0 )
+	, error( 0 )
+{
+	KWLKIT_ASSERT( data || !size );
+	KWLKIT_ASSERT( size <= (size_t)Limits<Int>::MAX );
+	if ( !pool ) {
+		pool = ownPool = new ThreadPool;
+	}
+	seq.SetFormat( fmt );
+	window.Resize( Inflate::WINDOW_SIZE );
+	// Kraft sums (in units of 1/128) of 4 packed 3-bit code lengths
+	for ( Int i=0; i<4096; i++ ) {
+		UInt sum = 0;
+		for ( Int j=0; j<4; j++ ) {
+			UInt len = (UInt)(i >> (3*j)) & 7;
+			sum += len ? 128u >> len : 0;
+		}
+		kraftTable[i] = (UShort)sum;
+	}
+	Rewind();
+}
+
+SpeculativeInflate::~SpeculativeInflate()
+{
+	DropChunks( Limits<Long>::MAX );
+	delete current;
+	delete ownPool;
+}
+
+bool SpeculativeInflate::Rewind()
+{
+	DropChunks( Limits<Long>::MAX );
+	delete current;
+	current = 0;
+	currentOfs = 0;
+	nextChunk = 1;
+	numChunks = (Int)((size + (size_t)CHUNK_SIZE - 1) / (size_t)CHUNK_SIZE);
+	skipBit = -1;
+	window.MemSet( 0 );
+	outPos = memberOffset = 0;
+	crc = 0;
+	error = 0;
+	seq.ResetState();
+	seq.inbit.SetMemory( data, (Int)size );
+	seq.stopBit = numChunks > 1 ? ChunkBit( 1 ) : Limits<Long>::MAX;
+	return 1;
+}
+
+void SpeculativeInflate::Schedule()
+{
+	const Int maxQueued = 2 * Max( pool->GetThreadCount(), (Int)1 );
+	while ( queue.GetSize() - queueHead < maxQueued && nextChunk < numChunks ) {
+		Long beginBit = ChunkBit( nextChunk++ );
+		if ( beginBit <= skipBit ) {
+			continue;
+		}
+		Chunk *c = new Chunk;
+		c->owner = this;
+		c->beginBit = beginBit;
+		c->startBit = c->endBit = -1;
+		c->final = 0;
+		c->status = CHUNK_PENDING;
+		c->cancelled = 0;
+		queue.Add( c );
+		pool->Submit( DecodeChunk, c );
+	}
+}
+
+void SpeculativeInflate::Wait( Chunk *c )
+{
+	MutexLock lock( mutex );
+	while ( c->status == CHUNK_PENDING ) {
+		done.Wait( mutex );
+	}
+}
+
+SpeculativeInflate::Chunk *SpeculativeInflate::PopChunk()
+{
+	KWLKIT_ASSERT( queueHead < queue.GetSize() );
+	Chunk *c = queue[ queueHead++ ];
+	if ( queueHead == queue.GetSize() ) {
+		queue.Clear();
+		queueHead = 0;
+	} else if ( queueHead >= 256 ) {
+		queue.erase( queue.begin(), queue.begin() + queueHead );
+		queueHead = 0;
+	}
+	return c;
+}
+
+void SpeculativeInflate::DropChunks( Long bitPos )
+{
+	{
+		MutexLock lock( mutex );
+		for ( Int i=queueHead; i<queue.GetSize() && queue[i]->beginBit <= bitPos; i++ ) {
+			queue[i]->cancelled = 1;
+		}
+	}
+	while ( queueHead < queue.GetSize() && queue[ queueHead ]->beginBit <= bitPos ) {
+		Chunk *c = PopChunk();
+		Wait( c );
+		delete c;
+	}
+}
+
+bool SpeculativeInflate::IsCancelled( Chunk *c )
+{
+	MutexLock lock( mutex );
+	return c->cancelled;
+}
+
+bool SpeculativeInflate::NextChunk( Long bitPos )
+{
+	for (;;) {
+		Schedule();
+		if ( queueHead == queue.GetSize() ) {
+			seq.stopBit = Limits<Long>::MAX;
+			return 0;
+		}
+		Chunk *c = queue[ queueHead ];
+		if ( bitPos < c->beginBit ) {
+			// decode sequentially up to first block boundary within chunk
+			seq.stopBit = c->beginBit;
+			return 0;
+		}
+		PopChunk();
+		Wait( c );
+		if ( c->status == CHUNK_OK && c->startBit == bitPos ) {
+			ResolveMarkers( *c );
+			current = c;
+			currentOfs = 0;
+			Schedule();
+			return 1;
+		}
+		delete c;
+	}
+}
+
+void SpeculativeInflate::FinishChunk()
+{
+	Chunk *c = current;
+	current = 0;
+	UpdateWindow( *c );
+	Long bitPos = c->endBit;
+	bool final = c->final;
+	delete c;
+	if ( final ) {
+		// anything past final block (bits of trailer, next GZip member) can't be trusted
+		skipBit = bitPos;
+		DropChunks( bitPos );
+		NextChunk( bitPos );
+		StartSequential( bitPos, 1 );
+		return;
+	}
+	if ( !NextChunk( bitPos ) ) {
+		StartSequential( bitPos, 0 );
+	}
+}
+
+void SpeculativeInflate::StartSequential( Long bitPos, bool finalize )
+{
+	if ( !seq.Restore( bitPos, window.GetData(), Inflate::WINDOW_SIZE, outPos, memberOffset, crc ) ) {
+		error = 1;
+		return;
+	}
+	if ( finalize ) {
+		// trailer (and next GZip member) is handled by seq
+		seq.state = Inflate::INF_STATE_EOS_FINALIZE;
+	}
+}
+
+void SpeculativeInflate::UpdateWindow( const Chunk &c )
+{
+	const Int wsize = Inflate::WINDOW_SIZE;
+	Int count = c.output.GetSize();
+	if ( count >= wsize ) {
+		MemCpy( window.GetData(), c.output.GetData() + count - wsize, (size_t)wsize );
+	} else if ( count > 0 ) {
+		MemMove( window.GetData(), window.GetData() + count, (size_t)(wsize - count) );
+		MemCpy( window.GetData() + wsize - count, c.output.GetData(), (size_t)count );
+	}
+}
+
+void SpeculativeInflate::ResolveMarkers( Chunk &c )
+{
+	const Byte *w = window.GetData();
+	Int count = c.markerPos.GetSize();
+	if ( !count ) {
+		return;
+	}
+	Byte *dst = c.output.GetData();
+	const UInt *mpos = c.markerPos.GetData();
+	const UShort *mref = c.markerRef.GetData();
+	for ( Int i=0; i<count; i++ ) {
+		dst[ mpos[i] ] = w[ mref[i] ];
+	}
+}
+
+bool SpeculativeInflate::Read( void *buf, Int count, Int &nread )
+{
+	KWLKIT_ASSERT( buf && count >= 0 );
+	nread = 0;
+	Byte *b = static_cast<Byte *>(buf);
+	Schedule();
+	while ( count > 0 && !error ) {
+		if ( current ) {
+			Int part = Min( count, current->output.GetSize() - currentOfs );
+			if ( part > 0 ) {
+				const Byte *src = current->output.GetData() + currentOfs;
+				MemCpy( b, src, (size_t)part );
+				if ( seq.crcFunction ) {
+					crc = seq.crcFunction( src, (size_t)part, crc );
+				}
+				outPos += part;
+				currentOfs += part;
+				b += part;
+				count -= part;
+				nread += part;
+				continue;
+			}
+			FinishChunk();
+			continue;
+		}
+		Int nr;
+		if ( !seq.Read( b, count, nr ) ) {
+			error = 1;
+			break;
+		}
+		b += nr;
+		count -= nr;
+		nread += nr;
+		if ( count <= 0 || seq.IsEof() ) {
+			break;
+		}
+		Long bitPos = seq.inbit.GetBitPosition();
+		if ( seq.state != Inflate::INF_STATE_BLOCK_HEADER || bitPos < seq.stopBit ) {
+			// truncated input
+			error = 1;
+			break;
+		}
+		// seq paused at block boundary => take over its state and try decoded chunk
+		outPos = seq.totalOutputSize;
+		memberOffset = seq.memberOffset;
+		crc = seq.crc;
+		seq.CopyWindow( window.GetData(), Inflate::WINDOW_SIZE );
+		NextChunk( bitPos );
+	}
+	return !error;
+}
+
+// worker side
+
+void SpeculativeInflate::DecodeChunk( void *param )
+{
+	Chunk *c = static_cast<Chunk *>(param);
+	SpeculativeInflate *s = c->owner;
+	bool ok = s->FindAndDecode( *c );
+	MutexLock lock( s->mutex );
+	c->status = ok ? CHUNK_OK : CHUNK_FAILED;
+	s->done.Broadcast();
+}
+
+// quick check for dynamic Huffman block header at bit position (bits = input from there on, BTYPE already
+// checked): symbol counts and a complete code length code (the rest is validated by decoding)
+inline bool SpeculativeInflate::IsBlockCandidate( ULong bits, Long bitPos ) const
+{
+	// HLIT <= 29, HDIST <= 29
+	if ( ((bits >> 3) & 31) > 29 || ((bits >> 8) & 31) > 29 ) {
+		return 0;
+	}
+	Int hclen = (Int)((bits >> 13) & 15) + 4;
+	// code length code lengths (3 bits each) start at bit 17
+	Long clPos = bitPos + 17;
+	ULong cl = LoadUnaligned<ULong>( data + (clPos >> 3) );
+	Endian::FromLittle( cl );
+	cl >>= clPos & 7;
+	cl &= ((ULong)1 << (3*hclen)) - 1;
+	// must be complete (Kraft sum 1 = 128/128)
+	const UShort *kt = kraftTable;
+	UInt kraft = kt[ cl & 4095 ] + kt[ (cl >> 12) & 4095 ] + kt[ (cl >> 24) & 4095 ] + kt[ (cl >> 36) & 4095 ] +
+		kt[ (cl >> 48) & 4095 ];
+	return kraft == 128;
+}
+
+bool SpeculativeInflate::FindAndDecode( Chunk &c )
+{
+	Inflate inf;
+	inf.inbit.SetMemory( data, (Int)size );
+	inf.strictHeader = 1;
+	Array< UShort > buf;
+	// block headers are usually frequent, give up early on incompressible (stored) data
+	Long limit = Min( c.beginBit + (Long)SEARCH_SIZE * 8, (Long)size * 8 );
+	// enough bytes left to check a header
+	Long lastOfs = (Long)size - 24;
+	for ( Long ofs = c.beginBit >> 3; ofs * 8 < limit && ofs <= lastOfs; ofs++ ) {
+		ULong bits = LoadUnaligned<ULong>( data + ofs );
+		Endian::FromLittle( bits );
+		// BTYPE = 2 (BFINAL ignored) at each of the 8 bit positions
+		UInt match = (UInt)((~bits >> 1) & (bits >> 2)) & 255;
+		for ( Int shift = 0; match; shift++, match >>= 1 ) {
+			Long bitPos = ofs * 8 + shift;
+			if ( !(match & 1) || !IsBlockCandidate( bits >> shift, bitPos ) ) {
+				continue;
+			}
+			if ( IsCancelled( &c ) ) {
+				return 0;
+			}
+			if ( DecodeFrom( inf, buf, c, bitPos ) ) {
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+// any marker among count entries?
+static inline bool HasMarkers( const UShort *src, Int count )
+{
+	UShort acc = 0;
+	for ( Int i=0; i<count; i++ ) {
+		acc |= src[i];
+	}
+	return acc >= 256;
+}
+
+bool SpeculativeInflate::AtChunkEnd( const Inflate &inf, Chunk &c )
+{
+	if ( inf.IsEof() ) {
+		c.final = 1;
+		return 1;
+	}
+	c.final = 0;
+	return inf.state == Inflate::INF_STATE_BLOCK_HEADER && inf.inbit.GetBitPosition() >= inf.stopBit;
+}
+
+bool SpeculativeInflate::DecodeFrom( Inflate &inf, Array< UShort > &buf, Chunk &c, Long bitPos )
+{
+	const Int wsize = Inflate::WINDOW_SIZE;
+	// no ResetState here (too slow for false matches): dictionary isn't used until SetWindow
+	if ( !inf.inbit.SeekBits( bitPos ) ) {
+		return 0;
+	}
+	inf.state = Inflate::INF_STATE_BLOCK_HEADER;
+	inf.uncLen = 0;
+	inf.stopBit = c.beginBit + (Long)CHUNK_SIZE * 8;
+	// marker phase: until last window is free of markers (nothing can refer past it then)
+	Int used = 0;
+	bool end;
+	for (;;) {
+		Int need = used + MARKER_STEP + 258;
+		if ( buf.GetSize() < need ) {
+			buf.Resize( Max( need, 2 * buf.GetSize() ) );
+		}
+		inf.markerBase = buf.GetData();
+		inf.markerPtr = inf.markerBase + used;
+		if ( !inf.DecodeMarkers( MARKER_STEP ) ) {
+			return 0;
+		}
+		used = (Int)(inf.markerPtr - inf.markerBase);
+		end = AtChunkEnd( inf, c );
+		if ( end || (used >= wsize && !HasMarkers( buf.GetData() + used - wsize, wsize )) ) {
+			break;
+		}
+		if ( used > MAX_CHUNK_OUTPUT || IsCancelled( &c ) ) {
+			return 0;
+		}
+	}
+	// split into bytes and markers
+	// branchless: markers may persist through the whole chunk (text), with no predictable pattern
+	c.output.Resize( used );
+	c.markerPos.Resize( used );
+	c.markerRef.Resize( used );
+	Int numMarkers = 0;
+	if ( used > 0 ) {
+		const UShort *src = buf.GetData();
+		Byte *dst = c.output.GetData();
+		UInt *mpos = c.markerPos.GetData();
+		UShort *mref = c.markerRef.GetData();
+		for ( Int i=0; i<used; i++ ) {
+			UShort v = src[i];
+			dst[i] = (Byte)v;
+			mpos[ numMarkers ] = (UInt)i;
+			mref[ numMarkers ] = (UShort)(v - 256);
+			numMarkers += v >= 256;
+		}
+	}
+	c.markerPos.Resize( numMarkers );
+	c.markerRef.Resize( numMarkers );
+	if ( !end ) {
+		// byte phase: plain direct output with last window in dictionary
+		inf.SetWindow( c.output.GetData() + used - wsize, wsize );
+		for (;;) {
+			Int need = used + DECODE_STEP + 258 + 1 + Inflate::DICTIONARY_PAD;
+			if ( c.output.GetSize() < need ) {
+				c.output.Resize( Max( need, 2 * c.output.GetSize() ) );
+			}
+			Int count;
+			if ( !inf.DecodeDirect( c.output.GetData() + used, DECODE_STEP, count ) ) {
+				return 0;
+			}
+			used += count;
+			if ( AtChunkEnd( inf, c ) ) {
+				break;
+			}
+			if ( used > MAX_CHUNK_OUTPUT || IsCancelled( &c ) ) {
+				return 0;
+			}
+		}
+		c.output.Resize( used );
+	}
+	c.startBit = bitPos;
+	c.endBit = inf.inbit.GetBitPosition();
+	return 1;
+}
+
+}
@@ -0,0 +1,149 @@
+
+// (c) Martin Sedlak (mar) 2015
+// distributed under the Boost Software License, version 1.0
+// (see accompanying file License.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "Inflate.h"
+#include "../Base/Thread.h"
+
+namespace KwlKit
+{
+
+// speculative parallel decoder for a single large deflate stream in memory
+// input is split into chunks; workers look for a dynamic Huffman block header near the start of each chunk and
+// decode from there without knowing the preceding window: back-references before chunk start are kept as markers
+// and resolved once the previous chunk has been read
+// chunks that don't start exactly where the previous one ended (false header match, stored/fixed block at chunk
+// start) are decoded sequentially instead, so the output is always the same as that of Inflate
+// input must stay valid while reading (at most 2GB because of BitStream memory mode)
+class SpeculativeInflate : public NoCopy
+{
+public:
+	// pool = thread pool to use (null = create own pool with one thread per CPU)
+	SpeculativeInflate( const void *ndata, size_t nsize, InflateFormat fmt = INF_RAW, ThreadPool *npool = 0 );
+	~SpeculativeInflate();
+
+	// set Zip CRC for verification
+	inline void SetZipCrc( UInt zcrc ) {
+		seq.SetZipCrc( zcrc );
+	}
+
+	// skip checksums (see Inflate::SetTrusted)
+	inline void SetTrusted( bool enable ) {
+		seq.SetTrusted( enable );
+	}
+
+	bool Read( void *buf, Int count, Int &nread );
+	bool Rewind();
+
+	inline bool IsEof() const {
+		return !current && seq.IsEof();
+	}
+
+	// get current (uncompressed) read position
+	inline Long GetPosition() const {
+		return current ? outPos : seq.GetPosition();
+	}
+
+	// compressed chunk size per task
+	static const Int CHUNK_SIZE;
+	// smaller inputs are better decoded sequentially
+	static const Long MIN_INPUT_SIZE;
+	// minimum threads (pool workers + reader); speculative decoding costs several times more CPU than sequential,
+	// so with fewer threads it's slower than Inflate
+	static const Int MIN_THREADS;
+
+private:
+	enum ChunkStatus
+	{
+		CHUNK_PENDING,
+		CHUNK_OK,
+		CHUNK_FAILED
+	};
+
+	struct Chunk
+	{
+		SpeculativeInflate *owner;
+		Long beginBit;			// block search starts here
+		Long startBit;			// first block decoded
+		Long endBit;			// first block boundary at or past next chunk (or end of final block)
+		bool final;				// final block decoded
+		Array< Byte > output;	// decoded bytes, markers not resolved yet
+		Array< UInt > markerPos;
+		Array< UShort > markerRef;	// window index
+		ChunkStatus status;		// guarded by owner mutex
+		bool cancelled;			// guarded by owner mutex
+	};
+
+	const Byte *data;
+	size_t size;
+	ThreadPool *pool;
+	ThreadPool *ownPool;
+
+	// chunks scheduled for decoding, in input order
+	Array< Chunk * > queue;
+	Int queueHead;
+	Int nextChunk;
+	Int numChunks;
+	// don't schedule chunks starting at or before this bit position
+	Long skipBit;
+
+	Mutex mutex;
+	CondVar done;
+
+	// chunk being read
+	Chunk *current;
+	Int currentOfs;
+	// sequential decoder (stream start, trailer and chunks that don't line up)
+	Inflate seq;
+	// last Inflate::WINDOW_SIZE bytes of output preceding current chunk
+	Array< Byte > window;
+	// state while reading chunks (taken from and passed back to seq)
+	Long outPos;
+	Long memberOffset;
+	UInt crc;
+	bool error;
+
+	static inline Long ChunkBit( Int index ) {
+		return (Long)index * CHUNK_SIZE * 8;
+	}
+
+	// queue chunks for decoding
+	void Schedule();
+	// wait until chunk is decoded
+	void Wait( Chunk *c );
+	// remove first queued chunk
+	Chunk *PopChunk();
+	// cancel, wait for and free queued chunks starting at or before bit position
+	void DropChunks( Long bitPos );
+	bool IsCancelled( Chunk *c );
+	// continue with decoded chunk starting at bit position (block boundary), otherwise sets seq stop position
+	bool NextChunk( Long bitPos );
+	// current chunk read => continue with next one or sequential decoding
+	void FinishChunk();
+	// restart sequential decoder at block boundary (or at end of final block)
+	void StartSequential( Long bitPos, bool finalize );
+	void UpdateWindow( const Chunk &c );
+	void ResolveMarkers( Chunk &c );
+
+	// worker side
+	static void DecodeChunk( void *param );
+	bool FindAndDecode( Chunk &c );
+	bool DecodeFrom( Inflate &inf, Array< UShort > &buf, Chunk &c, Long bitPos );
+	// paused past chunk end or final block done?
+	static bool AtChunkEnd( const Inflate &inf, Chunk &c );
+	// quick check for dynamic Huffman block header
+	inline bool IsBlockCandidate( ULong bits, Long bitPos ) const;
+	// code length code Kraft sums for 4 lengths
+	UShort kraftTable[4096];
+
+	// constants (for unity build)
+	static const Int MAX_CHUNK_OUTPUT;
+	static const Int DECODE_STEP;
+	static const Int MARKER_STEP;
+	static const Int SEARCH_SIZE;
+};
+
+}
@@ -0,0 +1,530 @@
+
+// (c) Martin Sedlak (mar) 2015
+// distributed under the Boost Software License, version 1.0
+// (see accompanying file License.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "ZipArchive.h"
+#include "Crc32.h"
+#include "../Base/Memory.h"
+#include "../Base/Limits.h"
+#include "../Base/Templates.h"
+
+namespace KwlKit
+{
+
+const Long ZipArchive::MAX_BATCH_TASK_SIZE = 1 << 20;
+const Long ZipArchive::BATCH_ENTRY_COST = 1024;
+
+static inline UInt ZipRead16( const Byte *p )
+{
+	return (UInt)p[0] | ((UInt)p[1] << 8);
+}
+
+static inline UInt ZipRead32( const Byte *p )
+{
+	return (UInt)p[0] | ((UInt)p[1] << 8) | ((UInt)p[2] << 16) | ((UInt)p[3] << 24);
+}
+
+static inline ULong ZipRead64( const Byte *p )
+{
+	return (ULong)ZipRead32( p ) | ((ULong)ZipRead32( p + 4 ) << 32);
+}
+
+// ZipArchive
+
+ZipArchive::ZipArchive() : data( 0 ), size( 0 ), bias( 0 ), ownPool( 0 )
+{
+}
+
+ZipArchive::~ZipArchive()
+{
+	Close();
+	delete ownPool;
+}
+
+bool ZipArchive::Open( const char *filename )
+{
+	Close();
+	if ( !file.Open( filename ) ) {
+		return 0;
+	}
+	data = file.GetData();
+	size = file.GetSize();
+	if ( !ReadDirectory() ) {
+		Close();
+		return 0;
+	}
+	return 1;
+}
+
+bool ZipArchive::OpenMemory( const void *ndata, size_t nsize )
+{
+	KWLKIT_ASSERT( ndata || !nsize );
+	Close();
+	data = static_cast<const Byte *>(ndata);
+	size = nsize;
+	if ( !ReadDirectory() ) {
+		Close();
+		return 0;
+	}
+	return 1;
+}
+
+void ZipArchive::Close()
+{
+	entries.Clear();
+	table.Clear();
+	file.Close();
+	data = 0;
+	size = 0;
+	bias = 0;
+}
+
+UInt ZipArchive::HashName( const char *name, Int len )
+{
+	// FNV-1a
+	UInt h = 2166136261u;
+	for ( Int i=0; i<len; i++ ) {
+		h ^= (Byte)name[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+bool ZipArchive::ReadDirectory()
+{
+	// end of central directory record, followed by comment (up to 64k)
+	if ( size < 22 ) {
+		return 0;
+	}
+	size_t minPos = size > 65535 + 22 ? size - 65535 - 22 : 0;
+	size_t eocd = size - 22;
+	for (;;) {
+		const Byte *p = data + eocd;
+		if ( ZipRead32( p ) == 0x06054b50 && ZipRead16( p + 20 ) <= size - eocd - 22 ) {
+			break;
+		}
+		if ( eocd == minPos ) {
+			return 0;
+		}
+		eocd--;
+	}
+	const Byte *p = data + eocd;
+	ULong numEntries = ZipRead16( p + 10 );
+	ULong cdSize = ZipRead32( p + 12 );
+	ULong cdOffset = ZipRead32( p + 16 );
+	ULong cdEnd = eocd;
+
+	// Zip64 end of central directory locator
+	if ( eocd >= 20 && ZipRead32( p - 20 ) == 0x07064b50 ) {
+		ULong z64 = ZipRead64( p - 20 + 8 );
+		// record offset is relative to archive start, but it immediately precedes the locator
+		if ( eocd < 20 + 56 ) {
+			return 0;
+		}
+		ULong z64Pos = eocd - 20 - 56;
+		if ( ZipRead32( data + z64Pos ) != 0x06064b50 ) {
+			// record with extensible data
+			if ( z64 >= size || size - z64 < 56 || ZipRead32( data + z64 ) != 0x06064b50 ) {
+				return 0;
+			}
+			z64Pos = z64;
+		}
+		const Byte *q = data + z64Pos;
+		numEntries = ZipRead64( q + 32 );
+		cdSize = ZipRead64( q + 40 );
+		cdOffset = ZipRead64( q + 48 );
+		cdEnd = z64Pos;
+	}
+
+	// central directory immediately precedes end records => data prepended to archive
+	if ( cdSize > cdEnd || cdEnd - cdSize < cdOffset ) {
+		return 0;
+	}
+	bias = cdEnd - cdSize - cdOffset;
+	if ( numEntries > cdSize / 46 ) {
+		return 0;
+	}
+
+	entries.Resize( (Int)numEntries );
+	const Byte *c = data + bias + cdOffset;
+	const Byte *cend = c + cdSize;
+
+	for ( Int i=0; i<entries.GetSize(); i++ ) {
+		if ( cend - c < 46 || ZipRead32( c ) != 0x02014b50 ) {
+			return 0;
+		}
+		Int nameLen = (Int)ZipRead16( c + 28 );
+		Int extraLen = (Int)ZipRead16( c + 30 );
+		Int commentLen = (Int)ZipRead16( c + 32 );
+		if ( cend - c < 46 + nameLen + extraLen + commentLen ) {
+			return 0;
+		}
+		Entry &e = entries[i];
+		e.name = reinterpret_cast<const char *>(c + 46);
+		e.nameLen = nameLen;
+		e.hash = HashName( e.name, nameLen );
+		e.flags = (UShort)ZipRead16( c + 8 );
+		e.method = (UShort)ZipRead16( c + 10 );
+		e.crc = ZipRead32( c + 16 );
+		ULong compSize = ZipRead32( c + 20 );
+		ULong usize = ZipRead32( c + 24 );
+		ULong localOffset = ZipRead32( c + 42 );
+
+		// Zip64 extended information (only fields saturated in the header are present, in fixed order)
+		if ( usize == 0xffffffffu || compSize == 0xffffffffu || localOffset == 0xffffffffu ) {
+			const Byte *x = c + 46 + nameLen;
+			const Byte *xend = x + extraLen;
+			while ( xend - x >= 4 ) {
+				UInt id = ZipRead16( x );
+				Int len = (Int)ZipRead16( x + 2 );
+				x += 4;
+				if ( xend - x < len ) {
+					break;
+				}
+				if ( id == 1 ) {
+					const Byte *f = x;
+					const Byte *fend = x + len;
+					if ( usize == 0xffffffffu && fend - f >= 8 ) {
+						usize = ZipRead64( f );
+						f += 8;
+					}
+					if ( compSize == 0xffffffffu && fend - f >= 8 ) {
+						compSize = ZipRead64( f );
+						f += 8;
+					}
+					if ( localOffset == 0xffffffffu && fend - f >= 8 ) {
+						localOffset = ZipRead64( f );
+					}
+					break;
+				}
+				x += len;
+			}
+		}
+		if ( (Long)usize < 0 || (Long)compSize < 0 || (Long)localOffset < 0 ) {
+			return 0;
+		}
+		e.size = (Long)usize;
+		e.compSize = (Long)compSize;
+		e.localOffset = (Long)localOffset;
+
+		c += 46 + nameLen + extraLen + commentLen;
+	}
+
+	// hash table, load factor at most 1/2
+	Int capacity = 16;
+	while ( capacity < 2*entries.GetSize() ) {
+		capacity *= 2;
+	}
+	table.Resize( capacity );
+	table.MemSet( 0 );
+	UInt mask = (UInt)capacity - 1;
+	for ( Int i=0; i<entries.GetSize(); i++ ) {
+		UInt slot = entries[i].hash & mask;
+		while ( table[slot] ) {
+			slot = (slot + 1) & mask;
+		}
+		table[slot] = i+1;
+	}
+	return 1;
+}
+
+Int ZipArchive::Find( const char *path ) const
+{
+	KWLKIT_ASSERT( path );
+	return Find( path, (Int)strlen( path ) );
+}
+
+Int ZipArchive::Find( const char *path, Int len ) const
+{
+	KWLKIT_ASSERT( path || !len );
+	if ( table.IsEmpty() ) {
+		return -1;
+	}
+	UInt h = HashName( path, len );
+	UInt mask = (UInt)table.GetSize() - 1;
+	for ( UInt slot = h & mask;; slot = (slot + 1) & mask ) {
+		Int idx = table[slot];
+		if ( !idx ) {
+			return -1;
+		}
+		const Entry &e = entries[idx-1];
+		if ( e.hash == h && e.nameLen == len && !MemCmp( e.name, path, (size_t)len ) ) {
+			return idx-1;
+		}
+	}
+}
+
+String ZipArchive::GetName( Int index ) const
+{
+	const Entry &e = entries[index];
+	String res;
+	res.assign( e.name, (size_t)e.nameLen );
+	return res;
+}
+
+Long ZipArchive::GetSize( Int index ) const
+{
+	return entries[index].size;
+}
+
+Long ZipArchive::GetCompressedSize( Int index ) const
+{
+	return entries[index].compSize;
+}
+
+UInt ZipArchive::GetCrc( Int index ) const
+{
+	return entries[index].crc;
+}
+
+bool ZipArchive::IsDirectory( Int index ) const
+{
+	const Entry &e = entries[index];
+	return e.nameLen > 0 && e.name[e.nameLen-1] == '/';
+}
+
+bool ZipArchive::GetEntryData( Int index, const Byte *&ptr ) const
+{
+	const Entry &e = entries[index];
+	// encrypted or unsupported method
+	if ( (e.flags & 1) || (e.method != 0 && e.method != 8) ) {
+		return 0;
+	}
+	if ( !e.method && e.size != e.compSize ) {
+		return 0;
+	}
+	// local header: name and extra field may differ from central directory
+	ULong ofs = bias + (ULong)e.localOffset;
+	if ( ofs >= size || size - ofs < 30 || ZipRead32( data + ofs ) != 0x04034b50 ) {
+		return 0;
+	}
+	ofs += 30 + ZipRead16( data + ofs + 26 ) + ZipRead16( data + ofs + 28 );
+	if ( ofs > size || (ULong)e.compSize > size - ofs ) {
+		return 0;
+	}
+	ptr = data + ofs;
+	return 1;
+}
+
+bool ZipArchive::Extract( Int index, void *dst, size_t dstSize ) const
+{
+	KWLKIT_ASSERT( index >= 0 && index < entries.GetSize() );
+	const Entry &e = entries[index];
+	const Byte *src;
+	if ( !GetEntryData( index, src ) || (ULong)e.size > (ULong)dstSize ) {
+		return 0;
+	}
+	if ( !e.size && !e.method ) {
+		return !e.crc;
+	}
+	KWLKIT_ASSERT( dst || !e.size );
+	if ( !e.method ) {
+		MemCpy( dst, src, (size_t)e.size );
+		return GetCrc32( dst, (size_t)e.size ) == e.crc;
+	}
+	Byte dummy;
+	size_t outSize;
+	return InflateBuffer( src, (size_t)e.compSize, e.size ? dst : &dummy, (size_t)e.size, INF_ZIP, &outSize, e.crc ) &&
+		outSize == (size_t)e.size;
+}
+
+bool ZipArchive::Extract( Int index, Array< Byte > &dst ) const
+{
+	KWLKIT_ASSERT( index >= 0 && index < entries.GetSize() );
+	Long sz = entries[index].size;
+	if ( sz > Limits<Int>::MAX ) {
+		dst.Clear();
+		return 0;
+	}
+	dst.Resize( (Int)sz );
+	return Extract( index, sz ? dst.GetData() : 0, (size_t)sz );
+}
+
+void ZipArchive::BatchWorker( void *param )
+{
+	BatchTask *t = static_cast<BatchTask *>(param);
+	bool ok = 1;
+	for ( Int i=0; i<t->count; i++ ) {
+		Int index = t->indices[i];
+		bool res = index >= 0 && index < t->owner->GetNumEntries() && t->owner->Extract( index, t->outputs[i] );
+		if ( t->results ) {
+			t->results[i] = res;
+		}
+		ok &= res;
+	}
+	MutexLock lock( t->state->mutex );
+	t->ok = ok;
+	if ( !--t->state->pending ) {
+		t->state->done.Broadcast();
+	}
+}
+
+bool ZipArchive::ExtractBatch( const Int *indices, Int count, Array< Byte > *outputs, bool *results, ThreadPool *pool )
+{
+	KWLKIT_ASSERT( count >= 0 && ((indices && outputs) || !count) );
+	if ( !count ) {
+		return 1;
+	}
+	if ( !pool ) {
+		MutexLock lock( poolMutex );
+		if ( !ownPool ) {
+			ownPool = new ThreadPool;
+		}
+		pool = ownPool;
+	}
+
+	// group entries into tasks so that many small entries don't pay per-task overhead, but keep enough tasks
+	// per thread to balance the load
+	Long total = 0;
+	for ( Int i=0; i<count; i++ ) {
+		Int index = indices[i];
+		if ( index >= 0 && index < entries.GetSize() ) {
+			total += entries[index].size;
+		}
+		total += BATCH_ENTRY_COST;
+	}
+	Long taskLimit = Min( MAX_BATCH_TASK_SIZE, total / (4 * (Long)Max( pool->GetThreadCount(), 1 )) );
+
+	BatchState state;
+	state.pending = 0;
+	Array< BatchTask > tasks;
+	Long taskSize = 0;
+	Int start = 0;
+	for ( Int i=0; i<count; i++ ) {
+		Int index = indices[i];
+		if ( index >= 0 && index < entries.GetSize() ) {
+			taskSize += entries[index].size;
+		}
+		taskSize += BATCH_ENTRY_COST;
+		if ( taskSize < taskLimit && i+1 < count ) {
+			continue;
+		}
+		BatchTask t;
+		t.owner = this;
+		t.state = &state;
+		t.indices = indices + start;
+		t.outputs = outputs + start;
+		t.results = results ? results + start : 0;
+		t.count = i+1 - start;
+		t.ok = 0;
+		tasks.Add( t );
+		start = i+1;
+		taskSize = 0;
+	}
+
+	// tasks array must not be touched until all tasks are done
+	state.pending = tasks.GetSize();
+	for ( Int i=0; i<tasks.GetSize(); i++ ) {
+		pool->Submit( BatchWorker, &tasks[i] );
+	}
+
+	bool ok = 1;
+	MutexLock lock( state.mutex );
+	while ( state.pending ) {
+		state.done.Wait( state.mutex );
+	}
+	for ( Int i=0; i<tasks.GetSize(); i++ ) {
+		ok &= tasks[i].ok;
+	}
+	return ok;
+}
+
+// ZipEntryStream
+
+ZipEntryStream::ZipEntryStream()
+	: stored( 0 )
+	, valid( 0 )
+	, checkCrc( 0 )
+	, expectedCrc( 0 )
+	, crc( 0 )
+	, size( 0 )
+	, pos( 0 )
+{
+}
+
+ZipEntryStream::ZipEntryStream( const ZipArchive &archive, Int index )
+	: stored( 0 )
+	, valid( 0 )
+	, checkCrc( 0 )
+	, expectedCrc( 0 )
+	, crc( 0 )
+	, size( 0 )
+	, pos( 0 )
+{
+	Open( archive, index );
+}
+
+bool ZipEntryStream::Open( const ZipArchive &archive, Int index )
+{
+	valid = 0;
+	const Byte *src;
+	if ( index < 0 || index >= archive.GetNumEntries() || !archive.GetEntryData( index, src ) ) {
+		return 0;
+	}
+	const ZipArchive::Entry &e = archive.entries[index];
+	mem.SetData( src, (size_t)e.compSize );
+	stored = !e.method;
+	expectedCrc = e.crc;
+	size = e.size;
+	if ( !stored ) {
+		// Inflate verifies CRC at end of stream
+		infl.SetStream( mem, 0 );
+		infl.SetFormat( INF_ZIP );
+		infl.SetZipCrc( e.crc );
+	}
+	valid = 1;
+	return Rewind();
+}
+
+bool ZipEntryStream::Read( void *buf, Int count, Int &nread )
+{
+	nread = 0;
+	if ( !valid ) {
+		return 0;
+	}
+	if ( stored ) {
+		if ( !mem.Read( buf, count, nread ) ) {
+			return 0;
+		}
+		crc = GetCrc32( buf, (size_t)nread, crc );
+	} else if ( !infl.Read( buf, count, nread ) ) {
+		return 0;
+	}
+	pos += nread;
+	if ( pos > size ) {
+		return 0;
+	}
+	// end of entry: stored data must match CRC, deflated data must match size
+	if ( nread < count ) {
+		return pos == size && (!stored || !checkCrc || crc == expectedCrc);
+	}
+	return !stored || !checkCrc || pos < size || crc == expectedCrc;
+}
+
+bool ZipEntryStream::Rewind()
+{
+	pos = 0;
+	crc = CRC32_INIT;
+	checkCrc = 1;
+	if ( !valid ) {
+		return 0;
+	}
+	return stored ? mem.Rewind() : infl.Rewind();
+}
+
+bool ZipEntryStream::Seek( Long npos )
+{
+	if ( !valid || npos < 0 || npos > size ) {
+		return 0;
+	}
+	if ( !npos ) {
+		return Rewind();
+	}
+	pos = npos;
+	crc = CRC32_INIT;
+	checkCrc = 0;
+	return stored ? mem.Seek( npos ) : infl.Seek( npos );
+}
+
+}
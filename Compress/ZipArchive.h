@@ -0,0 +1,150 @@
+
+// (c) Martin Sedlak (mar) 2015
+// distributed under the Boost Software License, version 1.0
+// (see accompanying file License.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "InflateStream.h"
+#include "../Base/MappedFile.h"
+#include "../Base/MemoryStream.h"
+#include "../Base/Thread.h"
+#include "../Base/String.h"
+
+namespace KwlKit
+{
+
+// read-only Zip archive (stored and deflated entries, Zip64)
+// central directory is indexed by a hash table so that Find is O(1); entry names are not copied
+// (they point into the archive) so the archive must stay open while entries are used
+// Find/Extract may be called from multiple threads
+class ZipArchive : public NoCopy
+{
+public:
+	ZipArchive();
+	~ZipArchive();
+
+	// open archive file (memory mapped)
+	bool Open( const char *filename );
+	// open archive in memory (must stay valid while the archive is open)
+	bool OpenMemory( const void *ndata, size_t nsize );
+	void Close();
+
+	inline Int GetNumEntries() const {
+		return entries.GetSize();
+	}
+
+	// find entry by path (case sensitive, '/' separators as stored in archive), returns -1 if not found
+	Int Find( const char *path ) const;
+	Int Find( const char *path, Int len ) const;
+
+	String GetName( Int index ) const;
+	// uncompressed size
+	Long GetSize( Int index ) const;
+	Long GetCompressedSize( Int index ) const;
+	UInt GetCrc( Int index ) const;
+	bool IsDirectory( Int index ) const;
+
+	// decompress whole entry into dst (dstSize must be at least GetSize), verifies CRC
+	bool Extract( Int index, void *dst, size_t dstSize ) const;
+	bool Extract( Int index, Array< Byte > &dst ) const;
+
+	// decompress entries on a thread pool (pool = null => own pool with one thread per CPU)
+	// outputs[i] receives entry indices[i], results (optional) receives per-entry success
+	// returns 1 if all entries were extracted successfully
+	bool ExtractBatch( const Int *indices, Int count, Array< Byte > *outputs, bool *results = 0,
+		ThreadPool *pool = 0 );
+
+private:
+	friend class ZipEntryStream;
+
+	struct Entry
+	{
+		const char *name;	// not zero-terminated
+		Int nameLen;
+		UInt hash;
+		UInt crc;
+		UShort method;
+		UShort flags;
+		Long size;
+		Long compSize;
+		Long localOffset;
+	};
+
+	// batch completion
+	struct BatchState
+	{
+		Mutex mutex;
+		CondVar done;
+		Int pending;
+	};
+
+	// batch task: contiguous range of batch entries
+	struct BatchTask
+	{
+		const ZipArchive *owner;
+		BatchState *state;
+		const Int *indices;
+		Array< Byte > *outputs;
+		bool *results;
+		Int count;
+		bool ok;
+	};
+
+	MappedFile file;
+	const Byte *data;
+	size_t size;
+	// offset of archive start (non-zero if data is prepended, e.g. self-extracting archives)
+	ULong bias;
+	Array< Entry > entries;
+	// open addressing hash table: entry index + 1 (0 = empty)
+	Array< Int > table;
+	ThreadPool *ownPool;
+	Mutex poolMutex;
+
+	bool ReadDirectory();
+	static UInt HashName( const char *name, Int len );
+	// get entry data (compressed), fails for unsupported entries (encrypted, unknown method)
+	bool GetEntryData( Int index, const Byte *&ptr ) const;
+
+	static void BatchWorker( void *param );
+
+	// constants (for unity build)
+	static const Long MAX_BATCH_TASK_SIZE;
+	static const Long BATCH_ENTRY_COST;
+};
+
+// stream over a single archive entry (decompressed, CRC verified at end of entry)
+// object can be reused for other entries to avoid reallocations
+class ZipEntryStream : public Stream
+{
+public:
+	KWLKIT_INJECT_STREAM()
+
+	ZipEntryStream();
+	ZipEntryStream( const ZipArchive &archive, Int index );
+
+	bool Open( const ZipArchive &archive, Int index );
+
+	bool Read( void *buf, Int count, Int &nread );
+	bool Rewind();
+	// stored entries seek directly (CRC is only verified when read from start), deflated entries decode from start
+	bool Seek( Long npos );
+
+	inline Long GetSize() const {
+		return size;
+	}
+
+private:
+	MemoryStream mem;
+	InflateStream infl;
+	bool stored;
+	bool valid;
+	bool checkCrc;
+	UInt expectedCrc;
+	UInt crc;
+	Long size;
+	Long pos;
+};
+
+}
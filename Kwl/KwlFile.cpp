@@ -12,6 +12,7 @@
 #include "../Mdct/DspWindows.h"
 
 #include "../Compress/InflateStream.h"
+#include "../Compress/InflatePool.h"
 
 #include "../Sample/SampleFormat.h"
 #include "../Sample/SampleUtil.h"
@@ -40,12 +41,14 @@ void KwlFile::Header::FromLittle()
 static const Float KWL_POW_SCL = 0.2f;
 
 KwlFile::KwlFile() : stream(0), ownedStream(0), powScl(KWL_POW_SCL), remSamples(0),
-	outMdct(0), inflate(0), outBuffPtr(0), outBase(0), outXor(0), mdctNorm(0) {
+	outMdct(0), inflate(0), inflatePool(0), inflateOwner(0), profile(0), outBuffPtr(0), outBase(0), outXor(0), outBlockSize(0), decodeShift(0), outShift(0), outChannels(0), decodeMono(0), mdctNorm(0), mdctBlockSize(0) {
 	MemSet( &hdr, 0, sizeof(hdr) );
 }
 
 KwlFile::~KwlFile() {
 	Close();
+	delete outMdct;
+	delete inflate;
 }
 
 // open for reading
@@ -59,6 +62,26 @@ bool KwlFile::Open( Stream &s, bool owned )
 	return ParseHeader();
 }
 
+bool KwlFile::SetDecodeScale( Int scale )
+{
+	KWLKIT_RET_FALSE( scale >= DECODE_SCALE_FULL && scale <= DECODE_SCALE_QUARTER );
+	decodeShift = scale;
+	return 1;
+}
+
+void KwlFile::SetDecodeMono( bool mono )
+{
+	decodeMono = mono;
+}
+
+void KwlFile::SetProfileStats( ProfileStats *stats )
+{
+	profile = stats;
+	if ( inflate ) {
+		inflate->GetInflate().SetProfileStats( stats );
+	}
+}
+
 bool KwlFile::ParseHeader()
 {
 	KWLKIT_ASSERT( stream );
@@ -69,38 +92,55 @@ bool KwlFile::ParseHeader()
 	KWLKIT_RET_FALSE( hdr.blockSize && (1 << Log2Size((Int)hdr.blockSize)) == hdr.blockSize );
 	KWLKIT_RET_FALSE( hdr.numChannels > 0 );
 	KWLKIT_RET_FALSE( hdr.sampleRate > 0 );
+	// reduced rate decoding: only keep low part of the spectrum and run a shorter iMDCT
+	// (never go below 32 coefficients per block)
+	outShift = decodeShift;
+	while ( outShift > 0 && (hdr.blockSize >> outShift) < 32 ) {
+		outShift--;
+	}
+	outBlockSize = (Int)hdr.blockSize >> outShift;
 	if ( hdr.flags & KWL_NORMALIZED ) {
-		remSamples = hdr.numSamples;
+		remSamples = (hdr.numSamples + ((ULong)1 << outShift) - 1) >> outShift;
 	}
 	// TODO: check all parameters for validity
 	outQBuffer.Resize( hdr.blockSize );
 	bool old = !(hdr.flags & KWL_NORMALIZED);
-	if ( !outMdct || (outMdct->GetN() != hdr.blockSize*2 || mdctNorm == old) ) {
+	// outMdct is kept across Close/Open: scales depend on full block size too
+	if ( !outMdct || outMdct->GetN() != outBlockSize*2 || mdctNorm == old || mdctBlockSize != (Int)hdr.blockSize ) {
+		// note: scales are always based on full block size; normalized coefficients don't depend on block size
+		// and old mode postscale compensates for full-size forward transform
 		Float two_n = 2.0f / (hdr.blockSize*2);
 		delete outMdct;
-		outMdct = new Mdct<Float>( hdr.blockSize*2, old ? 1.0f : 2.0f*two_n, old ? two_n : 0.5f );
+		outMdct = new Mdct<Float>( outBlockSize*2, old ? 1.0f : 2.0f*two_n, old ? two_n : 0.5f );
 		mdctNorm = !old;
+		mdctBlockSize = (Int)hdr.blockSize;
 	}
 	outMdct->SetWindowFunc( VorbisWindow );
 
-	Int channels = hdr.numChannels;
-	outFloatBuf.Resize( (Int)hdr.numChannels * hdr.blockSize * 4 );
+	outChannels = decodeMono ? 1 : (Int)hdr.numChannels;
+	Int channels = outChannels;
+	outFloatBuf.Resize( channels * outBlockSize * 4 );
 
-	outBase = outXor = (Int)hdr.blockSize * 2;
+	outBase = outXor = outBlockSize * 2;
 
-	outMdctBuf.Resize( hdr.blockSize );
+	outMdctBuf.Resize( outBlockSize );
 	outFloatBuf.MemSet( 0 );
 	outMdctBuf.MemSet( 0 );
-	finalOut.Resize( channels * hdr.blockSize );
+	finalOut.Resize( channels * outBlockSize );
 	finalOut.MemSet( 0 );
 
-	if ( !inflate ) {
-		inflate = new InflateStream;
+	// compressed data starts right after header
+	if ( !inflate && inflatePool ) {
+		inflate = inflatePool->Acquire( *stream, INF_ZLIB );
+		KWLKIT_RET_FALSE( inflate );
+		inflateOwner = inflatePool;
+	} else {
+		if ( !inflate ) {
+			inflate = new InflateStream;
+		}
+		KWLKIT_RET_FALSE( inflate->Reset( *stream, INF_ZLIB ) );
 	}
-	KWLKIT_RET_FALSE( inflate->SetStream( *stream, 0 ) );
-	inflate->SetFormat( INF_ZLIB );
-	inflate->Rewind();
-	inflate->GetInflate().GetStream().GetStream()->SkipRead( sizeof(Header) );
+	inflate->GetInflate().SetProfileStats( profile );
 
 	powScl = KWL_POW_SCL;
 	if (hdr.powScl) {
@@ -112,7 +152,7 @@ bool KwlFile::ParseHeader()
 		// prime output
 		KWLKIT_RET_FALSE( DecompressFrame() );
 	}
-	outBuffPtr = hdr.blockSize;
+	outBuffPtr = outBlockSize;
 
 	return 1;
 }
@@ -123,10 +163,14 @@ bool KwlFile::Close()
 		return 1;
 	}
 	bool res = 1;
-	delete outMdct;
-	outMdct = 0;
-	delete inflate;
-	inflate = 0;
+	// keep iMDCT and decoder storage for next Open
+	if ( inflateOwner ) {
+		inflateOwner->Release( inflate );
+		inflate = 0;
+		inflateOwner = 0;
+	} else if ( inflate ) {
+		inflate->Detach();
+	}
 	stream = 0;
 	delete ownedStream;
 	ownedStream = 0;
@@ -137,7 +181,7 @@ bool KwlFile::Close()
 void KwlFile::ResetState()
 {
 	remSamples = 0;
-	outBuffPtr = hdr.blockSize;
+	outBuffPtr = outBlockSize;
 	outFloatBuf.MemSet( 0 );
 	outMdctBuf.MemSet( 0 );
 }
@@ -158,22 +202,43 @@ bool KwlFile::ReadFloat( Stream &s, Float &f ) const
 
 bool KwlFile::DecompressFrame()
 {
+	// downmix: transform is linear so we can average coefficients and only do one iMDCT
+	bool downmix = outChannels < hdr.numChannels;
+	Float dmScale = 1.0f / hdr.numChannels;
 	for ( Int i=0; i<hdr.numChannels; i++ ) {
 		Float scl;
 		KWLKIT_RET_FALSE( ReadFloat(*inflate, scl) );
 		Int delta = (hdr.flags & KWL_DC_OFFSET) != 0;
 		outQBuffer[0] = 0;
 		KWLKIT_RET_FALSE( inflate->Read( outQBuffer.GetData()+delta, outQBuffer.GetSize()-delta ) );
-		Decompress( outQBuffer.GetData(),
-			outMdctBuf.GetData(), hdr.blockSize, scl );
+		if ( downmix ) {
+			scl *= dmScale;
+		}
+		if ( downmix && i > 0 ) {
+			DecompressAdd( outQBuffer.GetData() + delta,
+				outMdctBuf.GetData() + delta, outBlockSize - delta, scl );
+		} else {
+			Decompress( outQBuffer.GetData(),
+				outMdctBuf.GetData(), outBlockSize, scl );
+		}
 		if ( hdr.flags & KWL_DC_OFFSET ) {
-			KWLKIT_RET_FALSE( ReadFloat(*inflate, outMdctBuf[0] ) );
+			Float dc;
+			KWLKIT_RET_FALSE( ReadFloat(*inflate, dc ) );
+			if ( downmix ) {
+				dc *= dmScale;
+				if ( i > 0 ) {
+					dc += outMdctBuf[0];
+				}
+			}
+			outMdctBuf[0] = dc;
 		}
-		outMdct->DoIMdct( outMdctBuf.GetData(),
-			outFloatBuf.GetData() + 4*i*hdr.blockSize + outBase
-		);
-		outMdct->OverlapAdd( outFloatBuf.GetData() + 4*i*hdr.blockSize + (outBase ^ outXor),
-			outFloatBuf.GetData() + 4*i*hdr.blockSize + outBase, finalOut.GetData() + i*hdr.blockSize );
+		if ( downmix ) {
+			continue;
+		}
+		DecodeChannel( i );
+	}
+	if ( downmix ) {
+		DecodeChannel( 0 );
 	}
 	// shift buffers
 	outBase ^= outXor;
@@ -181,6 +246,19 @@ bool KwlFile::DecompressFrame()
 	return 1;
 }
 
+void KwlFile::DecodeChannel( Int ch )
+{
+	{
+		KWLKIT_PROFILE_SCOPE( profile, PROFILE_IMDCT );
+		outMdct->DoIMdct( outMdctBuf.GetData(),
+			outFloatBuf.GetData() + 4*ch*outBlockSize + outBase
+		);
+	}
+	KWLKIT_PROFILE_SCOPE( profile, PROFILE_OVERLAP_ADD );
+	outMdct->OverlapAdd( outFloatBuf.GetData() + 4*ch*outBlockSize + (outBase ^ outXor),
+		outFloatBuf.GetData() + 4*ch*outBlockSize + outBase, finalOut.GetData() + ch*outBlockSize );
+}
+
 template<typename T>
 struct ConvSampleFromFloat
 {
@@ -205,9 +283,10 @@ struct ConvSampleFromFloat<Float>
 template< typename T >
 void KwlFile::ConvSamplesFastPath( Int minChan, Int numChannels, Int rem, Int dstBps, Byte *&bout )
 {
+	KWLKIT_PROFILE_SCOPE( profile, PROFILE_CONV_SAMPLES );
 	Int j;
 	for ( j=0; j<minChan; j++ ) {
-		const Float *src = finalOut.GetData() + j * hdr.blockSize + outBuffPtr;
+		const Float *src = finalOut.GetData() + j * outBlockSize + outBuffPtr;
 		T *dst = CastTo<T *>(bout) + j;
 		for ( Int i=0; i<rem; i++ ) {
 			*dst = ConvSampleFromFloat<T>::Convert(*src++);
@@ -246,17 +325,17 @@ bool KwlFile::ReadSamples( void *buf, Int numSamples, Int numChannels, Int &numS
 	if ( KWLKIT_UNLIKELY( !buf ) ) {
 		return 0;
 	}
-	Int minChan = Min( (Int)hdr.numChannels, numChannels );
+	Int minChan = Min( outChannels, numChannels );
 	Byte *bout = (Byte *)buf;
 	Int dstBps = (samFormat & SAMPLE_FORMAT_SIZE_MASK) * numChannels;
 	while ( numSamples > 0 ) {
-		Int rem = hdr.blockSize - outBuffPtr;
+		Int rem = outBlockSize - outBuffPtr;
 		if ( KWLKIT_UNLIKELY( rem <= 0 ) ) {
 			bool res = DecompressFrame();
 			if ( !res ) {
 				break;
 			}
-			rem = hdr.blockSize;
+			rem = outBlockSize;
 		}
 		rem = Min( rem, numSamples );
 		numSamplesRead += rem;
@@ -279,7 +358,7 @@ bool KwlFile::ReadSamples( void *buf, Int numSamples, Int numChannels, Int &numS
 			Int j;
 			Float unpSam[ 256 ];
 			for ( j=0; j<minChan; j++ ) {
-				unpSam[ j ] = finalOut[ j * hdr.blockSize + outBuffPtr ];
+				unpSam[ j ] = finalOut[ j * outBlockSize + outBuffPtr ];
 			}
 			for ( ; j < numChannels; j++ ) {
 				// handle mono=>stereo expansion
@@ -302,12 +381,22 @@ bool KwlFile::ReadSamples( void *buf, Int numSamples, Int numChannels, Int &numS
 
 void KwlFile::Decompress( const Byte *qbuf, Float *buf, Int size, Float scl )
 {
+	KWLKIT_PROFILE_SCOPE( profile, PROFILE_DEQUANT );
 	Int msk = (1 << hdr.quantBits)-1;
 	for ( Int i=0; i<size; i++ ) {
 		buf[i] = dequantTbl[ qbuf[i] & msk ] * scl;
 	}
 }
 
+void KwlFile::DecompressAdd( const Byte *qbuf, Float *buf, Int size, Float scl )
+{
+	KWLKIT_PROFILE_SCOPE( profile, PROFILE_DEQUANT );
+	Int msk = (1 << hdr.quantBits)-1;
+	for ( Int i=0; i<size; i++ ) {
+		buf[i] += dequantTbl[ qbuf[i] & msk ] * scl;
+	}
+}
+
 // rewind (for loop-streaming)
 bool KwlFile::Rewind()
 {
@@ -7,6 +7,7 @@
 
 #include "../Base/Types.h"
 #include "../Base/Array.h"
+#include "../Base/Profile.h"
 #include "../Mdct/Mdct.h"
 #include "../Sample/SampleFormat.h"
 
@@ -14,6 +15,7 @@ namespace KwlKit
 {
 class Stream;
 class InflateStream;
+class InflatePool;
 
 // my own simple audio compressed format
 // everything is little endian
@@ -28,6 +30,13 @@ public:
 		KWL_NO_QBIAS		=	8,		// no quantizer bias (seems a tiny bit better in terms of quality)
 		KWL_HALF_FLOAT		=	16		// use half-float representation to improve compression
 	};
+	// output sample rate reduction (decoder only)
+	enum DecodeScale
+	{
+		DECODE_SCALE_FULL		=	0,		// full sample rate (default)
+		DECODE_SCALE_HALF		=	1,		// 1/2 sample rate
+		DECODE_SCALE_QUARTER	=	2		// 1/4 sample rate
+	};
 	struct Header
 	{
 		Byte magic[4];				// kwl, 0x1a
@@ -53,6 +62,23 @@ public:
 	KwlFile();
 	~KwlFile();
 
+	// set decode scale (DecodeScale); takes effect on next Open/Rewind
+	// reduced scale drops upper part of the spectrum and uses a shorter iMDCT
+	// so that output is produced directly at lower sample rate (no resampling needed)
+	bool SetDecodeScale( Int scale );
+
+	inline Int GetDecodeScale() const {
+		return decodeShift;
+	}
+
+	// decode multichannel streams as mono (takes effect on next Open/Rewind)
+	// channels are averaged in MDCT domain so only one iMDCT per frame is needed
+	void SetDecodeMono( bool mono );
+
+	inline bool GetDecodeMono() const {
+		return decodeMono;
+	}
+
 	// open for reading
 	bool Open( Stream &s, bool owned = 0 );
 	bool Close();
@@ -65,17 +91,28 @@ public:
 	// rewind (for loop-streaming)
 	bool Rewind();
 
+	// note: reflects decode scale
 	inline Int GetSampleRate() const {
-		return hdr.sampleRate;
+		return (Int)(hdr.sampleRate >> outShift);
 	}
 
+	// note: reflects mono decoding
 	inline Int GetNumChannels() const {
-		return hdr.numChannels;
+		return outChannels;
 	}
 
 	// get length in seconds (r/o)
 	Float GetLength() const;
 
+	// set profiling stats sink (can be null), only used if KWLKIT_PROFILE is enabled
+	void SetProfileStats( ProfileStats *stats );
+
+	// borrow Inflate context from pool on Open and return it on Close (null = keep own context)
+	// takes effect on next Open; decoder storage is kept across Close/Open either way
+	inline void SetInflatePool( InflatePool *pool ) {
+		inflatePool = pool;
+	}
+
 private:
 	Stream *stream;							// refptr
 	Stream *ownedStream;					// owned (if any)
@@ -95,6 +132,9 @@ private:
 
 	Mdct<Float> *outMdct;
 	InflateStream *inflate;
+	InflatePool *inflatePool;				// refptr
+	InflatePool *inflateOwner;				// pool inflate was borrowed from (if any)
+	ProfileStats *profile;
 
 	Array< Float > dequantTbl;
 
@@ -102,11 +142,23 @@ private:
 	// this avoids copying
 	Int outBase;
 	Int outXor;
+	// output (decoded) block size, less than hdr.blockSize when decoding at reduced scale
+	Int outBlockSize;
+	// decode scale shift (requested, actual)
+	Int decodeShift;
+	Int outShift;
+	// number of output channels (1 when decoding as mono)
+	Int outChannels;
+	bool decodeMono;
 	// mdct normalized mode?
 	bool mdctNorm;
+	// full block size outMdct scales were built for
+	Int mdctBlockSize;
 
 	bool DecompressFrame();
+	void DecodeChannel( Int ch );
 	void Decompress( const Byte *qbuf, Float *buf, Int size, Float scl );
+	void DecompressAdd( const Byte *qbuf, Float *buf, Int size, Float scl );
 	void ResetState();
 	bool ParseHeader();
 	void InitDequantTable();
@@ -10,14 +10,26 @@
 #if !KWLKIT_SEPARATE
 #	include "Base/BitStream.cpp"
 #	include "Base/Limits.cpp"
+#	include "Base/MappedFile.cpp"
 #	include "Base/Math.cpp"
 #	include "Base/Memory.cpp"
+#	include "Base/MemoryStream.cpp"
 #	include "Base/Stream.cpp"
+#	include "Base/Thread.cpp"
+#	include "Base/Timer.cpp"
 #	include "Compress/Adler32.cpp"
+#	include "Compress/BlockCache.cpp"
 #	include "Compress/Crc32.cpp"
+#	include "Compress/Deflate.cpp"
 #	include "Compress/Inflate.cpp"
+#	include "Compress/InflateIndex.cpp"
+#	include "Compress/InflatePool.cpp"
 #	include "Compress/InflateStream.cpp"
+#	include "Compress/ParallelInflate.cpp"
+#	include "Compress/SpeculativeInflate.cpp"
+#	include "Compress/ZipArchive.cpp"
 #	include "Kwl/KwlFile.cpp"
+#	include "Png/PngFile.cpp"
 #	include "Resample/Resampler.cpp"
 #	include "Sample/SampleUtil.cpp"
 #	include "Wav/WavFile.cpp"
@@ -28,7 +40,7 @@ namespace KwlKit
 {
 
 void Init() {
-	ComputeCrc32SlicingTables();
+	// nothing to do now (CRC-32 tables are precomputed), kept for compatibility
 }
 
 }
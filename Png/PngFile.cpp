@@ -0,0 +1,567 @@
+
+// (c) Martin Sedlak (mar) 2015
+// distributed under the Boost Software License, version 1.0
+// (see accompanying file License.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "PngFile.h"
+#include "../Compress/Inflate.h"
+#include "../Compress/Crc32.h"
+#include "../Base/Memory.h"
+#include "../Base/Templates.h"
+
+#if KWLKIT_SIMD_SSE2
+#	include <emmintrin.h>
+#endif
+
+namespace KwlKit
+{
+
+const Int PngFile::MAX_DIMENSION = 1 << 24;
+const Int PngFile::BATCH_SIZE = 64 << 10;
+
+static inline UInt PngRead32( const Byte *p )
+{
+	return ((UInt)p[0] << 24) | ((UInt)p[1] << 16) | ((UInt)p[2] << 8) | (UInt)p[3];
+}
+
+// PngFile::IdatStream
+
+PngFile::IdatStream::IdatStream() : stream(0), remaining(0), crc(0), end(1)
+{
+}
+
+void PngFile::IdatStream::Init( Stream &s, UInt size )
+{
+	stream = &s;
+	remaining = size;
+	crc = GetCrc32( "IDAT", 4 );
+	end = 0;
+}
+
+bool PngFile::IdatStream::NextChunk()
+{
+	Byte buf[12];
+	KWLKIT_RET_FALSE( stream->Read( buf, 12 ) );
+	KWLKIT_RET_FALSE( PngRead32( buf ) == crc );
+	UInt size = PngRead32( buf + 4 );
+	if ( MemCmp( buf + 8, "IDAT", 4 ) != 0 ) {
+		// data ends here (following chunks aren't needed)
+		end = 1;
+		return 1;
+	}
+	KWLKIT_RET_FALSE( size <= 0x7fffffffu );
+	remaining = size;
+	crc = GetCrc32( buf + 8, 4 );
+	return 1;
+}
+
+bool PngFile::IdatStream::Read( void *buf, Int count, Int &nread )
+{
+	KWLKIT_ASSERT( buf && count >= 0 );
+	nread = 0;
+	Byte *dst = static_cast<Byte *>(buf);
+	while ( count > 0 && !end ) {
+		if ( !remaining ) {
+			KWLKIT_RET_FALSE( NextChunk() );
+			continue;
+		}
+		Int n = (Int)Min( (UInt)count, remaining );
+		KWLKIT_RET_FALSE( stream->Read( dst, n ) );
+		crc = GetCrc32( dst, (size_t)n, crc );
+		remaining -= (UInt)n;
+		dst += n;
+		nread += n;
+		count -= n;
+	}
+	return 1;
+}
+
+// PngFile
+
+PngFile::PngFile() : stream(0), ownedStream(0), width(0), height(0), bitDepth(0), colorType(PNG_GRAY),
+	numChannels(0), paletteSize(0), transparent(0), decoded(0)
+{
+}
+
+PngFile::~PngFile()
+{
+	Close();
+}
+
+bool PngFile::Open( Stream &s, bool owned )
+{
+	if ( !Close() ) {
+		return 0;
+	}
+	stream = &s;
+	if ( owned ) {
+		ownedStream = &s;
+	}
+	if ( !ParseHeader() ) {
+		Close();
+		return 0;
+	}
+	return 1;
+}
+
+bool PngFile::Close()
+{
+	if ( !stream ) {
+		return 1;
+	}
+	stream = 0;
+	delete ownedStream;
+	ownedStream = 0;
+	width = height = bitDepth = numChannels = 0;
+	colorType = PNG_GRAY;
+	paletteSize = 0;
+	transparent = 0;
+	decoded = 0;
+	return 1;
+}
+
+bool PngFile::ReadChunkHeader( UInt &size, Byte *type )
+{
+	Byte buf[8];
+	KWLKIT_RET_FALSE( stream->Read( buf, 8 ) );
+	size = PngRead32( buf );
+	MemCpy( type, buf + 4, 4 );
+	return size <= 0x7fffffffu;
+}
+
+bool PngFile::ReadChunk( const Byte *type, UInt size, Array< Byte > &data )
+{
+	data.Resize( (Int)size + 4 );
+	KWLKIT_RET_FALSE( stream->Read( data.GetData(), (Int)size + 4 ) );
+	UInt crc = GetCrc32( data.GetData(), size, GetCrc32( type, 4 ) );
+	return PngRead32( data.GetData() + size ) == crc;
+}
+
+bool PngFile::ParseHeader()
+{
+	static const Byte signature[8] = { 137, 'P', 'N', 'G', 13, 10, 26, 10 };
+	Byte sig[8];
+	KWLKIT_RET_FALSE( stream->Read( sig, 8 ) && MemCmp( sig, signature, 8 ) == 0 );
+
+	Array< Byte > data;
+	UInt size;
+	Byte type[4];
+	KWLKIT_RET_FALSE( ReadChunkHeader( size, type ) && MemCmp( type, "IHDR", 4 ) == 0 && size == 13 );
+	KWLKIT_RET_FALSE( ReadChunk( type, size, data ) );
+	UInt w = PngRead32( data.GetData() );
+	UInt h = PngRead32( data.GetData() + 4 );
+	KWLKIT_RET_FALSE( w && h && w <= (UInt)MAX_DIMENSION && h <= (UInt)MAX_DIMENSION );
+	width = (Int)w;
+	height = (Int)h;
+	bitDepth = data[8];
+	colorType = (ColorType)data[9];
+	// compression, filter method, interlace (Adam7 not supported)
+	KWLKIT_RET_FALSE( !data[10] && !data[11] && !data[12] );
+
+	switch( colorType ) {
+	case PNG_GRAY:
+		KWLKIT_RET_FALSE( bitDepth == 1 || bitDepth == 2 || bitDepth == 4 || bitDepth == 8 );
+		numChannels = 1;
+		break;
+	case PNG_PALETTE:
+		KWLKIT_RET_FALSE( bitDepth == 1 || bitDepth == 2 || bitDepth == 4 || bitDepth == 8 );
+		break;
+	case PNG_RGB:
+		KWLKIT_RET_FALSE( bitDepth == 8 );
+		numChannels = 3;
+		break;
+	case PNG_GRAY_ALPHA:
+		KWLKIT_RET_FALSE( bitDepth == 8 );
+		numChannels = 2;
+		break;
+	case PNG_RGBA:
+		KWLKIT_RET_FALSE( bitDepth == 8 );
+		numChannels = 4;
+		break;
+	default:
+		return 0;
+	}
+
+	// out of range palette indices decode as opaque black
+	for ( Int i=0; i<256; i++ ) {
+		palette[i*4] = palette[i*4+1] = palette[i*4+2] = 0;
+		palette[i*4+3] = 255;
+	}
+
+	for (;;) {
+		KWLKIT_RET_FALSE( ReadChunkHeader( size, type ) );
+		if ( MemCmp( type, "IDAT", 4 ) == 0 ) {
+			idat.Init( *stream, size );
+			break;
+		}
+		if ( MemCmp( type, "PLTE", 4 ) == 0 ) {
+			KWLKIT_RET_FALSE( size && size % 3 == 0 && size <= 256*3 && ReadChunk( type, size, data ) );
+			paletteSize = (Int)size / 3;
+			for ( Int i=0; i<paletteSize; i++ ) {
+				MemCpy( palette + i*4, data.GetData() + i*3, 3 );
+			}
+		} else if ( MemCmp( type, "tRNS", 4 ) == 0 ) {
+			KWLKIT_RET_FALSE( ReadChunk( type, size, data ) );
+			// color key transparency of gray/RGB images is ignored
+			if ( colorType == PNG_PALETTE ) {
+				KWLKIT_RET_FALSE( size <= 256 );
+				for ( UInt i=0; i<size; i++ ) {
+					palette[i*4+3] = data[i];
+				}
+				transparent = 1;
+			}
+		} else if ( !(type[0] & 32) ) {
+			// unknown critical chunk (or IEND before image data)
+			return 0;
+		} else {
+			KWLKIT_RET_FALSE( stream->SkipRead( (Long)size + 4 ) );
+		}
+	}
+
+	if ( colorType == PNG_PALETTE ) {
+		KWLKIT_RET_FALSE( paletteSize );
+		numChannels = transparent ? 4 : 3;
+	}
+	return 1;
+}
+
+// unfilter kernels
+
+static inline Byte PngPaeth( Int a, Int b, Int c )
+{
+	Int pa = Abs( b - c );
+	Int pb = Abs( a - c );
+	Int pc = Abs( a + b - 2*c );
+	return (Byte)(pa <= pb && pa <= pc ? a : pb <= pc ? b : c);
+}
+
+static void PngUnfilterSub( const Byte *src, Byte *dst, Int rowBytes, Int bpp )
+{
+	for ( Int i=0; i<bpp; i++ ) {
+		dst[i] = src[i];
+	}
+	for ( Int i=bpp; i<rowBytes; i++ ) {
+		dst[i] = (Byte)(src[i] + dst[i-bpp]);
+	}
+}
+
+static void PngUnfilterUp( const Byte *src, Byte *dst, const Byte *prior, Int rowBytes )
+{
+	Int i = 0;
+#if KWLKIT_SIMD_SSE2
+	for ( ; i + 16 <= rowBytes; i += 16 ) {
+		__m128i x = _mm_loadu_si128( reinterpret_cast<const __m128i *>(src + i) );
+		__m128i b = _mm_loadu_si128( reinterpret_cast<const __m128i *>(prior + i) );
+		_mm_storeu_si128( reinterpret_cast<__m128i *>(dst + i), _mm_add_epi8( x, b ) );
+	}
+#endif
+	for ( ; i<rowBytes; i++ ) {
+		dst[i] = (Byte)(src[i] + prior[i]);
+	}
+}
+
+static void PngUnfilterAvg( const Byte *src, Byte *dst, const Byte *prior, Int rowBytes, Int bpp )
+{
+	for ( Int i=0; i<bpp; i++ ) {
+		dst[i] = (Byte)(src[i] + (prior[i] >> 1));
+	}
+	for ( Int i=bpp; i<rowBytes; i++ ) {
+		dst[i] = (Byte)(src[i] + ((dst[i-bpp] + prior[i]) >> 1));
+	}
+}
+
+static void PngUnfilterPaeth( const Byte *src, Byte *dst, const Byte *prior, Int rowBytes, Int bpp )
+{
+	for ( Int i=0; i<bpp; i++ ) {
+		dst[i] = (Byte)(src[i] + prior[i]);
+	}
+	for ( Int i=bpp; i<rowBytes; i++ ) {
+		dst[i] = (Byte)(src[i] + PngPaeth( dst[i-bpp], prior[i], prior[i-bpp] ));
+	}
+}
+
+#if KWLKIT_SIMD_SSE2
+
+// 3 or 4 byte pixels in low lanes; the dependency on the left pixel keeps these at one pixel per step
+template< Int bpp > static inline __m128i PngLoadPixel( const Byte *p )
+{
+	if ( bpp == 4 ) {
+		return _mm_cvtsi32_si128( LoadUnaligned<Int>( p ) );
+	}
+	return _mm_cvtsi32_si128( (Int)((UInt)p[0] | ((UInt)p[1] << 8) | ((UInt)p[2] << 16)) );
+}
+
+template< Int bpp > static inline void PngStorePixel( Byte *p, __m128i v )
+{
+	Int x = _mm_cvtsi128_si32( v );
+	if ( bpp == 4 ) {
+		StoreUnaligned<Int>( p, x );
+		return;
+	}
+	p[0] = (Byte)x;
+	p[1] = (Byte)(x >> 8);
+	p[2] = (Byte)(x >> 16);
+}
+
+static void PngUnfilterSub4Sse2( const Byte *src, Byte *dst, Int rowBytes )
+{
+	// prefix sum of 4 pixels at once
+	__m128i last = _mm_setzero_si128();
+	Int i = 0;
+	for ( ; i + 16 <= rowBytes; i += 16 ) {
+		__m128i x = _mm_loadu_si128( reinterpret_cast<const __m128i *>(src + i) );
+		x = _mm_add_epi8( x, _mm_slli_si128( x, 4 ) );
+		x = _mm_add_epi8( x, _mm_slli_si128( x, 8 ) );
+		x = _mm_add_epi8( x, last );
+		_mm_storeu_si128( reinterpret_cast<__m128i *>(dst + i), x );
+		last = _mm_shuffle_epi32( x, 0xff );
+	}
+	for ( ; i<rowBytes; i += 4 ) {
+		last = _mm_add_epi8( last, PngLoadPixel<4>( src + i ) );
+		PngStorePixel<4>( dst + i, last );
+	}
+}
+
+static void PngUnfilterSub3Sse2( const Byte *src, Byte *dst, Int rowBytes )
+{
+	__m128i a = _mm_setzero_si128();
+	for ( Int i=0; i<rowBytes; i += 3 ) {
+		a = _mm_add_epi8( a, PngLoadPixel<3>( src + i ) );
+		PngStorePixel<3>( dst + i, a );
+	}
+}
+
+template< Int bpp > static void PngUnfilterAvgSse2( const Byte *src, Byte *dst, const Byte *prior, Int rowBytes )
+{
+	const __m128i one = _mm_set1_epi8( 1 );
+	__m128i a = _mm_setzero_si128();
+	for ( Int i=0; i<rowBytes; i += bpp ) {
+		__m128i b = PngLoadPixel<bpp>( prior + i );
+		// avg_epu8 rounds up
+		__m128i avg = _mm_sub_epi8( _mm_avg_epu8( a, b ), _mm_and_si128( _mm_xor_si128( a, b ), one ) );
+		a = _mm_add_epi8( avg, PngLoadPixel<bpp>( src + i ) );
+		PngStorePixel<bpp>( dst + i, a );
+	}
+}
+
+static inline __m128i PngAbs16( __m128i x )
+{
+	return _mm_max_epi16( x, _mm_sub_epi16( _mm_setzero_si128(), x ) );
+}
+
+static inline __m128i PngSelect( __m128i mask, __m128i x, __m128i y )
+{
+	return _mm_or_si128( _mm_and_si128( mask, x ), _mm_andnot_si128( mask, y ) );
+}
+
+template< Int bpp > static void PngUnfilterPaethSse2( const Byte *src, Byte *dst, const Byte *prior, Int rowBytes )
+{
+	// 16-bit lanes
+	const __m128i zero = _mm_setzero_si128();
+	__m128i a = zero;
+	__m128i c = zero;
+	for ( Int i=0; i<rowBytes; i += bpp ) {
+		__m128i b = _mm_unpacklo_epi8( PngLoadPixel<bpp>( prior + i ), zero );
+		__m128i x = _mm_unpacklo_epi8( PngLoadPixel<bpp>( src + i ), zero );
+		// p = a + b - c: pa = |p - a|, pb = |p - b|, pc = |p - c|
+		__m128i pa = _mm_sub_epi16( b, c );
+		__m128i pb = _mm_sub_epi16( a, c );
+		__m128i pc = PngAbs16( _mm_add_epi16( pa, pb ) );
+		pa = PngAbs16( pa );
+		pb = PngAbs16( pb );
+		__m128i smallest = _mm_min_epi16( pc, _mm_min_epi16( pa, pb ) );
+		__m128i pred = PngSelect( _mm_cmpeq_epi16( pa, smallest ), a,
+			PngSelect( _mm_cmpeq_epi16( pb, smallest ), b, c ) );
+		a = _mm_and_si128( _mm_add_epi16( x, pred ), _mm_set1_epi16( 255 ) );
+		PngStorePixel<bpp>( dst + i, _mm_packus_epi16( a, a ) );
+		c = b;
+	}
+}
+
+#endif
+
+void PngFile::Unfilter( Int filter, const Byte *src, Byte *dst, const Byte *prior, Int rowBytes, Int bpp )
+{
+	switch( filter ) {
+	case 0:
+		MemCpy( dst, src, (size_t)rowBytes );
+		break;
+	case 1:
+#if KWLKIT_SIMD_SSE2
+		if ( bpp == 4 ) {
+			PngUnfilterSub4Sse2( src, dst, rowBytes );
+			break;
+		}
+		if ( bpp == 3 ) {
+			PngUnfilterSub3Sse2( src, dst, rowBytes );
+			break;
+		}
+#endif
+		PngUnfilterSub( src, dst, rowBytes, bpp );
+		break;
+	case 2:
+		PngUnfilterUp( src, dst, prior, rowBytes );
+		break;
+	case 3:
+#if KWLKIT_SIMD_SSE2
+		if ( bpp == 4 ) {
+			PngUnfilterAvgSse2<4>( src, dst, prior, rowBytes );
+			break;
+		}
+		if ( bpp == 3 ) {
+			PngUnfilterAvgSse2<3>( src, dst, prior, rowBytes );
+			break;
+		}
+#endif
+		PngUnfilterAvg( src, dst, prior, rowBytes, bpp );
+		break;
+	default:
+#if KWLKIT_SIMD_SSE2
+		if ( bpp == 4 ) {
+			PngUnfilterPaethSse2<4>( src, dst, prior, rowBytes );
+			break;
+		}
+		if ( bpp == 3 ) {
+			PngUnfilterPaethSse2<3>( src, dst, prior, rowBytes );
+			break;
+		}
+#endif
+		PngUnfilterPaeth( src, dst, prior, rowBytes, bpp );
+		break;
+	}
+}
+
+void PngFile::ExpandRow( const Byte *src, Byte *dst, Int channels ) const
+{
+	if ( bitDepth < 8 ) {
+		// packed pixels, MSBit first
+		Int mask = (1 << bitDepth) - 1;
+		// gray scale to 8 bits
+		Int scale = colorType == PNG_GRAY ? 255 / mask : 0;
+		for ( Int x=0; x<width; x++ ) {
+			Int bit = x * bitDepth;
+			Int v = (src[bit >> 3] >> (8 - bitDepth - (bit & 7))) & mask;
+			if ( scale ) {
+				v *= scale;
+				dst[0] = (Byte)v;
+				if ( channels == 4 ) {
+					dst[1] = dst[2] = (Byte)v;
+					dst[3] = 255;
+				}
+			} else {
+				MemCpy( dst, palette + v*4, (size_t)channels );
+			}
+			dst += channels;
+		}
+		return;
+	}
+
+	switch( colorType ) {
+	case PNG_PALETTE:
+		if ( channels == 4 ) {
+			for ( Int x=0; x<width; x++ ) {
+				MemCpy( dst + x*4, palette + src[x]*4, 4 );
+			}
+		} else {
+			for ( Int x=0; x<width; x++ ) {
+				const Byte *p = palette + src[x]*4;
+				dst[x*3] = p[0];
+				dst[x*3+1] = p[1];
+				dst[x*3+2] = p[2];
+			}
+		}
+		break;
+	case PNG_GRAY:
+		for ( Int x=0; x<width; x++ ) {
+			dst[x*4] = dst[x*4+1] = dst[x*4+2] = src[x];
+			dst[x*4+3] = 255;
+		}
+		break;
+	case PNG_GRAY_ALPHA:
+		for ( Int x=0; x<width; x++ ) {
+			dst[x*4] = dst[x*4+1] = dst[x*4+2] = src[x*2];
+			dst[x*4+3] = src[x*2+1];
+		}
+		break;
+	default:
+		// RGB
+		for ( Int x=0; x<width; x++ ) {
+			dst[x*4] = src[x*3];
+			dst[x*4+1] = src[x*3+1];
+			dst[x*4+2] = src[x*3+2];
+			dst[x*4+3] = 255;
+		}
+		break;
+	}
+}
+
+bool PngFile::Decode( void *dst, Int pitch, Int channels )
+{
+	if ( !stream || decoded ) {
+		return 0;
+	}
+	decoded = 1;
+	if ( !channels ) {
+		channels = numChannels;
+	}
+	if ( channels != numChannels && channels != 4 ) {
+		return 0;
+	}
+	KWLKIT_ASSERT( dst && (Long)Abs( pitch ) >= (Long)width * channels );
+
+	Int srcChannels = colorType == PNG_RGB ? 3 : colorType == PNG_GRAY_ALPHA ? 2 : colorType == PNG_RGBA ? 4 : 1;
+	Int bitsPerPixel = srcChannels * bitDepth;
+	Int rowBytes = (Int)(((Long)width * bitsPerPixel + 7) >> 3);
+	// filter pixel distance
+	Int bpp = Max( bitsPerPixel >> 3, 1 );
+	// unfilter straight into dst (previous dst row is the prior row)
+	bool direct = bitDepth == 8 && colorType != PNG_PALETTE && channels == srcChannels;
+
+	// filter type byte + row; several rows are inflated at once
+	Int stride = rowBytes + 1;
+	Int batchRows = Min( Max( BATCH_SIZE / stride, 1 ), height );
+	Array< Byte > batch;
+	batch.Resize( batchRows * stride );
+	// zero row (prior of first row) and two rows for expansion
+	Array< Byte > rows;
+	rows.Resize( (direct ? 1 : 3) * rowBytes );
+	rows.MemSet( 0 );
+	Byte *cur = rows.GetData() + rowBytes;
+	Byte *prev = cur + rowBytes;
+	const Byte *prior = rows.GetData();
+
+	Inflate inf( idat );
+	inf.SetFormat( INF_ZLIB );
+
+	Byte *out = static_cast<Byte *>(dst);
+	const Byte *src = 0;
+	Int batchLeft = 0;
+	for ( Int y=0; y<height; y++, out += pitch ) {
+		if ( !batchLeft ) {
+			batchLeft = Min( batchRows, height - y );
+			Int nread;
+			KWLKIT_RET_FALSE( inf.Read( batch.GetData(), batchLeft * stride, nread ) && nread == batchLeft * stride );
+			src = batch.GetData();
+		}
+		Int filter = *src++;
+		KWLKIT_RET_FALSE( filter <= 4 );
+		if ( direct ) {
+			Unfilter( filter, src, out, prior, rowBytes, bpp );
+			prior = out;
+		} else {
+			Unfilter( filter, src, cur, prior, rowBytes, bpp );
+			ExpandRow( cur, out, channels );
+			prior = cur;
+			Swap( cur, prev );
+		}
+		src += rowBytes;
+		batchLeft--;
+	}
+
+	// verify Adler-32 (trailing data is ignored)
+	Byte tmp;
+	Int nread;
+	return inf.Read( &tmp, 1, nread );
+}
+
+}
@@ -0,0 +1,117 @@
+
+// (c) Martin Sedlak (mar) 2015
+// distributed under the Boost Software License, version 1.0
+// (see accompanying file License.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "../Base/Stream.h"
+#include "../Base/NoCopy.h"
+#include "../Base/Array.h"
+
+namespace KwlKit
+{
+
+// PNG reader built on Inflate
+// supports non-interlaced 8-bit gray, gray+alpha, RGB and RGBA, 1/2/4-bit gray (scaled to 8 bits)
+// and 1/2/4/8-bit palette (expanded to RGB, or RGBA if the image has transparency)
+// IDAT chunks are streamed into Inflate without concatenation and rows are unfiltered straight into
+// the caller's buffer
+class PngFile : public NoCopy
+{
+public:
+	enum ColorType
+	{
+		PNG_GRAY = 0,
+		PNG_RGB = 2,
+		PNG_PALETTE = 3,
+		PNG_GRAY_ALPHA = 4,
+		PNG_RGBA = 6
+	};
+
+	PngFile();
+	~PngFile();
+
+	// read header chunks (up to first IDAT)
+	bool Open( Stream &s, bool owned = 0 );
+	bool Close();
+
+	inline Int GetWidth() const {
+		return width;
+	}
+
+	inline Int GetHeight() const {
+		return height;
+	}
+
+	inline Int GetBitDepth() const {
+		return bitDepth;
+	}
+
+	inline ColorType GetColorType() const {
+		return colorType;
+	}
+
+	// channels of decoded pixels
+	inline Int GetNumChannels() const {
+		return numChannels;
+	}
+
+	// decode image into dst: rows are pitch bytes apart (negative = bottom-up), GetWidth()*channels bytes each
+	// channels = 0 => GetNumChannels(), 4 => always expand to RGBA (opaque alpha if none)
+	// can only be called once per Open
+	bool Decode( void *dst, Int pitch, Int channels = 0 );
+
+	// constants (for unity build)
+	static const Int MAX_DIMENSION;
+
+private:
+	// IDAT chunk data as a continuous stream (verifies chunk CRCs)
+	class IdatStream : public Stream
+	{
+	public:
+		KWLKIT_INJECT_STREAM()
+
+		IdatStream();
+
+		void Init( Stream &s, UInt size );
+		bool Read( void *buf, Int count, Int &nread );
+
+	private:
+		Stream *stream;
+		UInt remaining;
+		UInt crc;
+		bool end;
+
+		// verify CRC of current chunk and move to next one
+		bool NextChunk();
+	};
+
+	Stream *stream;							// refptr
+	Stream *ownedStream;					// owned (if any)
+	IdatStream idat;
+	Int width;
+	Int height;
+	Int bitDepth;
+	ColorType colorType;
+	Int numChannels;
+	// RGBA
+	Byte palette[256*4];
+	Int paletteSize;
+	bool transparent;
+	bool decoded;
+
+	bool ParseHeader();
+	bool ReadChunkHeader( UInt &size, Byte *type );
+	// read chunk data and verify CRC
+	bool ReadChunk( const Byte *type, UInt size, Array< Byte > &data );
+
+	// expand unfiltered row to 8-bit pixels
+	void ExpandRow( const Byte *src, Byte *dst, Int channels ) const;
+
+	static void Unfilter( Int filter, const Byte *src, Byte *dst, const Byte *prior, Int rowBytes, Int bpp );
+
+	static const Int BATCH_SIZE;
+};
+
+}
@@ -27,7 +27,7 @@ void WavFile::FormatChunk::FromLittle()
 // WavFile
 
 WavFile::WavFile() : stream(0), ownedStream(0), silentSamples(0), bytesLeft(0), dataBytesLeft(0),
-	kwl(0), wavSamFormat(0)
+	kwl(0), kwlDecodeScale(KwlFile::DECODE_SCALE_FULL), kwlDecodeMono(0), profile(0), wavSamFormat(0)
 {
 	MemSet( &format, 0, sizeof(format) );
 }
@@ -87,6 +87,28 @@ bool WavFile::Rewind()
 	return ParseHeader();
 }
 
+bool WavFile::SetDecodeScale( Int scale )
+{
+	if ( scale < KwlFile::DECODE_SCALE_FULL || scale > KwlFile::DECODE_SCALE_QUARTER ) {
+		return 0;
+	}
+	kwlDecodeScale = scale;
+	return 1;
+}
+
+void WavFile::SetDecodeMono( bool mono )
+{
+	kwlDecodeMono = mono;
+}
+
+void WavFile::SetProfileStats( ProfileStats *stats )
+{
+	profile = stats;
+	if ( kwl ) {
+		kwl->SetProfileStats( stats );
+	}
+}
+
 struct RiffHeader
 {
 	Byte id[4];
@@ -111,7 +133,10 @@ bool WavFile::ParseHeader()
 		// try to parse kwl
 		if ( !kwl ) {
 			kwl = new KwlFile;
+			kwl->SetProfileStats( profile );
 		}
+		kwl->SetDecodeScale( kwlDecodeScale );
+		kwl->SetDecodeMono( kwlDecodeMono );
 		KWLKIT_RET_FALSE( stream->Rewind() );
 		bool res = kwl->Open( *stream );
 		if ( res ) {
@@ -270,6 +295,7 @@ bool WavFile::UnpackData( Byte *&buf, Int &numSamples, Int numChannels, Int &num
 			return 0;
 		}
 
+		KWLKIT_PROFILE_SCOPE( profile, PROFILE_CONV_SAMPLES );
 		SampleConv::Convert( wavSamFormat & ~SAMPLE_FORMAT_UNSIGNED, format.numChannels,
 			samFormat, numChannels, blockBuffer.GetData(), buf, samRead );
 
@@ -8,6 +8,7 @@
 #include "../Base/Stream.h"
 #include "../Base/NoCopy.h"
 #include "../Base/Array.h"
+#include "../Base/Profile.h"
 #include "../Sample/SampleFormat.h"
 #include "../Kwl/KwlFile.h"
 
@@ -50,6 +51,16 @@ public:
 	// rewind (for loop-streaming)
 	bool Rewind();
 
+	// set kwl decode scale (see KwlFile::DecodeScale), must be called before Open
+	// no effect on PCM wavs
+	bool SetDecodeScale( Int scale );
+	// decode kwl as mono (channels mixed), must be called before Open
+	// no effect on PCM wavs
+	void SetDecodeMono( bool mono );
+
+	// set profiling stats sink (can be null), only used if KWLKIT_PROFILE is enabled
+	void SetProfileStats( ProfileStats *stats );
+
 	inline Int GetNumChannels() const {
 		return format.numChannels;
 	}
@@ -92,6 +103,10 @@ private:
 
 	// kwl support
 	KwlFile *kwl;
+	Int kwlDecodeScale;
+	bool kwlDecodeMono;
+
+	ProfileStats *profile;
 
 	// sample format for wave (no meaning for compressed formats such as ADPCM)
 	UInt wavSamFormat;
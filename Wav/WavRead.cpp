@@ -12,7 +12,9 @@ namespace KwlKit
 // WavRead
 
 WavRead::WavRead() : position(0), resampler(&linResampler), sampleRate(44100), sampleFormat(SAMPLE_FORMAT_16S),
-	numChannels(2), resInit(0), doLoop(0), isOpen(0), doneFlag(0) {
+	numChannels(2), resInit(0), doLoop(0), isOpen(0), doneFlag(0)
+{
+	wf.SetProfileStats( &profile );
 }
 
 WavRead::~WavRead() {
@@ -35,6 +37,16 @@ bool WavRead::OpenOwn( Stream *s )
 	return Open( *s, 1 );
 }
 
+bool WavRead::SetDecodeScale( Int scale )
+{
+	return wf.SetDecodeScale( scale );
+}
+
+void WavRead::SetDecodeMono( bool mono )
+{
+	wf.SetDecodeMono( mono );
+}
+
 bool WavRead::SetSampleRate( Int srate )
 {
 	if ( sampleRate == srate ) {
@@ -124,7 +136,10 @@ bool WavRead::ReadSamples( void *buffer, Int samples, Int &nread )
 			// zero-fill the rest
 			MemSet( b, 0, (needSam - nread) * samSz * numChannels );
 		}
-		resampler->Resample( buffer, samples );
+		{
+			KWLKIT_PROFILE_SCOPE( &profile, PROFILE_RESAMPLE );
+			resampler->Resample( buffer, samples );
+		}
 		nread = samples;
 		return 1;
 	}
@@ -22,6 +22,13 @@ public:
 	// open owned
 	bool OpenOwn( Stream *s );
 
+	// set kwl decode scale (see KwlFile::DecodeScale), must be called before Open
+	// decoding kwl at 1/2 or 1/4 rate directly is much cheaper than resampling
+	bool SetDecodeScale( Int scale );
+	// decode kwl as mono, must be called before Open
+	// mixes all channels and halves decoding cost for stereo (ideal for positional sources)
+	void SetDecodeMono( bool mono );
+
 	// set looping (default: 0)
 	void SetLooping( bool looping = 0 );
 
@@ -58,6 +65,14 @@ public:
 	// (very slow, can break playback!)
 	bool SeekPosition( Float pos );
 
+	// get per-stage decode profiling stats (all zeros unless built with KWLKIT_PROFILE)
+	inline const ProfileStats &GetProfileStats() const {
+		return profile;
+	}
+	inline void ResetProfileStats() {
+		profile.Reset();
+	}
+
 private:
 	// current playback position
 	Long position;
@@ -71,6 +86,7 @@ private:
 	bool doLoop;
 	bool isOpen;
 	bool doneFlag;
+	ProfileStats profile;
 
 	bool RewindInternal();
 };